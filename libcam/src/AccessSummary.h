@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef ACCESSSUMMARY_H
+#define ACCESSSUMMARY_H
+
+#include <cstdint>
+
+/*
+ * A summary of the memory touched by the accesses of an instruction, written
+ * by the memory tracer to memory_accesses/access_summaries.txt, one line per
+ * trace:
+ *   <instruction id> <r|w> <lowest address> <highest address + 1> <words>
+ * where the words, in hex, are a bitmap of the pages touched, page p setting
+ * bit p modulo ACCESS_SUMMARY_WORDS*64.  Two traces whose extents or bitmaps
+ * do not intersect can have no aliases.
+ */
+
+#define ACCESS_SUMMARY_PAGE_SHIFT 12
+#define ACCESS_SUMMARY_WORDS 32
+#define ACCESS_SUMMARY_FILE "access_summaries.txt"
+
+struct AccessSummary{
+  uintptr_t lowest;    /* Lowest address accessed */
+  uintptr_t highest;   /* One past the highest address accessed */
+  uint64_t pages[ACCESS_SUMMARY_WORDS];
+
+  AccessSummary() : lowest(UINTPTR_MAX), highest(0) {
+    for(int i = 0; i < ACCESS_SUMMARY_WORDS; i++)
+      pages[i] = 0;
+  }
+
+  bool empty() const { return highest <= lowest; }
+
+  void add(uintptr_t addr, uint64_t len){
+    if(addr < lowest)
+      lowest = addr;
+    if(addr + len > highest)
+      highest = addr + len;
+    uintptr_t page = addr >> ACCESS_SUMMARY_PAGE_SHIFT;
+    uintptr_t last = (addr + len - 1) >> ACCESS_SUMMARY_PAGE_SHIFT;
+    /* Once every bit is set there is no need to carry on */
+    if(last - page >= ACCESS_SUMMARY_WORDS*64)
+      last = page + ACCESS_SUMMARY_WORDS*64 - 1;
+    for(; page <= last; page++)
+      pages[(page/64)%ACCESS_SUMMARY_WORDS] |= (uint64_t)1 << (page%64);
+  }
+
+  void merge(const AccessSummary& other){
+    if(other.lowest < lowest)
+      lowest = other.lowest;
+    if(other.highest > highest)
+      highest = other.highest;
+    for(int i = 0; i < ACCESS_SUMMARY_WORDS; i++)
+      pages[i] |= other.pages[i];
+  }
+
+  /* Returns false if no address can be accessed by both */
+  bool mayIntersect(const AccessSummary& other) const{
+    if(empty() || other.empty() || highest <= other.lowest || other.highest <= lowest)
+      return false;
+    uint64_t common = 0;
+    for(int i = 0; i < ACCESS_SUMMARY_WORDS; i++)
+      common |= pages[i] & other.pages[i];
+    return common != 0;
+  }
+};
+
+#endif
@@ -18,24 +18,199 @@
  */
 
 #include "BZ2ParserState.h"
+#include "WorkerPool.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 using namespace std;
 
+/**
+ * Number of descriptors left for the rest of the program when sizing the
+ * descriptor pool from RLIMIT_NOFILE.
+ **/
+#define DESCRIPTOR_POOL_RESERVE 64
+
+/**
+ * Open descriptors of the trace files, shared by all the parsers and closed
+ * in least recently used order.  Its size can be set with the environment
+ * variable LIBCAM_MAX_OPEN_TRACES.  Parsers may read on different threads, a
+ * descriptor is only used while holding the lock, so it is not closed mid-read.
+ **/
+class DescriptorPool{
+  typedef list<pair<const BZ2ParserState *, int> > LRUList;
+  LRUList lru;
+  unordered_map<const BZ2ParserState *, LRUList::iterator> descriptors;
+  size_t capacity;
+  mutex lock;
+
+  /* Return an open descriptor of filename for owner, with the lock held */
+  int acquire(const BZ2ParserState *owner, const char *filename){
+    auto d = descriptors.find(owner);
+    if(d != descriptors.end()){
+      lru.splice(lru.begin(), lru, d->second);
+      return d->second->second;
+    }
+    if(lru.size() >= capacity){
+      close(lru.back().second);
+      descriptors.erase(lru.back().first);
+      lru.pop_back();
+    }
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0){
+      cerr << "Error opening file: " << filename << endl;
+      perror(NULL);
+      abort();
+    }
+    lru.push_front(pair<const BZ2ParserState *, int>(owner, fd));
+    descriptors[owner] = lru.begin();
+    return fd;
+  }
+
+public:
+  DescriptorPool(){
+    struct rlimit limit;
+    capacity = 1024;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+      capacity = limit.rlim_cur > 2*DESCRIPTOR_POOL_RESERVE ? limit.rlim_cur - DESCRIPTOR_POOL_RESERVE : limit.rlim_cur/2;
+    char *env = getenv("LIBCAM_MAX_OPEN_TRACES");
+    if(env)
+      capacity = atoi(env);
+    if(capacity < 1){
+      cerr << "LIBCAM_MAX_OPEN_TRACES must be at least 1\n";
+      abort();
+    }
+  }
+
+  /* Read len bytes of filename at offset for owner */
+  ssize_t read(const BZ2ParserState *owner, const char *filename, char *buf, size_t len, off_t offset){
+    unique_lock<mutex> guard(lock);
+    return pread(acquire(owner, filename), buf, len, offset);
+  }
+
+  /* Close the descriptor of owner, if it has one */
+  void release(const BZ2ParserState *owner){
+    unique_lock<mutex> guard(lock);
+    auto d = descriptors.find(owner);
+    if(d == descriptors.end())
+      return;
+    close(d->second->second);
+    lru.erase(d->second);
+    descriptors.erase(d);
+  }
+};
+
+static DescriptorPool &descriptorPool(){
+  static DescriptorPool pool;
+  return pool;
+}
+
+/**
+ * Default total size in bytes of the parser buffers.
+ **/
+#define PARSER_BUFFER_MEMORY ((size_t)268435456ULL)
+
+/**
+ * Buffers decompressed data is parsed from, shared by all the parsers.  The
+ * buffers given back are kept for reuse, by size, and freed when the total
+ * would go over the limit, which can be set with the environment variable
+ * LIBCAM_PARSER_BUFFER_MEMORY.  Once the limit is reached parsers are given
+ * the smallest buffers.
+ **/
+class ParserBufferPool{
+  unordered_map<size_t, list<char *> > idle;
+  size_t idleMemory;
+  size_t leasedMemory;
+  size_t capacity;
+  mutex lock;
+
+  void freeIdle(size_t needed){
+    for(auto i = idle.begin(); i != idle.end() && leasedMemory + idleMemory + needed > capacity; i++){
+      while(!i->second.empty() && leasedMemory + idleMemory + needed > capacity){
+        free(i->second.front());
+        i->second.pop_front();
+        idleMemory -= i->first;
+      }
+    }
+  }
+
+public:
+  ParserBufferPool() : idleMemory(0), leasedMemory(0), capacity(PARSER_BUFFER_MEMORY) {
+    char *env = getenv("LIBCAM_PARSER_BUFFER_MEMORY");
+    if(env)
+      capacity = strtoull(env, NULL, 10);
+  }
+
+  /* Return a buffer of at most size bytes, plus two for the NULLs required by flex, setting size to its size */
+  char *lease(size_t &size){
+    unique_lock<mutex> guard(lock);
+    freeIdle(size);
+    if(leasedMemory + size > capacity)
+      size = BZ_MINBUFSIZE;
+    leasedMemory += size;
+    list<char *> &sized = idle[size];
+    if(!sized.empty()){
+      char *buf = sized.front();
+      sized.pop_front();
+      idleMemory -= size;
+      return buf;
+    }
+    return (char *)malloc(size + 2);
+  }
+
+  void release(char *buf, size_t size){
+    unique_lock<mutex> guard(lock);
+    leasedMemory -= size;
+    idle[size].push_front(buf);
+    idleMemory += size;
+    freeIdle(0);
+  }
+};
+
+static ParserBufferPool &bufferPool(){
+  static ParserBufferPool pool;
+  return pool;
+}
+
+/**
+ * Default size in bytes from which files are decompressed in parallel.
+ **/
+#define PARALLEL_DECOMPRESS_SIZE ((off_t)16777216)
+
+static off_t parallelDecompressSize(){
+  static off_t minSize = getenv("LIBCAM_PARALLEL_DECOMPRESS_SIZE") ? strtoll(getenv("LIBCAM_PARALLEL_DECOMPRESS_SIZE"), NULL, 10) : PARALLEL_DECOMPRESS_SIZE;
+  return minSize;
+}
+
+static bool mapTraces(){
+  static bool map = getenv("LIBCAM_MMAP_TRACES") != NULL;
+  return map;
+}
+
 BZ2ParserState::BZ2ParserState(const char * _filename
                              , int (*_lex)(void*)
                              , YY_BUFFER_STATE (*_scan_buffer)(char*, yy_size_t)
                              , void (*_switch_to_buffer)(YY_BUFFER_STATE)
                              , void (*_delete_buffer)(YY_BUFFER_STATE)
                              , void *_arg
-  ) : f(NULL)
-    , fPosition(0)
+  ) : fPosition(0)
     , eof(false)
-    , bzf(NULL)
-    , unused(malloc(BZ_MAX_UNUSED))
-    , nUnused(0)
-    , status(BZ_OK)
+    , streamOpen(false)
+    , inbuf(NULL)
+    , mapped(NULL)
+    , mappedSize(0)
+    , parallel(NULL)
+    , checkedParallel(false)
+    , buf(NULL)
+    , bufSize(0)
+    , nextBufSize(BZ_MINBUFSIZE)
     , rem(0)
     , count(0)
     , lex(_lex)
@@ -47,11 +222,22 @@ BZ2ParserState::BZ2ParserState(const char * _filename
   {
     filename = (char *)malloc(strlen(_filename)+1);
     strcpy(filename, _filename);
+    memset(&strm, 0, sizeof(strm));
   }
 
+BZ2ParserState::BZ2ParserState(const char * _filename)
+  : BZ2ParserState(_filename, NULL, NULL, NULL, NULL, NULL) {}
+
 BZ2ParserState::~BZ2ParserState(){
+  delete parallel;
+  if(streamOpen)
+    BZ2_bzDecompressEnd(&strm);
+  if(mapped)
+    munmap(mapped, mappedSize);
+  descriptorPool().release(this);
+  releaseBuffer();
   free(filename);
-  free(unused);
+  free(inbuf);
 }
 
 int BZ2ParserState::doLexing(int bufLength){
@@ -67,102 +253,217 @@ int BZ2ParserState::doLexing(int bufLength){
   else{
     activeParser = false;
     delete_buffer(yybuf);
-    if((eof || feof(f)) && nUnused == 0 && bzf == NULL)
+    if(finished())
       return 0;
     else
       return 1;
   }
 }
 
-void BZ2ParserState::openFile(){
-  f = fopen(filename, "r");
-  if(!f){
+void BZ2ParserState::leaseBuffer(){
+  if(buf)
+    return;
+  bufSize = nextBufSize;
+  buf = bufferPool().lease(bufSize);
+}
+
+void BZ2ParserState::releaseBuffer(){
+  if(!buf)
+    return;
+  bufferPool().release(buf, bufSize);
+  buf = NULL;
+}
+
+bool BZ2ParserState::finished(){
+  if(parallel)
+    return parallel->finished();
+  return eof && !streamOpen && strm.avail_in == 0;
+}
+
+void BZ2ParserState::mapFile(){
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) != 0){
     cerr << "Error opening file: " << filename << endl;
     perror(NULL);
     abort();
   }
-  fseeko(f, fPosition, SEEK_SET);
+  mappedSize = st.st_size;
+  if(mappedSize > 0){
+    mapped = (char *)mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped == MAP_FAILED){
+      cerr << "Error mapping file: " << filename << endl;
+      perror(NULL);
+      abort();
+    }
+    madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+  }
+  close(fd);
 }
 
-void BZ2ParserState::closeFile(){
-  if(feof(f))
-    eof = true;
-  else
-    fPosition = ftello(f);
-  fclose(f);
-  f = NULL;
+void BZ2ParserState::checkParallel(){
+  checkedParallel = true;
+  struct stat st;
+  if(WorkerPool::shared().size() < 2 || stat(filename, &st) != 0 || st.st_size < parallelDecompressSize())
+    return;
+  mapFile();
+  eof = true;
+  parallel = new ParallelBZ2Reader(filename, mapped, mappedSize);
 }
 
-int BZ2ParserState::parseBlock2(){
-  if(activeParser){
-    return doLexing();
+bool BZ2ParserState::readCompressed(){
+  if(strm.avail_in > 0)
+    return true;
+  if(eof)
+    return false;
+  if(mapTraces()){
+    /* The whole file is handed to the decompressor at once */
+    mapFile();
+    eof = true;
+    strm.next_in = mapped;
+    strm.avail_in = mappedSize;
+    return mappedSize > 0;
   }
-  else if(!(eof && nUnused == 0 && bzf == NULL)){
-    /* copy any remaining chars into buf */
-    memcpy(buf, remainder, rem);
-    /* If there is no stream open, open a new stream */
-    if(bzf == NULL){
-      bzf = BZ2_bzReadOpen(&status, f, 0, 0, unused, nUnused);
-      if(status != BZ_OK){
-        cout << "Error opening for decompression: " << filename << " ( error:" << status << " ) " << endl;
+  if(!inbuf)
+    inbuf = (char *)malloc(BZ_INBUFSIZE);
+  ssize_t n = descriptorPool().read(this, filename, inbuf, BZ_INBUFSIZE, fPosition);
+  if(n < 0){
+    cerr << "Error reading file: " << filename << endl;
+    perror(NULL);
+    abort();
+  }
+  if(n == 0){
+    eof = true;
+    descriptorPool().release(this);
+    return false;
+  }
+  fPosition += n;
+  strm.next_in = inbuf;
+  strm.avail_in = n;
+  return true;
+}
+
+size_t BZ2ParserState::decompress(char *out, size_t len){
+  if(!checkedParallel)
+    checkParallel();
+  if(parallel)
+    return parallel->read(out, len);
+  size_t produced = 0;
+  while(produced < len){
+    if(!readCompressed()){
+      if(streamOpen){
+        cerr << "Truncated compressed stream: " << filename << endl;
         abort();
       }
-      if(*(FILE**)bzf != f){
-        cout << "bzf format not as expected\n";
+      break;
+    }
+    /* The trace files are streams appended one after the other, open the next one */
+    if(!streamOpen){
+      char *next_in = strm.next_in;
+      unsigned int avail_in = strm.avail_in;
+      int status = BZ2_bzDecompressInit(&strm, 0, 0);
+      if(status != BZ_OK){
+        cout << "Error opening for decompression: " << filename << " ( error:" << status << " ) " << endl;
         abort();
       }
+      strm.next_in = next_in;
+      strm.avail_in = avail_in;
+      streamOpen = true;
     }
-    /* This is a horrible hack due to the fact that f must be closed and reopened while 
-     * the compression stream remains open. There is no way in the bzlib API to bind the reopened
-     * file stream to the open compression stream so I do so manually here. Hopefully the format
-     * of BZFILE (currently has the file handle as first field) will not change.
-    */
-    (*(FILE**)bzf) = f;
-    /* Fill the rest of buf with new data */
-    count = BZ2_bzRead(&status, bzf, buf + rem, BZ_BUFSIZE - rem) + rem;
-    /* Check if we reached the end of this stream */
-    if(status != BZ_OK){
-      if(status != BZ_STREAM_END){ abort(); }
-      void *unusedTemp;
-      BZ2_bzReadGetUnused(&status, bzf, &unusedTemp, &nUnused );
-      memcpy(unused, unusedTemp, nUnused);
-      if(status != BZ_OK){ abort(); }
-      BZ2_bzReadClose(&status, bzf);
-      if(status != BZ_OK){ abort(); }
-      bzf = NULL;
-      if(count == 0) //empty stream
-        return 1;
+    strm.next_out = out + produced;
+    strm.avail_out = len - produced;
+    int status = BZ2_bzDecompress(&strm);
+    produced = len - strm.avail_out;
+    if(status == BZ_STREAM_END){
+      BZ2_bzDecompressEnd(&strm);
+      streamOpen = false;
     }
-    /* Find a token to split on near the back and copy the remainder */
-    rem = 1;
-    while(buf[count - rem] != ' ' && buf[count-rem] != ')' && buf[count-rem] != ',' && buf[count-rem] != '\n'){
-      rem++;
-      if(rem > MAXREMAINDER || rem > count){
-        cerr << "Could not find token to split on\n";
-        exit(-1);
-      }
+    else if(status != BZ_OK){
+      cerr << "Error decompressing: " << filename << " ( error:" << status << " ) " << endl;
+      abort();
+    }
+  }
+  return produced;
+}
+
+size_t BZ2ParserState::fillBuffer(){
+  leaseBuffer();
+  /* copy any remaining chars into buf */
+  memcpy(buf, remainder, rem);
+  /* Fill the rest of buf with new data */
+  count = decompress(buf + rem, bufSize - rem) + rem;
+  if(count == 0) //empty file
+    return 0;
+  /* Streams that fill the buffer are given a larger one next time */
+  if(count == bufSize && nextBufSize < BZ_BUFSIZE)
+    nextBufSize *= 2;
+  /* Find a token to split on near the back and copy the remainder */
+  rem = 1;
+  while(buf[count - rem] != ' ' && buf[count-rem] != ')' && buf[count-rem] != ',' && buf[count-rem] != '\n'){
+    rem++;
+    if(rem > MAXREMAINDER || rem > count){
+      cerr << "Could not find token to split on\n";
+      exit(-1);
     }
-    memcpy(remainder, buf + count - rem, rem);
-    /* Write NULLS to the end of the buffer as required by flex */
-    buf[count-rem] = buf[count-rem+1] = 0;
+  }
+  memcpy(remainder, buf + count - rem, rem);
+  /* Write NULLS to the end of the buffer as required by flex */
+  buf[count-rem] = buf[count-rem+1] = 0;
+  return count - rem;
+}
+
+size_t BZ2ParserState::fillRemainder(){
+  leaseBuffer();
+  memcpy(buf, remainder, rem);
+  buf[rem] = buf[rem+1] = 0;
+  return rem;
+}
+
+int BZ2ParserState::parseBlock2(){
+  if(activeParser){
+    return doLexing();
+  }
+  else if(!finished()){
+    size_t length = fillBuffer();
+    if(count == 0) //empty file
+      return 1;
     /* Set up the flex buffer and parse */
-    return doLexing(count-rem+2);
+    return doLexing(length + 2);
   }
   else{
     /* parse anything that's left over */
-    memcpy(buf, remainder, rem);
-    buf[rem] = buf[rem+1] = 0;
-    return doLexing(rem+2);
+    return doLexing(fillRemainder() + 2);
   }
 }
 
 int BZ2ParserState::parseBlock(){
-  openFile();
   int res = parseBlock2();
-  closeFile();
+  /* The lexer has finished with the buffer, the remainder is kept separately */
+  if(!activeParser)
+    releaseBuffer();
   return res;
 }
 
+size_t BZ2ParserState::readBlock(char *&text){
+  releaseBuffer();
+  while(!finished()){
+    size_t length = fillBuffer();
+    if(length > 0){
+      text = buf;
+      return length;
+    }
+  }
+  /* The text left over is returned once */
+  if(rem > 0){
+    size_t length = fillRemainder();
+    rem = 0;
+    text = buf;
+    return length;
+  }
+  releaseBuffer();
+  return 0;
+}
+
 void BZ2ParserState::parseAll(){
   while(parseBlock());
 }
@@ -22,11 +22,16 @@
 
 #include <sys/types.h>
 #include <bzlib.h>
-//#include "memory_trace_parser.h"
+#include "ParallelBZ2Reader.h"
 
-#define BZ_BUFSIZE 1000000
+/* Largest and smallest sizes of the buffers decompressed data is parsed from */
+#define BZ_BUFSIZE 1048576
+#define BZ_MINBUFSIZE 16384
 #define MAXREMAINDER 100
 
+/* Size of the buffer compressed data is read into, when files are not mapped */
+#define BZ_INBUFSIZE 65536
+
 #ifndef YY_TYPEDEF_YY_BUFFER_STATE
 #define YY_TYPEDEF_YY_BUFFER_STATE
 typedef struct yy_buffer_state *YY_BUFFER_STATE;
@@ -94,8 +99,10 @@ struct yy_buffer_state
    * possible backing-up.
    *
    * When we actually see the EOF, we change the status to "new"
-   * (via memorytracerestart()), so that the user can continue scanning by
-   * just pointing memorytracein at a new input file.
+   * (via the scanner's restart function), so that the user can continue
+   * scanning by just pointing the scanner at a new input file.  Only the
+   * loop and call trace scanners use these buffers, MemoryTraceDecoder
+   * reads its text with readBlock.
    */
 #define YY_BUFFER_EOF_PENDING 2
 
@@ -103,16 +110,34 @@ struct yy_buffer_state
 #endif /* !YY_STRUCT_YY_BUFFER_STATE */
 
 
+/* The compressed trace files are read through descriptors from a pool shared
+ * by all parsers, the least recently used are closed to stay within
+ * RLIMIT_NOFILE, or mapped into memory if LIBCAM_MMAP_TRACES is set.  The
+ * decompressor is kept between blocks so reading resumes where it left off.
+ * The buffer decompressed data is parsed from is leased from a pool shared by
+ * all parsers, bounded by LIBCAM_PARSER_BUFFER_MEMORY, and is only held while
+ * the lexer has data left in it.  Its size starts at BZ_MINBUFSIZE and grows
+ * while the stream fills it.  Files of at least LIBCAM_PARALLEL_DECOMPRESS_SIZE
+ * bytes are mapped and decompressed on the WorkerPool, see ParallelBZ2Reader.
+ * The loop and call trace scanners parse the text with parseBlock, while
+ * MemoryTraceDecoder takes it a block at a time with readBlock and splits it
+ * with a TraceTokenizer, keeping all of its state in the decoder.  The
+ * pools may be used by parsers on different threads, each parser must only be
+ * used by one thread at a time. */
 class BZ2ParserState{
   char * filename;
-  FILE *f;
   off_t fPosition;
   bool eof;
-  BZFILE *bzf;
-  void *unused;
-  int nUnused;
-  int status;
-  char buf[BZ_BUFSIZE+2];
+  bz_stream strm;
+  bool streamOpen;
+  char *inbuf;
+  char *mapped;
+  size_t mappedSize;
+  ParallelBZ2Reader *parallel;
+  bool checkedParallel;
+  char *buf;
+  size_t bufSize;
+  size_t nextBufSize;
   char remainder[MAXREMAINDER];
   yy_size_t rem;
   yy_size_t count;
@@ -126,8 +151,31 @@ class BZ2ParserState{
 
   int doLexing(int bufLength = 0);
   int parseBlock2();
-  void openFile();
-  void closeFile();
+
+  /* Decompress into the buffer, returns the length of the text up to the last token boundary */
+  size_t fillBuffer();
+
+  /* Copy the text left over at the end of the file into the buffer, returns its length */
+  size_t fillRemainder();
+
+  /* Lease a buffer from the pool, or give it back */
+  void leaseBuffer();
+  void releaseBuffer();
+
+  /* Returns true if all the compressed data has been decompressed */
+  bool finished();
+
+  /* Map the whole file into memory */
+  void mapFile();
+
+  /* Start decompressing the file in parallel if it is large enough */
+  void checkParallel();
+
+  /* Make more compressed data available to the decompressor, returns false at the end of the file */
+  bool readCompressed();
+
+  /* Decompress up to len bytes into out, across streams, returns the number of bytes decompressed */
+  size_t decompress(char *out, size_t len);
 
 public:
   BZ2ParserState(const char * _filename
@@ -138,10 +186,18 @@ public:
                  , void *_arg
     );  
 
+  /* The parser of a MemoryTraceDecoder, which reads the text with readBlock */
+  BZ2ParserState(const char * _filename);
+
   ~BZ2ParserState();
 
   int parseBlock();
 
+  /* Decompress the next block of text, ending on a token boundary and followed
+   * by a NULL, sets text to it and returns its length, or 0 at the end of the
+   * file.  The text is valid until the next call */
+  size_t readBlock(char *&text);
+
   void parseAll();
 
   bool isActive();
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014  Simone Campanoni, Timothy M Jones
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef BINARYTRACE_H
+#define BINARYTRACE_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * Binary encoding of the loop and call traces, written instead of the text
+ * traces when LIBCAM_BINARY_TRACES is set. The files (loop_trace.bin.bz2 and
+ * call_trace.bin.bz2) start with the magic bytes and the version as a varint,
+ * after which the layout follows the text traces field for field, each number
+ * being an unsigned LEB128 varint:
+ *   range  - the number of sub-ranges, then for each the distance of its start
+ *            from the end of the previous one (plus one) and its length
+ *   cfc    - the number of top level patterns, then each pattern in pre-order,
+ *            a symbol as (sym << 1) and a pattern as (numChildren << 1 | 1)
+ *            followed by its children and its number of repetitions
+ *   status - one of the BINARY_TRACE_INVOC_* values, standing in for the
+ *            COMPLETE/INCOMPLETE symbols
+ */
+
+#define BINARY_TRACE_MAGIC "CAMB"
+#define BINARY_TRACE_MAGIC_LENGTH 4
+#define BINARY_TRACE_VERSION 1
+
+#define BINARY_TRACE_INVOC_COMPLETE 1
+#define BINARY_TRACE_INVOC_INCOMPLETE 2
+
+/**
+ * Append an unsigned LEB128 varint to a buffer.
+ **/
+static inline void appendVarint(std::vector<uint8_t>& buf, uint64_t value){
+  while(value >= 0x80){
+    buf.push_back((uint8_t)(value | 0x80));
+    value >>= 7;
+  }
+  buf.push_back((uint8_t)value);
+}
+
+#endif
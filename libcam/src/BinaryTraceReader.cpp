@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2014  Simone Campanoni, Timothy M Jones
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "BinaryTraceReader.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+using namespace std;
+
+BinaryTraceReader::BinaryTraceReader(const string& _filename) 
+  : filename(_filename)
+  , f(NULL)
+  , bzf(NULL)
+  , pos(0)
+  , count(0)
+{
+  f = fopen(filename.c_str(), "r");
+  if(!f){
+    cerr << "Error opening file: " << filename << endl;
+    perror(NULL);
+    abort();
+  }
+
+  /* Check the magic bytes and that this version can decode the trace */
+  char magic[BINARY_TRACE_MAGIC_LENGTH];
+  for(int i = 0; i < BINARY_TRACE_MAGIC_LENGTH; i++)
+    magic[i] = readByte();
+  if(memcmp(magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_LENGTH) != 0){
+    cerr << filename << " is not a binary trace\n";
+    abort();
+  }
+  uint64_t version = readVarint();
+  if(version > BINARY_TRACE_VERSION){
+    cerr << filename << " has binary trace version " << version << ", only up to " << BINARY_TRACE_VERSION << " is supported\n";
+    abort();
+  }
+}
+
+BinaryTraceReader::~BinaryTraceReader(){
+  int status;
+  if(bzf)
+    BZ2_bzReadClose(&status, bzf);
+  fclose(f);
+}
+
+bool BinaryTraceReader::exists(const string& filename){
+  return access(filename.c_str(), F_OK) == 0;
+}
+
+bool BinaryTraceReader::fill(){
+  int status;
+  pos = count = 0;
+  while(count == 0){
+    /* Open a new stream if the last one ended, the file may hold several */
+    if(bzf == NULL){
+      if(feof(f))
+        return false;
+      bzf = BZ2_bzReadOpen(&status, f, 0, 0, NULL, 0);
+      if(status != BZ_OK){
+        cerr << "Error opening for decompression: " << filename << " ( error:" << status << " ) " << endl;
+        abort();
+      }
+    }
+    count = BZ2_bzRead(&status, bzf, buf, BINARY_TRACE_BUFSIZE);
+    if(status == BZ_STREAM_END){
+      void *unused;
+      int nUnused;
+      BZ2_bzReadGetUnused(&status, bzf, &unused, &nUnused);
+      if(status != BZ_OK){ abort(); }
+      /* Step back over any bytes read past the end of this stream */
+      if(fseeko(f, -(off_t)nUnused, SEEK_CUR) != 0){ abort(); }
+      BZ2_bzReadClose(&status, bzf);
+      bzf = NULL;
+      /* Check whether another stream follows */
+      int c = fgetc(f);
+      if(c == EOF && count == 0)
+        return false;
+      ungetc(c, f);
+    }
+    else if(status != BZ_OK){
+      cerr << "Error decompressing: " << filename << " ( error:" << status << " ) " << endl;
+      abort();
+    }
+  }
+  return true;
+}
+
+uint8_t BinaryTraceReader::readByte(){
+  if(pos == count && !fill()){
+    cerr << "Unexpected end of binary trace: " << filename << endl;
+    abort();
+  }
+  return buf[pos++];
+}
+
+bool BinaryTraceReader::readVarint(uint64_t& value){
+  if(pos == count && !fill())
+    return false;
+  value = readVarint();
+  return true;
+}
+
+uint64_t BinaryTraceReader::readVarint(){
+  uint64_t value = 0;
+  unsigned int shift = 0;
+  uint8_t byte;
+  do{
+    byte = readByte();
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while(byte & 0x80);
+  return value;
+}
+
+void BinaryTraceReader::readRange(vector<pair<uint64_t, uint64_t>>& ranges){
+  uint64_t numRanges = readVarint();
+  uint64_t next = 0;
+  for(uint64_t i = 0; i < numRanges; i++){
+    uint64_t start = next + readVarint();
+    uint64_t end = start + readVarint();
+    ranges.push_back(pair<uint64_t, uint64_t>(start, end));
+    next = end + 1;
+  }
+}
+
+void BinaryTraceReader::readPattern(CompressionPattern& cp, set<uintptr_t> *symbols){
+  uint64_t node = readVarint();
+  if(node & 1){
+    uint64_t numChildren = node >> 1;
+    for(uint64_t i = 0; i < numChildren; i++){
+      CompressionPattern child;
+      readPattern(child, symbols);
+      cp.addPattern(child);
+    }
+    uint64_t numRepetitions = readVarint();
+    if(numChildren > 0)
+      cp.setNumRepetitions(numRepetitions);
+  }
+  else{
+    cp.setSymbol(node >> 1);
+    if(symbols)
+      symbols->insert(node >> 1);
+  }
+}
+
+void BinaryTraceReader::readCfc(vector<CompressionPattern> *patterns, set<uintptr_t> *symbols){
+  uint64_t numPatterns = readVarint();
+  for(uint64_t i = 0; i < numPatterns; i++){
+    CompressionPattern cp;
+    readPattern(cp, symbols);
+    if(patterns)
+      patterns->push_back(cp);
+  }
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2014  Simone Campanoni, Timothy M Jones
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef BINARYTRACEREADER_H
+#define BINARYTRACEREADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+#include <bzlib.h>
+#include "BinaryTrace.h"
+#include "CompressionPattern.h"
+
+#define BINARY_TRACE_BUFSIZE 65536
+
+/*
+ * Reads the fields of a binary loop or call trace (see BinaryTrace.h) directly
+ * from the bzip2 stream, without going through a lexer.
+ */
+class BinaryTraceReader{
+  string filename;
+  FILE *f;
+  BZFILE *bzf;
+  uint8_t buf[BINARY_TRACE_BUFSIZE];
+  int pos;
+  int count;
+
+  /* Refill the buffer, returns false at the end of the file */
+  bool fill();
+  uint8_t readByte();
+  void readPattern(CompressionPattern& cp, set<uintptr_t> *symbols);
+
+public:
+  BinaryTraceReader(const string& _filename);
+  ~BinaryTraceReader();
+
+  /* Returns true if a binary trace named filename exists */
+  static bool exists(const string& filename);
+
+  /* Returns false if the end of the trace was reached instead of reading a value */
+  bool readVarint(uint64_t& value);
+  uint64_t readVarint();
+
+  /* Read a range as a list of (start, end) pairs */
+  void readRange(vector<pair<uint64_t, uint64_t>>& ranges);
+
+  /* Read a compressed trace, its top level patterns are appended to patterns
+   * and its symbols inserted into symbols, either may be NULL */
+  void readCfc(vector<CompressionPattern> *patterns, set<uintptr_t> *symbols);
+};
+
+#endif
@@ -21,20 +21,82 @@
 #include "call_trace_cfc_parser.h"
 #include <cassert>
 
-CallTraceStreamer::CallTraceStreamer() 
+CallTraceStreamer::CallTraceStreamer(unsigned int level) 
   : ctcl(CallTraceCfcLex())
   , parser(BZ2ParserState(
-        "call_trace.txt.bz2"
+        (level == 0 ? string("call_trace.txt.bz2") : "call_trace.level" + to_string(level) + ".txt.bz2").c_str()
       , calltracecfclex
       , calltracecfc_scan_buffer
       , calltracecfc_switch_to_buffer
       , calltracecfc_delete_buffer
       , &ctcl
     ))
+  , binary(NULL)
+  , binaryRemainingEntries(0)
 { 
+  string binaryName = level == 0 ? string("call_trace.bin.bz2") : "call_trace.level" + to_string(level) + ".bin.bz2";
+  if(BinaryTraceReader::exists(binaryName))
+    binaryFilename = binaryName;
+}
+
+CallTraceStreamer::~CallTraceStreamer(){
+  delete binary;
+}
+
+int CallTraceStreamer::getFullBinaryEntry(CallTraceLoopInvocationGroup& clig, set<uintptr_t> *callList, set<uintptr_t> *subInstrList){
+  if(!binary)
+    binary = new BinaryTraceReader(binaryFilename);
+
+  /* Number of loop invocation entries in this dump */
+  while(binaryRemainingEntries == 0){
+    if(!binary->readVarint(binaryRemainingEntries))
+      return 0;
+  }
+
+  /* Loop invocation repetition pattern */
+  vector<pair<uint64_t, uint64_t>> ranges;
+  binary->readRange(ranges);
+  for(auto r = ranges.begin(); r != ranges.end(); r++)
+    clig.addInvocationPattern(r->first, r->second);
+
+  /* Each call ID with its instance repetition patterns and CFCs */
+  uint64_t numCalls = binary->readVarint();
+  for(uint64_t c = 0; c < numCalls; c++){
+    uintptr_t callID = binary->readVarint();
+    uint64_t numInstances = binary->readVarint();
+    clig.addNewCall(callID);
+    if(callList)
+      callList->insert(callID);
+    for(uint64_t i = 0; i < numInstances; i++){
+      clig.addCallInstance(callID);
+      ranges.clear();
+      binary->readRange(ranges);
+      for(auto r = ranges.begin(); r != ranges.end(); r++)
+        clig.addCallPattern(callID, r->first, r->second);
+      vector<CompressionPattern> patterns;
+      binary->readCfc(subInstrList ? NULL : &patterns, subInstrList);
+      for(auto p = patterns.begin(); p != patterns.end(); p++)
+        clig.addCallCfc(callID, *p);
+    }
+  }
+  binaryRemainingEntries--;
+
+  uint64_t status = binary->readVarint();
+  if(status == BINARY_TRACE_INVOC_COMPLETE)
+    ctcl.rstatus = ctcl.INVOC_COMPLETE;
+  else if(status == BINARY_TRACE_INVOC_INCOMPLETE)
+    ctcl.rstatus = ctcl.INVOC_INCOMPLETE;
+  else{
+    cerr << "Call trace found invalid completion status " << status << endl;
+    abort();
+  }
+  return 1;
 }
 
 int CallTraceStreamer::getFullEntry(CallTraceLoopInvocationGroup& clig){
+  if(!binaryFilename.empty())
+    return getFullBinaryEntry(clig);
+
   assert(ctcl.state == NUM_INVOC || ctcl.state == INVOC_PATTERN);
   ctcl.callEntry = &clig;
   ctcl.rstatus = ctcl.ACTIVE;
@@ -68,6 +130,12 @@ pair<set<uintptr_t>, set<uintptr_t>> CallTraceStreamer::parseForInstructionLists
   set<uintptr_t> subInstrList;
   CallTraceLoopInvocationGroup c;
 
+  if(!binaryFilename.empty()){
+    while(getFullBinaryEntry(c, &callList, &subInstrList))
+      c = CallTraceLoopInvocationGroup();
+    return pair<set<uintptr_t>, set<uintptr_t>>(callList, subInstrList);
+  }
+
   ctcl.callEntry = &c;
   ctcl.callList = &callList;
   ctcl.subInstrList = &subInstrList;
@@ -22,15 +22,23 @@
 
 #include "BZ2ParserState.h"
 #include "CallTraceCfcLex.h"
+#include "BinaryTraceReader.h"
 
 class CallTraceStreamer{
   CallTraceCfcLex ctcl;
   BZ2ParserState parser;
+  /* Set if the trace was written in the binary format, the reader is opened on first use */
+  string binaryFilename;
+  BinaryTraceReader *binary;
+  uint64_t binaryRemainingEntries;
 
   int getFullEntry(CallTraceLoopInvocationGroup& clig);
+  int getFullBinaryEntry(CallTraceLoopInvocationGroup& clig, set<uintptr_t> *callList = NULL, set<uintptr_t> *subInstrList = NULL);
 
 public:
-  CallTraceStreamer();
+  /* Streams the call trace of the given nesting level */
+  CallTraceStreamer(unsigned int level = 0);
+  ~CallTraceStreamer();
 
   /* Returns 1 if a valid CallTraceLoopInvocationGroup was filled, 0 otherwise */
   int getNextEntry(CallTraceLoopInvocationGroup& clig);
@@ -0,0 +1,193 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef COMPRESSIONTUNER_H
+#define COMPRESSIONTUNER_H
+
+#include <cstdlib>
+#include <algorithm>
+#include "ControlFlowCompressor.h"
+using namespace std;
+
+/**
+ * Number of compressed iterations between adjustments.
+ **/
+#define COMPRESSION_TUNER_EPOCH 64
+
+/**
+ * A larger window is only kept if it shrinks the compressed iterations by this factor.
+ **/
+#define COMPRESSION_TUNER_GAIN 0.9
+
+/**
+ * Maximum number of epochs to wait before trying a larger window again.
+ **/
+#define COMPRESSION_TUNER_MAX_BACKOFF 64
+
+/*
+ * Adapts the compression window length and the number of recent iterations
+ * kept for matching of one loop, within the bounds set by
+ * LIBCAM_COMPRESSION_WINDOW_MIN/MAX and LIBCAM_RECENT_ITER_MATCHES_MIN/MAX.
+ *
+ * Statistics are gathered over epochs of COMPRESSION_TUNER_EPOCH iterations:
+ *   window - while iterations overflow the window it is doubled each epoch,
+ *            then the smallest length that improved the compression ratio
+ *            (patterns per symbol) is kept, or the original length with an
+ *            exponential backoff before the next attempt. If the window is
+ *            never more than a quarter full it shrinks to twice its peak use.
+ *   recent - the list grows when matches are found near its end and shrinks
+ *            to twice the depth of the deepest match otherwise, since every
+ *            iteration without a match scans the whole list.
+ * Only the sequence of events drives the adjustments, so a given execution
+ * always produces the same trace.
+ */
+class CompressionTuner{
+  unsigned int minWindow, maxWindow, window;
+  unsigned int minRecent, maxRecent, recent;
+
+  /* Statistics of the current epoch */
+  unsigned int numCfcs;
+  uint64_t numSymbols;
+  uint64_t numPatterns;
+  unsigned int numOverflows;
+  unsigned int windowHighWater;
+  uint64_t numLookups;
+  uint64_t numHits;
+  unsigned int deepestHit;
+
+  /* Window growth in progress and its outcome so far */
+  bool climbing;
+  double bestRatio;
+  unsigned int bestWindow;
+  unsigned int backoff;
+  unsigned int epochsUntilClimb;
+
+  static unsigned int readBound(const char *name, unsigned int def){
+    char *env = getenv(name);
+    if (env) {
+      int value = atoi(env);
+      if (value < 1) {
+        cerr << name << " must be at least 1\n";
+        abort();
+      }
+      return value;
+    }
+    return def;
+  }
+
+  void resetEpoch(){
+    numCfcs = 0;
+    numSymbols = numPatterns = 0;
+    numOverflows = windowHighWater = 0;
+    numLookups = numHits = 0;
+    deepestHit = 0;
+  }
+
+  void adaptWindow(){
+    double ratio = numSymbols ? (double)numPatterns / numSymbols : 1;
+    if(climbing){
+      if(ratio < bestRatio * COMPRESSION_TUNER_GAIN){
+        bestRatio = ratio;
+        bestWindow = window;
+      }
+      if(numOverflows > 0 && window < maxWindow){
+        window = min(maxWindow, window * 2);
+        return;
+      }
+      /* Keep the smallest window that paid off, if none did wait before trying again */
+      climbing = false;
+      if(bestWindow != window){
+        window = bestWindow;
+        backoff = min(backoff * 2, (unsigned int)COMPRESSION_TUNER_MAX_BACKOFF);
+        epochsUntilClimb = backoff;
+      }
+      else{
+        backoff = 1;
+      }
+      return;
+    }
+    if(epochsUntilClimb > 0)
+      epochsUntilClimb--;
+    if(numOverflows > 0 && window < maxWindow && epochsUntilClimb == 0){
+      climbing = true;
+      bestRatio = ratio;
+      bestWindow = window;
+      window = min(maxWindow, window * 2);
+    }
+    else if(numOverflows == 0 && windowHighWater * 4 <= window && window > minWindow){
+      window = max(minWindow, windowHighWater * 2);
+    }
+  }
+
+  void adaptRecent(){
+    if(numLookups == 0)
+      return;
+    if(numHits > 0 && (deepestHit + 1) * 4 >= recent * 3)
+      recent = min(maxRecent, recent * 2);
+    else if(numHits == 0)
+      recent = max(minRecent, recent / 2);
+    else if((deepestHit + 1) * 4 <= recent)
+      recent = max(minRecent, (deepestHit + 1) * 2);
+  }
+
+public:
+  CompressionTuner(unsigned int initialWindow, unsigned int initialRecent)
+    : climbing(false), bestRatio(1), bestWindow(0), backoff(1), epochsUntilClimb(0) {
+    minWindow = readBound("LIBCAM_COMPRESSION_WINDOW_MIN", 8);
+    maxWindow = readBound("LIBCAM_COMPRESSION_WINDOW_MAX", 400);
+    minRecent = readBound("LIBCAM_RECENT_ITER_MATCHES_MIN", 4);
+    maxRecent = readBound("LIBCAM_RECENT_ITER_MATCHES_MAX", 256);
+    if (minWindow > maxWindow || minRecent > maxRecent) {
+      cerr << "Compression tuner bounds are inconsistent\n";
+      abort();
+    }
+    window = min(maxWindow, max(minWindow, initialWindow));
+    recent = min(maxRecent, max(minRecent, initialRecent));
+    resetEpoch();
+  }
+
+  unsigned int getWindowLength(){ return window; }
+  unsigned int getRecentMatches(){ return recent; }
+
+  /* Record the search of the recent iterations for a match, depth is the
+   * position of the match or -1 if there was none */
+  void recordLookup(int depth){
+    numLookups++;
+    if(depth >= 0){
+      numHits++;
+      deepestHit = max(deepestHit, (unsigned int)depth);
+    }
+  }
+
+  /* Record a compressed iteration before it is matched or stored */
+  void recordCfc(const ControlFlowCompressor *cfc){
+    numSymbols += cfc->getNumSymbols();
+    numPatterns += cfc->getNumPatterns();
+    if(cfc->hasOverflowed())
+      numOverflows++;
+    windowHighWater = max(windowHighWater, cfc->getWindowHighWater());
+    if(++numCfcs == COMPRESSION_TUNER_EPOCH){
+      adaptWindow();
+      adaptRecent();
+      resetEpoch();
+    }
+  }
+};
+
+#endif
@@ -27,12 +27,43 @@ ostream& operator<<(ostream& os, const TracerCompressionPattern& p){
     }
     os << "," << p.numRepetitions << ")";
   }
+  else if(p.sym & TRACER_BLOCK_SYMBOL){
+    const vector<tracer_symbol>& insts = ControlFlowCompressor::getBlockInstructions(p.sym);
+    for(auto inst = insts.begin(); inst != insts.end(); inst++)
+      os << "(" << *inst << ")";
+  }
   else{
     os << "(" << p.sym << ")";
   }
   return os;
 }
 
+unsigned int TracerCompressionPattern::numWrittenPatterns() const {
+  if(pattern.size() == 0 && (sym & TRACER_BLOCK_SYMBOL))
+    return ControlFlowCompressor::getBlockInstructions(sym).size();
+  return 1;
+}
+
+void TracerCompressionPattern::appendBinary(vector<uint8_t>& buf) const {
+  if(pattern.size() > 0){
+    unsigned int numChildren = 0;
+    for (auto pat = pattern.begin(); pat != pattern.end(); pat++)
+      numChildren += (*pat)->numWrittenPatterns();
+    appendVarint(buf, ((uint64_t)numChildren << 1) | 1);
+    for (auto pat = pattern.begin(); pat != pattern.end(); pat++)
+      (*pat)->appendBinary(buf);
+    appendVarint(buf, numRepetitions);
+  }
+  else if(sym & TRACER_BLOCK_SYMBOL){
+    const vector<tracer_symbol>& insts = ControlFlowCompressor::getBlockInstructions(sym);
+    for(auto inst = insts.begin(); inst != insts.end(); inst++)
+      appendVarint(buf, (uint64_t)*inst << 1);
+  }
+  else{
+    appendVarint(buf, (uint64_t)sym << 1);
+  }
+}
+
 void TracerCompressionPattern::coutThis(){
   cout << *this;
 }
@@ -187,11 +218,34 @@ map<tracer_symbol, uint64_t> TracerCompressionPattern::getNumberOfInstancesMap()
  * ControlFlowCompressor
 */
 
+map<tracer_symbol, vector<tracer_symbol>> ControlFlowCompressor::blocks;
+
+void ControlFlowCompressor::registerBlock(tracer_symbol blockID, const vector<tracer_symbol>& insts){
+  if(insts.empty() || (blockID & TRACER_BLOCK_SYMBOL)){
+    cerr << "Cannot register block " << blockID << " with " << insts.size() << " instructions\n";
+    abort();
+  }
+  blocks[blockSymbol(blockID)] = insts;
+}
+
+tracer_symbol ControlFlowCompressor::blockSymbol(tracer_symbol blockID){
+  return blockID | TRACER_BLOCK_SYMBOL;
+}
+
+const vector<tracer_symbol>& ControlFlowCompressor::getBlockInstructions(tracer_symbol sym){
+  auto block = blocks.find(sym);
+  if(block == blocks.end()){
+    cerr << "Block " << (sym & ~TRACER_BLOCK_SYMBOL) << " was seen but never registered\n";
+    abort();
+  }
+  return block->second;
+}
+
 ControlFlowCompressor::ControlFlowCompressor(CamMemoryAllocator* alloc) 
-  : allocator(alloc), maxWindowLength(100) { }
+  : allocator(alloc), maxWindowLength(100), numSymbols(0), windowHighWater(0) { }
 
 ControlFlowCompressor::ControlFlowCompressor(CamMemoryAllocator* alloc, unsigned int maxWindowLength_p) 
-  : allocator(alloc), maxWindowLength(maxWindowLength_p) { }
+  : allocator(alloc), maxWindowLength(maxWindowLength_p), numSymbols(0), windowHighWater(0) { }
 
 ControlFlowCompressor::~ControlFlowCompressor(){
   for(auto i = window.begin(); i != window.end(); i++)
@@ -271,6 +325,9 @@ void ControlFlowCompressor::insertSymbol(tracer_symbol symbol){
 
   /* Push new symbol into the window */
   window.push_front(allocator->newMem<TracerCompressionPattern>(allocator, symbol));
+  numSymbols++;
+  if(window.size() > windowHighWater)
+    windowHighWater = window.size();
 
   /* Match and merge until the window does not change */
   while( match() || merge() );
@@ -316,6 +373,8 @@ void ControlFlowCompressor::clear(){
     allocator->deleteMem<TracerCompressionPattern>(*i);
   storedPatterns.clear();
   window.clear();
+  numSymbols = 0;
+  windowHighWater = 0;
 }
 
 bool ControlFlowCompressor::isEmpty(){
@@ -352,6 +411,19 @@ ostream& operator<<(ostream& os, const ControlFlowCompressor& cfc){
   return os;
 }
 
+void ControlFlowCompressor::appendBinary(vector<uint8_t>& buf) const {
+  unsigned int numPatterns = 0;
+  for(auto i = storedPatterns.begin(); i != storedPatterns.end(); i++)
+    numPatterns += (*i)->numWrittenPatterns();
+  for(auto i = window.rbegin(); i != window.rend(); i++)
+    numPatterns += (*i)->numWrittenPatterns();
+  appendVarint(buf, numPatterns);
+  for(auto i = storedPatterns.begin(); i != storedPatterns.end(); i++)
+    (*i)->appendBinary(buf);
+  for(auto i = window.rbegin(); i != window.rend(); i++)
+    (*i)->appendBinary(buf);
+}
+
 void ControlFlowCompressor::rawOutput(){
   cout << "WINDOW: \n";
   for(auto i = window.begin(); i != window.end(); i++)
@@ -26,11 +26,15 @@
 #include <map>
 #include <iostream>
 #include "cam_system.h"
+#include "BinaryTrace.h"
 #include "memory_allocator.hh"
 using namespace std;
 
 typedef uintptr_t tracer_symbol;
 
+/* Symbols with this bit set stand for a whole registered basic block */
+#define TRACER_BLOCK_SYMBOL ((tracer_symbol)1 << (sizeof(tracer_symbol)*8 - 1))
+
 class TracerCompressionPattern{
   CamMemoryAllocator* allocator;
   vector<TracerCompressionPattern*> pattern;
@@ -56,6 +60,11 @@ public:
   void setSymbol(tracer_symbol s);
   void coutThis();
   map<tracer_symbol, uint64_t> getNumberOfInstancesMap();
+
+  /* Number of patterns this writes out as, blocks are expanded into their instructions */
+  unsigned int numWrittenPatterns() const;
+  /* Append the binary pre-order encoding of this pattern, see BinaryTrace.h */
+  void appendBinary(vector<uint8_t>& buf) const;
 };
 
 /*
@@ -84,6 +93,8 @@ class ControlFlowCompressor{
   vector<TracerCompressionPattern*> storedPatterns;
   CamMemoryAllocator* allocator;
   unsigned int maxWindowLength;
+  uint64_t numSymbols;           /* Symbols inserted since the last clear */
+  unsigned int windowHighWater;  /* Largest the window has been since the last clear */
 
 
 public:
@@ -103,6 +114,11 @@ public:
   void rawOutput();
   void coutThis();
 
+  /*
+   * Append the binary encoding of the patterns written by operator<<, see BinaryTrace.h
+  */
+  void appendBinary(vector<uint8_t>& buf) const;
+
   /*
    * Add a new symbol and run the compression algorithm
   */
@@ -124,7 +140,27 @@ public:
   bool isRepeatedSequence(unsigned int width);
   void clear();
   bool isEmpty();
+
+  /*
+   * Statistics used to tune the window length, see CompressionTuner.h
+  */
+  uint64_t getNumSymbols() const { return numSymbols; }
+  uint64_t getNumPatterns() const { return storedPatterns.size() + window.size(); }
+  unsigned int getWindowHighWater() const { return windowHighWater; }
+  bool hasOverflowed() const { return storedPatterns.size() > 0; }
+  void setMaxWindowLength(unsigned int length) { maxWindowLength = length; }
   vector<tracer_symbol> decompress();
+
+  /*
+   * Basic blocks are compressed as a single symbol and only expanded into
+   * their instructions when the compressed trace is written out
+  */
+  static void registerBlock(tracer_symbol blockID, const vector<tracer_symbol>& insts);
+  static tracer_symbol blockSymbol(tracer_symbol blockID);
+  static const vector<tracer_symbol>& getBlockInstructions(tracer_symbol sym);
+
+private:
+  static map<tracer_symbol, vector<tracer_symbol>> blocks;
 };
 
 #endif
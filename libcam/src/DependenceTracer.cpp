@@ -0,0 +1,573 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cam.h"
+#include "cam_system.h"
+#include "DependenceTracer.h"
+#include "TimeoutCounter.h"
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <new>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Number of bytes of memory covered by each page of shadow memory.
+ **/
+#define LIBCAM_SHADOW_PAGE_SIZE 4096
+
+/**
+ * Default number of slots in the address signatures of the signature profile,
+ * can be altered using the environment variable LIBCAM_SIGNATURE_SLOTS.
+ **/
+#define LIBCAM_DEFAULT_SIGNATURE_SLOTS 65536
+
+/**
+ * Number of bytes of memory hashed to the same signature slot.
+ **/
+#define LIBCAM_SIGNATURE_LINE_SIZE 64
+
+
+/**
+ * Follows the loop and call events and checks each memory reference made
+ * inside a loop for dependences carried by the loop.  As in cam, references
+ * made inside a call, or a nested loop, are attributed to the outermost call
+ * or nested loop.
+ **/
+class DependenceTracer
+{
+  uint64_t loopDepth;                       /* Number of loops running */
+  uint64_t callDepth;                       /* Number of calls and nested loops running inside the outermost loop */
+  inst_id_t currCallID;                     /* Outermost call or nested loop inside the outermost loop */
+  string outputDirectory;
+
+protected:
+  /* Iterations are numbered across all invocations, so anything recorded in
+   * an earlier invocation is older than firstIteration */
+  uint64_t currIteration;
+  uint64_t firstIteration;                  /* First iteration of the current invocation */
+  uint64_t currInvocation;
+
+  /* Check a read or write of the current iteration */
+  virtual void recordRead(inst_id_t id, uintptr_t addr, uint64_t len) = 0;
+  virtual void recordWrite(inst_id_t id, uintptr_t addr, uint64_t len) = 0;
+
+  /* Called when the current iteration ends */
+  virtual void finishIteration(void) {}
+
+  /* Write a pair set in the format of cam -p */
+  void
+  writePairs(ofstream &outputFile, set<pair<inst_id_t, inst_id_t>> &pairs)
+  {
+    outputFile << pairs.size() << endl;
+    for (auto i = pairs.begin(); i != pairs.end(); i++)
+      outputFile << i->first << " " << i->second << endl;
+  }
+
+public:
+  DependenceTracer()
+    : loopDepth(0), callDepth(0), currCallID(0), outputDirectory("."), currIteration(0), firstIteration(1), currInvocation(0)
+  {
+    char *env = getenv("LIBCAM_OUTPUT_DIRECTORY");
+    if (env) {
+      outputDirectory = env;
+    }
+  }
+
+  virtual ~DependenceTracer() {}
+
+  string getOutputDirectory() { return outputDirectory; }
+
+  void
+  loopInvocationStart(JITNINT loopID)
+  {
+    if (loopDepth++ > 0) {
+      callInvocationStart(loopID);
+      return;
+    }
+    callDepth = 0;
+    currIteration++;
+    firstIteration = currIteration;
+    currInvocation++;
+  }
+
+  void
+  loopInvocationEnd(void)
+  {
+    if (--loopDepth > 0) {
+      callInvocationEnd();
+      return;
+    }
+    finishIteration();
+  }
+
+  void
+  loopIterationStart(void)
+  {
+    if (loopDepth == 1) {
+      finishIteration();
+      currIteration++;
+    }
+  }
+
+  void
+  callInvocationStart(JITNINT instID)
+  {
+    if (loopDepth > 0 && callDepth++ == 0) {
+      currCallID = instID;
+    }
+  }
+
+  void
+  callInvocationEnd(void)
+  {
+    if (loopDepth > 0 && callDepth > 0) {
+      callDepth--;
+    }
+  }
+
+  void
+  record(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen)
+  {
+    if (loopDepth == 0) {
+      return;
+    }
+    if (callDepth > 0) {
+      id = currCallID;
+    }
+    recordRead(id, raddr1, rlen1);
+    recordRead(id, raddr2, rlen2);
+    recordWrite(id, waddr, wlen);
+  }
+
+  /* Write the dependences found */
+  virtual void dumpDependences(void) = 0;
+};
+
+
+/**
+ * The accesses of a byte of memory by an instruction in the current
+ * invocation.  Iterations are numbered from 1, so 0 is no iteration.
+ **/
+struct ShadowAccess
+{
+  inst_id_t id;
+  uint64_t lastIteration;                   /* Last iteration in which the instruction made the access */
+  uint64_t otherIteration;                  /* An earlier iteration, other than lastIteration, or 0 */
+
+  /* Returns true if the access was made in an iteration other than the given one */
+  bool
+  inOtherIteration(uint64_t iteration) const
+  {
+    return lastIteration != iteration || otherIteration != 0;
+  }
+};
+
+
+/**
+ * The instructions which wrote and read a byte of memory in an invocation.
+ * Two iterations per instruction are enough to tell whether it accessed
+ * the byte in any iteration other than a given one.
+ **/
+struct ShadowEntry
+{
+  uint64_t invocation;
+  vector<ShadowAccess> writes;
+  vector<ShadowAccess> reads;
+
+  ShadowEntry() : invocation(0) {}
+
+  /* Forget the accesses of earlier invocations */
+  void
+  startInvocation(uint64_t currInvocation)
+  {
+    if (invocation != currInvocation) {
+      writes.clear();
+      reads.clear();
+      invocation = currInvocation;
+    }
+  }
+
+  static void
+  addAccess(vector<ShadowAccess> &accesses, inst_id_t id, uint64_t iteration)
+  {
+    for (auto a = accesses.begin(); a != accesses.end(); a++) {
+      if (a->id == id) {
+        if (a->lastIteration != iteration) {
+          a->otherIteration = a->lastIteration;
+          a->lastIteration = iteration;
+        }
+        return;
+      }
+    }
+    accesses.push_back(ShadowAccess{id, iteration, 0});
+  }
+};
+
+
+/**
+ * Shadow memory holding a ShadowEntry for every byte accessed, allocated a
+ * page at a time as memory is touched.
+ **/
+class ShadowMemory
+{
+  unordered_map<uintptr_t, ShadowEntry *> pages;
+  uintptr_t lastPageNum;
+  ShadowEntry *lastPage;
+
+public:
+  ShadowMemory() : lastPageNum(0), lastPage(NULL) {}
+
+  ~ShadowMemory()
+  {
+    for (auto page : pages) {
+      delete[] page.second;
+    }
+  }
+
+  /* Return the entry for an address, allocating its page if necessary */
+  ShadowEntry &
+  getEntry(uintptr_t addr)
+  {
+    uintptr_t pageNum = addr/LIBCAM_SHADOW_PAGE_SIZE;
+    if (lastPage == NULL || pageNum != lastPageNum) {
+      ShadowEntry *&page = pages[pageNum];
+      if (page == NULL) {
+        page = new (nothrow) ShadowEntry[LIBCAM_SHADOW_PAGE_SIZE];
+        if (page == NULL) {
+          cerr << "Failed to allocate shadow memory\n";
+          abort();
+        }
+      }
+      lastPageNum = pageNum;
+      lastPage = page;
+    }
+    return lastPage[addr%LIBCAM_SHADOW_PAGE_SIZE];
+  }
+};
+
+
+/**
+ * Exact dependences, found by checking each reference against every write
+ * and read of the byte in the current invocation, written in the format of
+ * the dependence pairs produced by cam -p.
+ **/
+class ShadowDependenceTracer : public DependenceTracer
+{
+  ShadowMemory shadow;
+  set<pair<inst_id_t, inst_id_t>> rwPairs;  /* (write, read) pairs, RAW and WAR */
+  set<pair<inst_id_t, inst_id_t>> wwPairs;
+
+protected:
+  /* Check a read against the writes of each byte in other iterations, then record it */
+  void
+  recordRead(inst_id_t id, uintptr_t addr, uint64_t len)
+  {
+    for (uint64_t i = 0; i < len; i++) {
+      ShadowEntry &entry = shadow.getEntry(addr + i);
+      entry.startInvocation(currInvocation);
+      for (auto w = entry.writes.begin(); w != entry.writes.end(); w++) {
+        if (w->inOtherIteration(currIteration)) {
+          rwPairs.insert(pair<inst_id_t, inst_id_t>(w->id, id));
+        }
+      }
+      ShadowEntry::addAccess(entry.reads, id, currIteration);
+    }
+  }
+
+  /* Check a write against the writes and reads of each byte in other iterations, then record it */
+  void
+  recordWrite(inst_id_t id, uintptr_t addr, uint64_t len)
+  {
+    for (uint64_t i = 0; i < len; i++) {
+      ShadowEntry &entry = shadow.getEntry(addr + i);
+      entry.startInvocation(currInvocation);
+      for (auto w = entry.writes.begin(); w != entry.writes.end(); w++) {
+        if (w->inOtherIteration(currIteration)) {
+          wwPairs.insert(pair<inst_id_t, inst_id_t>(w->id, id));
+          wwPairs.insert(pair<inst_id_t, inst_id_t>(id, w->id));
+        }
+      }
+      for (auto r = entry.reads.begin(); r != entry.reads.end(); r++) {
+        if (r->inOtherIteration(currIteration)) {
+          rwPairs.insert(pair<inst_id_t, inst_id_t>(id, r->id));
+        }
+      }
+      ShadowEntry::addAccess(entry.writes, id, currIteration);
+    }
+  }
+
+public:
+  void
+  dumpDependences(void)
+  {
+    ofstream outputFile;
+    outputFile.open(getOutputDirectory() + "/dependence_pairs.txt");
+    writePairs(outputFile, rwPairs);
+    outputFile << endl;
+    writePairs(outputFile, wwPairs);
+    outputFile.close();
+  }
+};
+
+
+/**
+ * A slot of the address signatures.  The current iteration's signature holds
+ * the slots stamped with currIteration, the union of the earlier iterations
+ * of the invocation holds the slots stamped with currInvocation.
+ **/
+struct SignatureSlot
+{
+  uint64_t readIteration;
+  uint64_t writeIteration;
+  uint64_t earlierReadInvocation;
+  uint64_t earlierWriteInvocation;
+  inst_id_t reader;                         /* Last reader and writer in the current iteration */
+  inst_id_t writer;
+  inst_id_t earlierReader;                  /* Last reader and writer in the earlier iterations */
+  inst_id_t earlierWriter;
+};
+
+
+/**
+ * Suspected dependences, found by hashing the cache lines read and written on
+ * each iteration into fixed size signatures and intersecting them with the
+ * union of the signatures of the earlier iterations when the iteration ends.
+ * Hash collisions may give false positives, but memory use is bounded
+ * whatever the length of the loop.
+ **/
+class SignatureDependenceTracer : public DependenceTracer
+{
+  vector<SignatureSlot> slots;
+  vector<uint64_t> touchedSlots;            /* Slots in the current iteration's signature */
+  map<pair<inst_id_t, inst_id_t>, uint64_t> rwConflicts;  /* (write, read) pairs, RAW and WAR, and conflict counts */
+  map<pair<inst_id_t, inst_id_t>, uint64_t> wwConflicts;
+
+  SignatureSlot &
+  getSlot(uintptr_t addr)
+  {
+    uint64_t line = addr/LIBCAM_SIGNATURE_LINE_SIZE;
+    SignatureSlot &slot = slots[(line*0x9E3779B97F4A7C15ULL >> 32) & (slots.size() - 1)];
+    if (slot.readIteration != currIteration && slot.writeIteration != currIteration) {
+      touchedSlots.push_back(&slot - slots.data());
+    }
+    return slot;
+  }
+
+  void
+  writeConflicts(ofstream &outputFile, map<pair<inst_id_t, inst_id_t>, uint64_t> &conflicts)
+  {
+    outputFile << conflicts.size() << endl;
+    for (auto i = conflicts.begin(); i != conflicts.end(); i++)
+      outputFile << i->first.first << " " << i->first.second << " " << i->second << endl;
+  }
+
+protected:
+  void
+  recordRead(inst_id_t id, uintptr_t addr, uint64_t len)
+  {
+    if (len == 0) {
+      return;
+    }
+    for (uintptr_t line = addr/LIBCAM_SIGNATURE_LINE_SIZE; line <= (addr + len - 1)/LIBCAM_SIGNATURE_LINE_SIZE; line++) {
+      SignatureSlot &slot = getSlot(line*LIBCAM_SIGNATURE_LINE_SIZE);
+      slot.readIteration = currIteration;
+      slot.reader = id;
+    }
+  }
+
+  void
+  recordWrite(inst_id_t id, uintptr_t addr, uint64_t len)
+  {
+    if (len == 0) {
+      return;
+    }
+    for (uintptr_t line = addr/LIBCAM_SIGNATURE_LINE_SIZE; line <= (addr + len - 1)/LIBCAM_SIGNATURE_LINE_SIZE; line++) {
+      SignatureSlot &slot = getSlot(line*LIBCAM_SIGNATURE_LINE_SIZE);
+      slot.writeIteration = currIteration;
+      slot.writer = id;
+    }
+  }
+
+  /* Intersect the signatures of the iteration with those of the earlier iterations, then add them to the union */
+  void
+  finishIteration(void)
+  {
+    for (uint64_t s : touchedSlots) {
+      SignatureSlot &slot = slots[s];
+      bool read = slot.readIteration == currIteration;
+      bool write = slot.writeIteration == currIteration;
+      if (slot.earlierWriteInvocation == currInvocation) {
+        if (read)
+          rwConflicts[pair<inst_id_t, inst_id_t>(slot.earlierWriter, slot.reader)]++;
+        if (write)
+          wwConflicts[pair<inst_id_t, inst_id_t>(slot.earlierWriter, slot.writer)]++;
+      }
+      if (write && slot.earlierReadInvocation == currInvocation) {
+        rwConflicts[pair<inst_id_t, inst_id_t>(slot.writer, slot.earlierReader)]++;
+      }
+      if (read) {
+        slot.earlierReadInvocation = currInvocation;
+        slot.earlierReader = slot.reader;
+      }
+      if (write) {
+        slot.earlierWriteInvocation = currInvocation;
+        slot.earlierWriter = slot.writer;
+      }
+    }
+    touchedSlots.clear();
+  }
+
+public:
+  SignatureDependenceTracer()
+  {
+    uint64_t numSlots = LIBCAM_DEFAULT_SIGNATURE_SLOTS;
+    char *env = getenv("LIBCAM_SIGNATURE_SLOTS");
+    if (env) {
+      numSlots = strtoull(env, NULL, 10);
+      if (numSlots == 0 || (numSlots & (numSlots - 1)) != 0) {
+        cerr << "LIBCAM_SIGNATURE_SLOTS must be a power of two\n";
+        abort();
+      }
+    }
+    slots.resize(numSlots, SignatureSlot());
+    touchedSlots.reserve(numSlots);
+  }
+
+  /* Write the suspected dependences with their conflict counts, and a verdict */
+  void
+  dumpDependences(void)
+  {
+    ofstream outputFile;
+    outputFile.open(getOutputDirectory() + "/suspected_dependences.txt");
+    writeConflicts(outputFile, rwConflicts);
+    outputFile << endl;
+    writeConflicts(outputFile, wwConflicts);
+    outputFile.close();
+    if (rwConflicts.empty() && wwConflicts.empty()) {
+      cerr << "LIBCAM: No conflicts between iterations found, loops are likely DOALL\n";
+    } else {
+      cerr << "LIBCAM: " << rwConflicts.size() + wwConflicts.size() << " suspected dependences, see suspected_dependences.txt\n";
+    }
+  }
+};
+
+
+/**
+ * The dependence tracer, if running.
+ **/
+static DependenceTracer *dependenceTracer = NULL;
+static TimeoutCounter *timeoutCounter = NULL;
+
+
+/**
+ * Check a memory reference for dependences.
+ **/
+void
+dependence_trace_record(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen)
+{
+  if(timeoutCounter->recordOperation())
+    return;
+
+  dependenceTracer->record(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
+}
+
+
+/**
+ * Check whether the dependence tracer is initialised.
+ **/
+bool
+dependence_trace_running(void)
+{
+  return dependenceTracer != NULL;
+}
+
+
+/**
+ * Follow the loop and call events.
+ **/
+void
+dependence_trace_loop_invocation_start(JITNINT loopID)
+{
+  dependenceTracer->loopInvocationStart(loopID);
+}
+
+void
+dependence_trace_loop_invocation_end(void)
+{
+  dependenceTracer->loopInvocationEnd();
+}
+
+void
+dependence_trace_loop_iteration_start(void)
+{
+  dependenceTracer->loopIterationStart();
+}
+
+void
+dependence_trace_call_invocation_start(JITNINT instID)
+{
+  dependenceTracer->callInvocationStart(instID);
+}
+
+void
+dependence_trace_call_invocation_end(void)
+{
+  dependenceTracer->callInvocationEnd();
+}
+
+
+/**
+ * Initialisation, signatures selects the signature tracer rather than the
+ * exact shadow memory tracer.
+ **/
+void
+dependence_trace_init(bool signatures)
+{
+  if (signatures) {
+    dependenceTracer = new SignatureDependenceTracer();
+  } else {
+    dependenceTracer = new ShadowDependenceTracer();
+  }
+  timeoutCounter = new TimeoutCounter();
+}
+
+
+/**
+ * Shut down.
+ **/
+void
+dependence_trace_shutdown(void)
+{
+  timeoutCounter->dumpStats(dependenceTracer->getOutputDirectory());
+  delete timeoutCounter;
+
+  dependenceTracer->dumpDependences();
+  delete dependenceTracer;
+  dependenceTracer = NULL;
+}
@@ -0,0 +1,42 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef DEPENDENCETRACER_H
+#define DEPENDENCETRACER_H
+
+#include "cam.h"
+
+/* Initialisation, of the signature tracer if signatures is true, otherwise of the shadow memory tracer. */
+void dependence_trace_init(bool signatures);
+
+/* Shut down, writing dependence_pairs.txt or suspected_dependences.txt. */
+void dependence_trace_shutdown(void);
+
+/* Check for dependences of a memory reference, used by CAM_mem and CAM_memSeenInstruction. */
+bool dependence_trace_running(void);
+void dependence_trace_record(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen);
+
+/* Loop and call events, used to attribute references to iterations and calls. */
+void dependence_trace_loop_invocation_start(JITNINT loopID);
+void dependence_trace_loop_invocation_end(void);
+void dependence_trace_loop_iteration_start(void);
+void dependence_trace_call_invocation_start(JITNINT instID);
+void dependence_trace_call_invocation_end(void);
+
+#endif
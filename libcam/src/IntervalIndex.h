@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef INTERVALINDEX_H
+#define INTERVALINDEX_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+/*
+ * A static index of closed intervals [start, stop], answering which of them
+ * overlap another.  The intervals are kept in one array sorted by start, which
+ * is read as an implicit balanced tree: the nodes of level k are the indices
+ * whose lowest k bits are set and their lowest k + 1 bits are not, each
+ * augmented with the largest stop of its subtree.  Building is a sort, there
+ * is no allocation per interval, and a query visits O(log n + overlaps)
+ * entries, scanning the small subtrees near the leaves linearly.
+ */
+template<class T, typename K = uint64_t> class IntervalIndex{
+public:
+  struct Entry{
+    K start;
+    K stop;
+    K maxStop;    /* Largest stop in the subtree of this entry */
+    T value;
+    size_t position;    /* Position of the item indexed, for updates */
+  };
+
+private:
+  std::vector<Entry> entries;
+  int maxLevel;
+  K highestStop;
+
+  /* Subtrees up to this level are scanned rather than descended */
+  static const int SCAN_LEVEL = 3;
+
+  struct Node{
+    int level;
+    int64_t index;
+    bool leftDone;
+  };
+
+  static bool startsBefore(const Entry& a, const Entry& b) { return a.start < b.start; }
+
+  void augment(){
+    int64_t n = entries.size();
+    if(n == 0){
+      maxLevel = 0;
+      return;
+    }
+    /* Leaves, the last of them is the rightmost path through a partial tree */
+    int64_t lastIndex = 0;
+    K last = 0;
+    for(int64_t i = 0; i < n; i += 2){
+      lastIndex = i;
+      last = entries[i].maxStop = entries[i].stop;
+    }
+    int k;
+    for(k = 1; (int64_t(1) << k) <= n; k++){
+      int64_t half = int64_t(1) << (k - 1);
+      for(int64_t i = (half << 1) - 1; i < n; i += half << 2){
+        K m = std::max(entries[i].stop, entries[i - half].maxStop);
+        /* A right child past the end stands for the last entries */
+        m = std::max(m, i + half < n ? entries[i + half].maxStop : last);
+        entries[i].maxStop = m;
+      }
+      lastIndex = (lastIndex >> k & 1) ? lastIndex - half : lastIndex + half;
+      if(lastIndex < n)
+        last = std::max(last, entries[lastIndex].maxStop);
+    }
+    maxLevel = k - 1;
+  }
+
+public:
+  IntervalIndex() : maxLevel(0), highestStop(0) {}
+
+  template<class Iter, class Extent>
+  IntervalIndex(Iter begin, Iter end, Extent extent) { build(begin, end, extent); }
+
+  /* Index the items in [begin, end), extent(item, start, stop, value) gives each interval */
+  template<class Iter, class Extent>
+  void build(Iter begin, Iter end, Extent extent){
+    entries.clear();
+    highestStop = 0;
+    for(Iter i = begin; i != end; i++){
+      Entry e;
+      extent(*i, e.start, e.stop, e.value);
+      e.maxStop = e.stop;
+      e.position = entries.size();
+      highestStop = std::max(highestStop, e.stop);
+      entries.push_back(e);
+    }
+    std::sort(entries.begin(), entries.end(), startsBefore);
+    augment();
+  }
+
+  /*
+   * Index the items in [begin, end) in place of those of the last build, a
+   * random access range of the same number of items is matched by position.
+   * Returns false if the intervals had to be sorted again.  Items with the
+   * same extents, or all moved by the same distance, keep the augmented tree,
+   * and items still in order of start only have it recomputed.
+   */
+  template<class Iter, class Extent>
+  bool update(Iter begin, Iter end, Extent extent){
+    if(size_t(end - begin) != entries.size()){
+      build(begin, end, extent);
+      return false;
+    }
+    bool sorted = true;
+    bool shifted = true;
+    K shift = 0;
+    K highest = 0;
+    for(size_t i = 0; i < entries.size(); i++){
+      Entry& e = entries[i];
+      K start, stop;
+      extent(*(begin + e.position), start, stop, e.value);
+      if(i == 0)
+        shift = start - e.start;
+      else if(start < entries[i - 1].start)
+        sorted = false;
+      shifted = shifted && start - e.start == shift && stop - e.stop == shift;
+      e.start = start;
+      e.stop = stop;
+      highest = std::max(highest, stop);
+    }
+    highestStop = highest;
+    if(shifted){
+      if(shift != 0){
+        for(auto e = entries.begin(); e != entries.end(); e++)
+          e->maxStop += shift;
+      }
+      return true;
+    }
+    for(auto e = entries.begin(); e != entries.end(); e++)
+      e->maxStop = e->stop;
+    if(!sorted)
+      std::sort(entries.begin(), entries.end(), startsBefore);
+    augment();
+    return sorted;
+  }
+
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+
+  /*
+   * Call visit(value) for each interval overlapping [start, stop], while it
+   * returns true.  Returns false if the visit was stopped.
+   */
+  template<class Visit>
+  bool findOverlapping(K start, K stop, Visit visit) const{
+    int64_t n = entries.size();
+    if(n == 0)
+      return true;
+    /* The depth of the walk is bounded by the levels, nodes are revisited once */
+    Node stack[2 * 64 + 2];
+    int top = 0;
+    stack[top++] = Node{maxLevel, (int64_t(1) << maxLevel) - 1, false};
+    while(top > 0){
+      Node node = stack[--top];
+      if(node.level <= SCAN_LEVEL){
+        int64_t first = node.index >> node.level << node.level;
+        int64_t last = std::min(first + (int64_t(1) << (node.level + 1)) - 1, n);
+        for(int64_t i = first; i < last && entries[i].start <= stop; i++){
+          if(entries[i].stop >= start && !visit(entries[i].value))
+            return false;
+        }
+      }
+      else if(!node.leftDone){
+        int64_t left = node.index - (int64_t(1) << (node.level - 1));
+        stack[top++] = Node{node.level, node.index, true};
+        if(left >= n || entries[left].maxStop >= start)
+          stack[top++] = Node{node.level - 1, left, false};
+      }
+      else if(node.index < n && entries[node.index].start <= stop){
+        if(entries[node.index].stop >= start && !visit(entries[node.index].value))
+          return false;
+        stack[top++] = Node{node.level - 1, node.index + (int64_t(1) << (node.level - 1)), false};
+      }
+    }
+    return true;
+  }
+
+  /* Append the values of the intervals overlapping [start, stop] */
+  void findOverlapping(K start, K stop, std::vector<T>& values) const{
+    findOverlapping(start, stop, [&values](const T& v){ values.push_back(v); return true; });
+  }
+
+  /*
+   * Overlaps of a batch of queries, extent(query, start, stop) gives the
+   * interval of each query in [begin, end), and visit(query, value) is called
+   * for each overlap in the order of the queries, while it returns true.
+   * Returns false if the visit was stopped.
+   */
+  template<class Iter, class Extent, class Visit>
+  bool findOverlappingBatch(Iter begin, Iter end, Extent extent, Visit visit) const{
+    if(entries.empty())
+      return true;
+    K lowest = entries.front().start;
+    for(Iter q = begin; q != end; q++){
+      K start, stop;
+      extent(*q, start, stop);
+      /* Queries outside the span of the index do not walk it */
+      if(stop < lowest || start > highestStop)
+        continue;
+      if(!findOverlapping(start, stop, [&visit, &q](const T& v){ return visit(*q, v); }))
+        return false;
+    }
+    return true;
+  }
+};
+
+#endif
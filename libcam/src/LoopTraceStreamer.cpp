@@ -21,20 +21,77 @@
 #include "loop_trace_cfc_parser.h"
 #include <cassert>
 
-LoopTraceStreamer::LoopTraceStreamer() 
+LoopTraceStreamer::LoopTraceStreamer(unsigned int level) 
   : ltcl(LoopTraceCfcLex())
   , parser(BZ2ParserState(
-        "loop_trace.txt.bz2"
+        (level == 0 ? string("loop_trace.txt.bz2") : "loop_trace.level" + to_string(level) + ".txt.bz2").c_str()
       , looptracecfclex
       , looptracecfc_scan_buffer
       , looptracecfc_switch_to_buffer
       , looptracecfc_delete_buffer
       , &ltcl
     ))
+  , binary(NULL)
+  , binaryRemainingGroups(0)
 { 
+  string binaryName = level == 0 ? string("loop_trace.bin.bz2") : "loop_trace.level" + to_string(level) + ".bin.bz2";
+  if(BinaryTraceReader::exists(binaryName))
+    binaryFilename = binaryName;
+}
+
+LoopTraceStreamer::~LoopTraceStreamer(){
+  delete binary;
+}
+
+int LoopTraceStreamer::getFullBinaryEntry(LoopTraceEntry& lte, set<uintptr_t> *instructionList){
+  if(!binary)
+    binary = new BinaryTraceReader(binaryFilename);
+
+  /* Loop ID (ignored) and number of invocation entries */
+  while(binaryRemainingGroups == 0){
+    uint64_t loopID;
+    if(!binary->readVarint(loopID))
+      return 0;
+    binaryRemainingGroups = binary->readVarint();
+  }
+
+  /* Invocation repetition pattern */
+  vector<pair<uint64_t, uint64_t>> ranges;
+  binary->readRange(ranges);
+  for(auto r = ranges.begin(); r != ranges.end(); r++)
+    lte.addInvocationPattern(r->first, r->second);
+
+  /* Iteration repetition patterns and CFCs */
+  uint64_t numIterGroups = binary->readVarint();
+  for(uint64_t i = 0; i < numIterGroups; i++){
+    lte.addIterationGroup();
+    ranges.clear();
+    binary->readRange(ranges);
+    for(auto r = ranges.begin(); r != ranges.end(); r++)
+      lte.addIterationPattern(r->first, r->second);
+    vector<CompressionPattern> patterns;
+    binary->readCfc(instructionList ? NULL : &patterns, instructionList);
+    for(auto p = patterns.begin(); p != patterns.end(); p++)
+      lte.addCfc(*p);
+  }
+  binaryRemainingGroups--;
+
+  uint64_t status = binary->readVarint();
+  if(status == BINARY_TRACE_INVOC_COMPLETE)
+    ltcl.rstatus = ltcl.INVOC_COMPLETE;
+  else if(status == BINARY_TRACE_INVOC_INCOMPLETE)
+    ltcl.rstatus = ltcl.INVOC_INCOMPLETE;
+  else{
+    cerr << "Loop trace found invalid completion status " << status << endl;
+    abort();
+  }
+  return 1;
 }
 
 int LoopTraceStreamer::getFullEntry(LoopTraceEntry& lte){
+  if(!binaryFilename.empty())
+    return getFullBinaryEntry(lte);
+
   assert(ltcl.state == 0 || ltcl.state == 2);
   ltcl.loopEntry = &lte;
   ltcl.rstatus = ltcl.ACTIVE;
@@ -68,6 +125,16 @@ pair<set<uintptr_t>, uint64_t> LoopTraceStreamer::parseForInstructionList(){
   uint64_t numInvoc = 0;
   LoopTraceEntry lte;
 
+  if(!binaryFilename.empty()){
+    LoopTraceEntry entry;
+    while(getFullBinaryEntry(entry, &instructionList)){
+      if(entry.getLastInvocationNumber() > numInvoc)
+        numInvoc = entry.getLastInvocationNumber();
+      entry = LoopTraceEntry();
+    }
+    return pair<set<uintptr_t>, uint64_t>(instructionList, numInvoc+1);
+  }
+
   ltcl.loopEntry = &lte;
   ltcl.instructionList = &instructionList;
   ltcl.numInvoc = &numInvoc;
@@ -23,15 +23,23 @@
 #include "BZ2ParserState.h"
 //#include "parser_wrappers.h"
 #include "LoopTraceCfcLex.h"
+#include "BinaryTraceReader.h"
 
 class LoopTraceStreamer{
   LoopTraceCfcLex ltcl;
   BZ2ParserState parser;
+  /* Set if the trace was written in the binary format, the reader is opened on first use */
+  string binaryFilename;
+  BinaryTraceReader *binary;
+  uint64_t binaryRemainingGroups;
 
   int getFullEntry(LoopTraceEntry& lte);
+  int getFullBinaryEntry(LoopTraceEntry& lte, set<uintptr_t> *instructionList = NULL);
 
 public:
-  LoopTraceStreamer();
+  /* Streams the loop trace of the given nesting level */
+  LoopTraceStreamer(unsigned int level = 0);
+  ~LoopTraceStreamer();
 
   /* Returns 1 if a valid LoopTraceEntry was filled, 0 otherwise */
   int getNextEntry(LoopTraceEntry& lte);
@@ -0,0 +1,321 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "MemoryTraceDecoder.h"
+#include "TraceTokenizer.h"
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+MemoryTraceDecoder::MemoryTraceDecoder(const char *filename)
+  : parser(filename), text(NULL), textLength(0), position(0), exhausted(false),
+    state(0), remaining_groups(0), group_state(0), memset(NULL), currNested(false), currTagged(false), currDeltaRun(false),
+    currReference(false), currTemplate(false), lastOffset(0), capture(NULL), lastAccess(0), nextExpectedInstance(0) {}
+
+/* Copy the entries just added to the template being read, if any */
+void MemoryTraceDecoder::captureTemplateEntries(MemSet& set, size_t first){
+  if(capture == NULL)
+    return;
+  for(size_t i = first; i < set.size(); i++){
+    MemSetEntry entry = set[i];
+    entry.setStart(entry.getStart() - captureFirstInstance);
+    entry.setEnd(entry.getEnd() - captureFirstInstance);
+    capture->entries.push_back(entry);
+  }
+  if(nextExpectedInstance >= captureEndInstance){
+    capture->lastAccess = lastAccess;
+    capture = NULL;
+  }
+}
+
+void MemoryTraceDecoder::addNumRepsToSet(MemSet& set, uint64_t tagSpan){
+  size_t first = set.size();
+  if(currNested){
+    set.push_back(MemSetEntry(currBase, currStride, currLength, nextExpectedInstance, nextExpectedInstance+currNumReps-1,
+                              currRowStride, currRowLength));
+    nextExpectedInstance += currNumReps;
+    currNested = false;
+    captureTemplateEntries(set, first);
+    return;
+  }
+  set.push_back(MemSetEntry(currBase, currStride, currLength, nextExpectedInstance, nextExpectedInstance+currNumReps-1));
+  nextExpectedInstance += currNumReps;
+  if(currTagged){
+    set.back().setIterationTags(currTagInvocation, currTagFirstIteration, tagSpan);
+    currTagged = false;
+  }
+  if(set.back().isTrivialPattern()){
+    set.push_back(set.back().splitTrivial());
+  }
+  captureTemplateEntries(set, first);
+}
+
+void MemoryTraceDecoder::getAbsoluteBase(intptr_t baseDiff){
+  if(baseDiff < 0)
+    currBase = lastAccess - abs(baseDiff);
+  else
+    currBase = lastAccess + baseDiff;
+  lastAccess = currBase;
+}
+
+void MemoryTraceDecoder::finishMemSetEntry(){
+  currDeltaRun = false;
+  group_state=0;
+  remaining_groups--;
+  if(remaining_groups == 0)
+    state = (state + 1)%5;
+}
+
+/* Each access of a delta run becomes a single instance entry */
+void MemoryTraceDecoder::addDeltaAccessToSet(MemSet& set){
+  set.push_back(MemSetEntry(currDeltaAddr, 0, currLength, nextExpectedInstance, nextExpectedInstance));
+  nextExpectedInstance++;
+  captureTemplateEntries(set, set.size() - 1);
+}
+
+/* A template marker is an invocation and its number of instances, the
+ * entries holding them follow it */
+void MemoryTraceDecoder::readTemplateEntry(int64_t value){
+  if(group_state == 0){
+    currInvocation = value;
+    group_state++;
+  }
+  else{
+    capture = &templates[currInvocation];
+    capture->entries.clear();
+    captureFirstInstance = nextExpectedInstance;
+    captureEndInstance = nextExpectedInstance + value;
+    currTemplate = false;
+    finishMemSetEntry();
+  }
+}
+
+/* A reference is an earlier invocation, the offset of the addresses from it,
+ * relative to the offset of the previous reference, and the number of
+ * instances, it repeats the entries of the template */
+void MemoryTraceDecoder::readReferenceEntry(MemSet& set, int64_t value){
+  if(group_state == 0){
+    currInvocation = value;
+    group_state++;
+  }
+  else if(group_state == 1){
+    currOffset = lastOffset + value;
+    lastOffset = currOffset;
+    group_state++;
+  }
+  else{
+    auto t = templates.find(currInvocation);
+    uint64_t numInstances = value;
+    if(t == templates.end() || t->second.entries.back().getEnd() + 1 != numInstances){
+      cerr << "Memory trace refers to unknown invocation " << currInvocation << endl;
+      abort();
+    }
+    for(auto i = t->second.entries.begin(); i != t->second.entries.end(); i++){
+      set.push_back(*i);
+      set.back().setBase(i->getBase() + currOffset);
+      set.back().setStart(i->getStart() + nextExpectedInstance);
+      set.back().setEnd(i->getEnd() + nextExpectedInstance);
+    }
+    nextExpectedInstance += numInstances;
+    lastAccess = t->second.lastAccess + currOffset;
+    currReference = false;
+    finishMemSetEntry();
+  }
+}
+
+/* A delta run is the base, the length, the number of accesses and then the
+ * difference of each access after the first from the one before it */
+void MemoryTraceDecoder::readDeltaRunEntry(int64_t value){
+  if(group_state == 1){
+    currLength = value;
+    group_state++;
+  }
+  else if(group_state == 2){
+    remainingDeltas = value - 1;
+    currDeltaAddr = currBase;
+    addDeltaAccessToSet(*memset);
+    if(remainingDeltas == 0)
+      finishMemSetEntry();
+    else
+      group_state++;
+  }
+  else{
+    currDeltaAddr += value;
+    addDeltaAccessToSet(*memset);
+    remainingDeltas--;
+    if(remainingDeltas == 0)
+      finishMemSetEntry();
+  }
+}
+
+void MemoryTraceDecoder::readMemSetEntry(int64_t value){
+  if(currTemplate){
+    readTemplateEntry(value);
+    return;
+  }
+  if(currReference){
+    readReferenceEntry(*memset, value);
+    return;
+  }
+  if(group_state > 0 && currDeltaRun){
+    readDeltaRunEntry(value);
+    return;
+  }
+  if(group_state == 0){
+    getAbsoluteBase(value);
+    group_state++;
+  }
+  else if(group_state == 1){
+    currStride = value;
+    group_state++;
+  }
+  else if(group_state == 2){
+    currLength = value;
+    group_state++;
+  }
+  else if(group_state == 3){
+    currNumReps = value;
+    /* A nested entry carries the row stride and row length after the number of repetitions */
+    if(currNested){
+      group_state++;
+      return;
+    }
+    /* A tagged entry carries the invocation, first iteration and iteration span */
+    if(currTagged){
+      group_state = 6;
+      return;
+    }
+    addNumRepsToSet(*memset, value);
+    finishMemSetEntry();
+  }
+  else if(group_state == 4){
+    currRowStride = value;
+    group_state++;
+  }
+  else if(group_state == 5){
+    currRowLength = value;
+    addNumRepsToSet(*memset, value);
+    finishMemSetEntry();
+  }
+  else if(group_state == 6){
+    currTagInvocation = value;
+    group_state++;
+  }
+  else if(group_state == 7){
+    currTagFirstIteration = value;
+    group_state++;
+  }
+  else if(group_state == 8){
+    addNumRepsToSet(*memset, value);
+    finishMemSetEntry();
+  }
+}
+
+void MemoryTraceDecoder::readNumber(int64_t value){
+  if(state == 0){
+    /* The instruction ID is actually not being used any more */
+    lastAccess = 0;
+    lastOffset = 0;
+    state++;
+  }
+  else if(state == 1){
+    remaining_groups = value;
+    if(remaining_groups > 0){
+      group_state = 0;
+      state++;
+    }
+    else {
+      state += 2;
+    }
+  }
+  else if(state == 2 || state == 4){
+    readMemSetEntry(value);
+  }
+  else if(state == 3){
+    remaining_groups = value;
+    if(remaining_groups > 0){
+      group_state = 0;
+      state++;
+    }
+    else {
+      state = 0;
+    }
+  }
+  else{
+    cerr << "error, wrong state: " << value << endl;
+  }
+}
+
+void MemoryTraceDecoder::readMarker(char marker){
+  if(state != 2 && state != 4)
+    return;
+  switch(marker){
+    /* Marks the following entry as a nested (two-level stride) pattern */
+    case 'n':
+      currNested = true;
+      break;
+    /* Marks the following entry as tagged with the loop invocation and iterations it covers */
+    case 't':
+      currTagged = true;
+      break;
+    /* Marks the following entry as a run of irregular accesses stored as deltas */
+    case 'd':
+      currDeltaRun = true;
+      break;
+    /* Marks the following entry as a reference to the entries of an earlier invocation */
+    case 'r':
+      currReference = true;
+      break;
+    /* Marks the following entries as an invocation that may be referred to */
+    case 'i':
+      currTemplate = true;
+      break;
+  }
+}
+
+bool MemoryTraceDecoder::decodeUntil(MemSet& set, uint64_t endInstance){
+  memset = &set;
+  while(nextExpectedInstance < endInstance){
+    if(position == textLength){
+      if(exhausted)
+        return false;
+      textLength = parser.readBlock(text);
+      position = 0;
+      if(textLength == 0){
+        exhausted = true;
+        return false;
+      }
+    }
+    position += skipSeparators(text + position, textLength - position);
+    if(position == textLength)
+      continue;
+    char c = text[position];
+    if(isTraceDigit(c) || (c == '-' && isTraceDigit(text[position + 1]))){
+      int64_t value;
+      position += parseNumber(text + position, textLength - position, value);
+      readNumber(value);
+    }
+    else{
+      readMarker(c);
+      position++;
+    }
+  }
+  return true;
+}
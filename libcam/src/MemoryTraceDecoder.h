@@ -0,0 +1,104 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef MEMORYTRACEDECODER_H
+#define MEMORYTRACEDECODER_H
+
+#include <map>
+#include "static_inst_rec.h"
+#include "BZ2ParserState.h"
+
+/* The entries of an invocation that later invocations refer back to,
+ * starting from instance 0, and the base of the last of them */
+struct MemoryTraceTemplate{
+  MemSet entries;
+  uintptr_t lastAccess;
+};
+
+/*
+ * Decodes a compressed memory trace file into MemSet entries.  The trace is
+ * numbers, and the markers n, d, t, r and i, separated by anything else; it
+ * is split by TraceTokenizer rather than a flex scanner, and all the state of the
+ * decoder is held in the object, so several traces can be decoded at once on
+ * different threads.
+ */
+class MemoryTraceDecoder{
+  BZ2ParserState parser;
+
+  /* The block of text being decoded */
+  char *text;
+  size_t textLength;
+  size_t position;
+  bool exhausted;
+
+  int state;
+  uint64_t remaining_groups;
+  int group_state;
+  MemSet *memset;
+  uintptr_t currBase;
+  intptr_t currStride;
+  uint64_t currLength;
+  uint64_t currNumReps;
+  bool currNested;
+  intptr_t currRowStride;
+  uint64_t currRowLength;
+  bool currTagged;
+  uint64_t currTagInvocation;
+  uint64_t currTagFirstIteration;
+  bool currDeltaRun;
+  uintptr_t currDeltaAddr;
+  uint64_t remainingDeltas;
+  bool currReference;
+  bool currTemplate;
+  uint64_t currInvocation;
+  intptr_t currOffset;
+  intptr_t lastOffset;
+  std::map<uint64_t, MemoryTraceTemplate> templates;
+  MemoryTraceTemplate *capture;
+  uint64_t captureFirstInstance;
+  uint64_t captureEndInstance;
+  uintptr_t lastAccess;
+  uint64_t nextExpectedInstance;
+
+  void captureTemplateEntries(MemSet& set, size_t first);
+  void addNumRepsToSet(MemSet& set, uint64_t tagSpan);
+  void getAbsoluteBase(intptr_t baseDiff);
+  void finishMemSetEntry();
+  void addDeltaAccessToSet(MemSet& set);
+  void readTemplateEntry(int64_t value);
+  void readReferenceEntry(MemSet& set, int64_t value);
+  void readDeltaRunEntry(int64_t value);
+  void readMemSetEntry(int64_t value);
+
+  /* Decode a number of the trace */
+  void readNumber(int64_t value);
+
+  /* Decode a marker of the following entry */
+  void readMarker(char marker);
+
+public:
+  MemoryTraceDecoder(const char *filename);
+
+  /* Decode entries into set until instance endInstance - 1 has been read,
+   * returns false once the end of the trace has been reached */
+  bool decodeUntil(MemSet& set, uint64_t endInstance);
+};
+
+#endif
@@ -18,24 +18,50 @@
  */
 
 #include "MemoryTraceStreamer.h"
+#include "WorkerPool.h"
 #include <cassert>
+#include <cstdlib>
+
+static bool prefetchTraces(){
+  static bool prefetch = WorkerPool::shared().size() > 1 &&
+    !(getenv("LIBCAM_PREFETCH_MEMORY_TRACES") && atoi(getenv("LIBCAM_PREFETCH_MEMORY_TRACES")) == 0);
+  return prefetch;
+}
 
 MemoryTraceStreamer::MemoryTraceStreamer(uintptr_t _instrID, string filename, bool _write)
   : instrID(_instrID)
-  , mtl(MemoryTraceLex())
-  , parser(BZ2ParserState(
-        filename.c_str()
-      , memorytracelex
-      , memorytrace_scan_buffer
-      , memorytrace_switch_to_buffer
-      , memorytrace_delete_buffer
-      , &mtl
-    ))
+  , decoder(filename.c_str())
   , write(_write)
   , status(1)
+  , startInstance(0)
+  , prefetching(false)
+  , nextSkipped(0)
 {
 }
 
+MemoryTraceStreamer::~MemoryTraceStreamer(){
+  finishPrefetch();
+}
+
+void MemoryTraceStreamer::startPrefetch(uint64_t numInstances){
+  if(!status || !prefetchTraces())
+    return;
+  uint64_t endInstance = startInstance + numInstances;
+  prefetching = true;
+  prefetch = WorkerPool::shared().submit([this, endInstance](){
+    status = decoder.decodeUntil(prefetched, endInstance);
+  });
+}
+
+void MemoryTraceStreamer::finishPrefetch(){
+  if(!prefetching)
+    return;
+  WorkerPool::shared().wait(prefetch);
+  prefetching = false;
+  copy(prefetched.begin(), prefetched.end(), back_inserter(remainder));
+  prefetched.clear();
+}
+
 uint64_t MemoryTraceStreamer::getNumBufferedInstances(MemSet& memset){
   if(memset.size() > 0)
     return memset.back().getEnd() -  memset.front().getStart() + 1;
@@ -43,23 +69,36 @@ uint64_t MemoryTraceStreamer::getNumBufferedInstances(MemSet& memset){
     return 0;
 }
 
+void MemoryTraceStreamer::setSkippedInstances(const vector<pair<uint64_t, uint64_t>> &ranges){
+  skipped = ranges;
+  nextSkipped = 0;
+}
+
 MemSet MemoryTraceStreamer::getNextChunk(uint64_t numInstances, bool allowOvershoot){
+  if(numInstances == 0)
+    return MemSet();
+
+  /* Drop the instances outside the loops before the next chunk */
+  while(nextSkipped < skipped.size() && skipped[nextSkipped].first <= startInstance){
+    readChunk(skipped[nextSkipped].second, true);
+    nextSkipped++;
+  }
+  return readChunk(numInstances, allowOvershoot);
+}
+
+MemSet MemoryTraceStreamer::readChunk(uint64_t numInstances, bool allowOvershoot){
   MemSet chunk;
 
   if(numInstances == 0)
     return chunk;
 
-  /* Copy the remainder into chunk */
-  copy(remainder.begin(), remainder.end(), back_inserter(chunk));
-  remainder.clear();
-
-  /* Set up the lexer state */
-  mtl.memset = &chunk;
-  mtl.numInstancesRequired = numInstances;
+  /* Copy the remainder, and anything decoded in the background, into chunk */
+  finishPrefetch();
+  chunk.swap(remainder);
 
-  while(getNumBufferedInstances(chunk) < numInstances && status){
-    status = parser.parseBlock();
-  }
+  /* Decode the rest of the instances needed */
+  if(status)
+    status = decoder.decodeUntil(chunk, startInstance + numInstances);
 
   /* The stream has been exhausted */
   if(chunk.empty())
@@ -73,7 +112,17 @@ MemSet MemoryTraceStreamer::getNextChunk(uint64_t numInstances, bool allowOversh
 
   /* Split the straddleEntry if necessary and copy and entries in excess into remainder */
   if(straddleEntry != chunk.end()){
-    if(straddleEntry->getEnd() > lastInstance)
+    if(straddleEntry->getEnd() > lastInstance && straddleEntry->isNested()){
+      /* A nested entry may have to be broken into several entries on either side of the split */
+      vector<MemSetEntry> head = straddleEntry->getSlices(straddleEntry->getStart(), lastInstance);
+      vector<MemSetEntry> tail = straddleEntry->getSlices(lastInstance + 1, straddleEntry->getEnd());
+      copy(tail.begin(), tail.end(), back_inserter(remainder));
+      uint64_t straddleIndex = straddleEntry - chunk.begin();
+      chunk.erase(straddleEntry);
+      chunk.insert(chunk.begin() + straddleIndex, head.begin(), head.end());
+      straddleEntry = chunk.begin() + straddleIndex + head.size() - 1;
+    }
+    else if(straddleEntry->getEnd() > lastInstance)
       remainder.push_back(straddleEntry->splitOffEnd(straddleEntry->getEnd() - lastInstance));
     if(next(straddleEntry,1) != chunk.end()){
       copy(next(straddleEntry, 1), chunk.end(), back_inserter(remainder));
@@ -103,8 +152,9 @@ MemSet MemoryTraceStreamer::getNextChunk(uint64_t numInstances, bool allowOversh
   }
 #endif
 
-  /* Set mtl.startInstance */
-  mtl.startInstance = chunk.back().getEnd() + 1;
+  /* The next chunk starts after this one, decode it meanwhile */
+  startInstance = chunk.back().getEnd() + 1;
+  startPrefetch(numInstances);
 
   assert(allowOvershoot || getNumBufferedInstances(chunk) == numInstances);
 
@@ -20,30 +20,57 @@
 #ifndef MEMORYTRACESTREAMER_H
 #define MEMORYTRACESTREAMER_H
 
+#include <future>
 #include <map>
 #include <vector>
 #include "static_inst_rec.h"
 #include "parser_wrappers.h"
-#include "BZ2ParserState.h"
-#include "memory_trace_parser.h"
+#include "MemoryTraceDecoder.h"
 
+/*
+ * Streams the memory trace of an instruction a chunk of instances at a time.
+ * Unless LIBCAM_PREFETCH_MEMORY_TRACES is 0, and if the WorkerPool has more
+ * than one thread, as each chunk is returned the next, assumed to be as long,
+ * is decoded on the pool while the caller works on the current one.
+ */
 class MemoryTraceStreamer{
   uintptr_t instrID;
   MemSet remainder;
-  MemoryTraceLex mtl;
-  BZ2ParserState parser;
+  MemoryTraceDecoder decoder;
   bool write;
   uint64_t lastReturnedInstance;
   int status;
+  uint64_t startInstance;
+
+  /* Entries decoded ahead of the next chunk */
+  MemSet prefetched;
+  std::future<void> prefetch;
+  bool prefetching;
+
+  /* Ranges of instances, (first, count), made outside the loops of the analysed level */
+  vector<pair<uint64_t, uint64_t>> skipped;
+  size_t nextSkipped;
 
   uint64_t getNumBufferedInstances(MemSet& memset);
 
+  /* Decode the entries up to numInstances past the last chunk in the background */
+  void startPrefetch(uint64_t numInstances);
+
+  /* Wait for the entries decoded in the background and move them to the remainder */
+  void finishPrefetch();
+
+  MemSet readChunk(uint64_t numInstances, bool allowOvershoot);
+
 public:
   MemoryTraceStreamer(uintptr_t _instrID, string filename, bool _write);
+  ~MemoryTraceStreamer();
 
   /* Parse enough of the trace to get the specified number of instances */ 
   MemSet getNextChunk(uint64_t numInstances, bool allowOvershoot=false);
 
+  /* Instances the loop trace does not count, which are discarded as they are reached */
+  void setSkippedInstances(const vector<pair<uint64_t, uint64_t>> &ranges);
+
   uintptr_t getID();
 
   bool isWrite();
@@ -20,6 +20,7 @@
 #include <bzlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 
@@ -28,8 +29,11 @@
 #include "MemoryTracer.h"
 #include "memory_allocator.hh"
 #include "TimeoutCounter.h"
+#include "AccessSummary.h"
 
+#include <algorithm>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <vector>
@@ -42,50 +46,260 @@ using namespace std;
  **/
 #define LIBCAM_DEFAULT_MAX_MEM_USAGE ((JITUINT64)1073741824ULL)
 
+/**
+ * Percentage of the maximum memory usage that the trace is brought back down
+ * to by evicting instruction records once the maximum is exceeded.  Can be
+ * altered using the environment variable LIBCAM_MEM_TRACE_LOW_WATERMARK, 0
+ * dumps the whole trace each time.
+ **/
+#define LIBCAM_DEFAULT_LOW_WATERMARK 75
+
+/**
+ * Number of consecutive short (one or two instance) patterns after which an
+ * instruction's accesses are considered irregular and recorded as deltas.
+ **/
+#define LIBCAM_IRREGULAR_PATTERN_THRESHOLD 4
+
+/**
+ * Number of consecutive equal deltas after which a delta run is considered
+ * regular again and stride compression is resumed.
+ **/
+#define LIBCAM_STABLE_DELTA_THRESHOLD 4
+
+/**
+ * Initial size in bytes of the buffer holding the deltas of a delta run.
+ **/
+#define LIBCAM_DELTA_BUFFER_SIZE 64
+
+/**
+ * Maximum number of distinct invocations kept for later invocations to
+ * refer back to, when deduplicating invocations.  Can be altered using the
+ * environment variable LIBCAM_MEM_TRACE_DEDUP_TEMPLATES.
+ **/
+#define LIBCAM_DEDUP_TEMPLATES 64
+
+/* The different kinds of TracerMemSetEntry */
+enum TracerEntryKind { PATTERN_ENTRY, DELTA_ENTRY, TAGGED_ENTRY, REFERENCE_ENTRY, TEMPLATE_ENTRY };
+
 class TracerMemSetEntry {
   uintptr_t base;
   intptr_t stride;
-  uint64_t length;
+  uint32_t length;
+  uint8_t kind;         /* A TracerEntryKind, entries other than PATTERN_ENTRY are subclasses */
   uint64_t start;
   uint64_t end;
+  intptr_t rowStride;   /* Distance between the bases of consecutive rows of a nested pattern */
+  uint64_t rowLength;   /* Number of instances in each row, 0 if the pattern is not nested */
 public:
   void init(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e);
 
   /* Return the next address as predicted by the pattern */
   uintptr_t prediction();
 
+  /* Return the address of the nth instance of the pattern */
+  uintptr_t getAccess(uint64_t n);
+
+  /* Returns true if this entry is a repetition of a 1-D pattern (base, stride, rowLength) whose bases advance by rowStride */
+  bool isNested() const;
+
+  /* Returns true if this entry is a TracerDeltaEntry holding an irregular run of accesses */
+  bool isDeltaRun() const;
+
+  /* Returns true if this entry is a TracerTaggedEntry */
+  bool isTagged() const;
+
+  /* Returns true if this entry is a TracerReferenceEntry or a TracerTemplateEntry */
+  bool isReference() const;
+  bool isTemplate() const;
+
   uintptr_t getBase() const;
   intptr_t getStride() const;
   uintptr_t getLength() const;
   uintptr_t getStart() const;
   uintptr_t getEnd() const;
+  intptr_t getRowStride() const;
+  uint64_t getRowLength() const;
   void setBase(uintptr_t);
   void setStride(intptr_t);
   void setLength(uint64_t);
   void setStart(uint64_t);
   void setEnd(uint64_t);
+  void setRowStride(intptr_t);
+  void setRowLength(uint64_t);
 
   uintptr_t getNumInstances();
   void incEnd();
   void dumpInitialEntry(BZFILE *compressedFile);
   void dumpEntry(BZFILE *compressedFile, TracerMemSetEntry* prev);
+  void dumpDedupEntry(BZFILE *compressedFile);
+
+  /* Estimate of the memory held by the entry */
+  size_t getMemUsage();
+
+  /* Append the accesses of the entry, relative to address b, for comparison with another invocation */
+  void appendShape(uintptr_t b, vector<uint64_t> &shape);
+
+protected:
+  void setKind(TracerEntryKind);
+};
+
+
+/* An irregular run of accesses of a single width, stored as variable length
+ * (zigzag LEB128) deltas from the previous address rather than as patterns */
+class TracerDeltaEntry : public TracerMemSetEntry {
+  uint8_t *deltas;
+  uint32_t size;
+  uint32_t capacity;
+  uintptr_t lastAddr;
+  intptr_t lastDelta;
+  uint32_t equalDeltas;         /* Number of consecutive trailing deltas equal to lastDelta */
+  uint32_t equalDeltasOffset;   /* Offset in deltas of the first of them */
+public:
+  void initDeltas(uintptr_t b, uint64_t l, uint64_t st);
+  void freeDeltas();
+
+  /* Append the next access of the run */
+  void append(uintptr_t addr);
+
+  /* Returns true if the trailing deltas are equal for long enough to be recorded as a pattern */
+  bool isStable() const;
+  intptr_t getLastDelta() const;
+  uint32_t getNumEqualDeltas() const;
+  uint32_t getCapacity() const { return capacity; }
+
+  /* Remove the accesses forming the trailing run of equal deltas, returning the first of them */
+  uintptr_t removeStableRun();
+
+  void dumpDeltas(BZFILE *compressedFile);
+
+  /* Append the deltas, packed in words */
+  void appendDeltas(vector<uint64_t> &shape);
+};
+
+
+/* A pattern recorded in iteration tagging mode, along with the loop invocation
+ * and the iterations it covers. Each covered iteration holds the same number
+ * of instances, so the iteration of any instance can be recovered from the tags */
+class TracerTaggedEntry : public TracerMemSetEntry {
+  bool inLoop;
+  uint64_t invocation;
+  uint64_t firstIteration;
+  uint64_t lastIteration;
+  uint64_t perIteration;      /* Instances in each iteration, valid once the pattern covers more than one */
+public:
+  void initTags(uintptr_t b, uint64_t l, uint64_t st);
+
+  /* Returns true if an access made now can be added to this pattern without breaking the tags */
+  bool canExtend();
+
+  /* Add an instance made in the current iteration */
+  void extend();
+
+  /* Number of instances recorded in the last covered iteration */
+  uint64_t getInstancesInLastIteration();
+
+  /* Remove the instances of a partially complete last iteration, returning how many were removed */
+  uint64_t removePartialIteration();
+
+  void copyTags(TracerTaggedEntry *other, uint64_t iteration);
+
+  bool isInLoop() const;
+  uint64_t getLastIteration() const;
+  uint64_t getIterationSpan() const;
+
+  void dumpTags(char *buf);
+};
+
+
+/* In invocation deduplication mode, stands for the accesses an instruction
+ * made in an invocation that repeats an earlier one, shifted in memory.  The
+ * offset is relative to that of the previous reference, so the references of
+ * invocations walking through memory in equal steps are identical.  The base
+ * is that of the last entry replaced, later entries are relative to it */
+class TracerReferenceEntry : public TracerMemSetEntry {
+  uint64_t invocation;
+  intptr_t offset;
+public:
+  void initReference(uintptr_t b, uint64_t st, uint64_t e, uint64_t inv, intptr_t off);
+  void dumpReference(char *buf);
+};
+
+
+/* Marks the entries an instruction made in an invocation which later
+ * invocations may refer back to. The base is that of the entry before */
+class TracerTemplateEntry : public TracerMemSetEntry {
+  uint64_t invocation;
+public:
+  void initTemplate(uintptr_t b, uint64_t st, uint64_t e, uint64_t inv);
+  void dumpTemplate(char *buf);
 };
 
 
 class TracerMemSet : public std::vector<TracerMemSetEntry *>{
+  uint64_t owner;                 /* The instruction, times two, plus one for its write set */
+  /* Where the accesses of the current invocation start, when deduplicating invocations */
+  uint64_t invocation;            /* Outermost invocation of the last access, counting from 1, 0 outside loops */
+  size_t invocationFirstEntry;
+  uint64_t invocationFirstInstance;
+  bool breakPattern;              /* The next access starts a new entry */
+  intptr_t lastReferenceOffset;
 public:
+  TracerMemSet() : owner(0), invocation(0), invocationFirstEntry(0), invocationFirstInstance(0), breakPattern(false), lastReferenceOffset(0) {}
   ~TracerMemSet();
+  void deleteEntry(TracerMemSetEntry *entry);
   void newMemSetEntry(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e);
+
+  /* Called when the last entry stops matching, folds it into the previous entry if they form a nested pattern */
+  void closeLastEntry();
+
+  /* Returns true if the last entries are short patterns of width l, i.e. the accesses do not follow a stride */
+  bool isIrregular(uint64_t l);
+
+  /* Replace the last short patterns by a delta run and append addr to it */
+  void startDeltaRun(uintptr_t addr, uint64_t l);
+
   void recordMemoryReference(uintptr_t addr, uint64_t len);
+
+  /* As recordMemoryReference, but patterns are broken wherever they would not fall on iteration boundaries */
+  void recordTaggedMemoryReference(uintptr_t addr, uint64_t len);
+
+  /* Keep the accesses of an invocation, or of the code between invocations, in entries of their own */
+  void startInvocation(uint64_t inv);
+
+  /* Replace the entries of the current invocation by a reference to invocation inv */
+  void replaceInvocation(uint64_t inv, intptr_t offset);
+
+  /* Mark the entries of the current invocation as invocation inv, for later references */
+  void markInvocation(uint64_t inv);
+
+  void setOwner(inst_id_t id, bool write) { owner = 2*id + write; }
+
+  /* Append the owner and the entries of the current invocation, relative to address b */
+  void appendInvocationShape(uintptr_t b, vector<uint64_t> &shape);
+
+  size_t getMemUsage();
   void dumpSet(BZFILE *compressedFile);
 };
 
 class TracerStaticInstRec {
   TracerMemSet readSet;
   TracerMemSet writeSet;
+  uint64_t lastActive;    /* Number of references recorded by the tracer when the instruction was last seen */
+  AccessSummary readSummary;
+  AccessSummary writeSummary;
+  uint64_t numReads;      /* Instances in the read and write traces, including those of evicted records */
+  uint64_t numWrites;
 public:
+  TracerStaticInstRec() : lastActive(0), numReads(0), numWrites(0) {}
   TracerMemSet &getReadSet();
   TracerMemSet &getWriteSet();
+  AccessSummary &getReadSummary() { return readSummary; }
+  AccessSummary &getWriteSummary() { return writeSummary; }
+  void setLastActive(uint64_t x) { lastActive = x; }
+  uint64_t getLastActive() const { return lastActive; }
+  uint64_t &getNumReads() { return numReads; }
+  uint64_t &getNumWrites() { return numWrites; }
+  size_t getMemUsage();
   void dumpRecord(BZFILE *compressedFile);
   void dumpReadSet(BZFILE *compressedFile);
   void dumpWriteSet(BZFILE *compressedFile);
@@ -94,6 +308,10 @@ public:
 
 class TracerMemoryTrace : public std::map<uintptr_t, TracerStaticInstRec *>{
   string outputDirectory;
+  /* The read and write summaries of every instruction, including those written out */
+  map<uintptr_t, pair<AccessSummary, AccessSummary> > summaries;
+  /* The number of read and write instances of the instructions written out */
+  map<uintptr_t, pair<uint64_t, uint64_t> > instanceCounts;
 public:
   TracerMemoryTrace() : outputDirectory(".") {
     char *env = getenv("LIBCAM_OUTPUT_DIRECTORY");
@@ -103,10 +321,26 @@ public:
     // Ensure the memtrace directory exists and is empty
     if(system(("mkdir -p " + outputDirectory + "/memory_accesses").c_str())){ cerr << "mkdir memory_accesses failed\n"; abort(); }
     if(system(("rm -f " + outputDirectory + "/memory_accesses/memory_accesses.*.*.txt.bz2").c_str())) { cerr << "clean memory_accesses failed\n"; abort(); }
+    if(system(("rm -f " + outputDirectory + "/memory_accesses/repeated_invocations.txt").c_str())) { cerr << "clean memory_accesses failed\n"; abort(); }
+    if(system(("rm -f " + outputDirectory + "/memory_accesses/" ACCESS_SUMMARY_FILE).c_str())) { cerr << "clean memory_accesses failed\n"; abort(); }
+    if(system(("rm -f " + outputDirectory + "/memory_accesses/outside_instances*.txt").c_str())) { cerr << "clean memory_accesses failed\n"; abort(); }
   }
   ~TracerMemoryTrace();
+  void dumpRecord(uintptr_t id, TracerStaticInstRec *rec);
   void dumpMemoryTrace(void);
   void clear();
+
+  /* Write out the summaries of the accesses of each instruction, see AccessSummary.h */
+  void dumpSummaries(void);
+
+  /* Write out the instances made outside the loops of each level */
+  void dumpOutsideInstances(void);
+
+  /* A new record of an instruction carries on numbering the instances of an evicted one */
+  void restoreInstanceCounts(uintptr_t id, TracerStaticInstRec *rec);
+
+  /* Write out and free the records of the coldest and largest instructions until memory usage is at most target */
+  void evictRecords(JITUINT64 target);
   string getOutputDirectory(){ return outputDirectory; }
 };
 
@@ -114,6 +348,7 @@ public:
 class MemTraceMemory : public CamMemoryAllocator
 {
   JITUINT64 dumpTraceMemUsage;   /**< Memory size trigger for dumping the trace. */
+  JITUINT64 evictTraceMemUsage;  /**< Memory size the trace is brought down to by a dump. */
 
 public:
   MemTraceMemory()
@@ -123,6 +358,16 @@ public:
     if (env) {
       dumpTraceMemUsage = atoi(env);
     }
+    JITUINT64 lowWatermark = LIBCAM_DEFAULT_LOW_WATERMARK;
+    env = getenv("LIBCAM_MEM_TRACE_LOW_WATERMARK");
+    if (env) {
+      lowWatermark = atoi(env);
+      if (lowWatermark > 100) {
+        cerr << "LIBCAM_MEM_TRACE_LOW_WATERMARK must be a percentage\n";
+        abort();
+      }
+    }
+    evictTraceMemUsage = dumpTraceMemUsage / 100 * lowWatermark;
   }
 
   void checkDumpTrace(void);
@@ -133,54 +378,468 @@ static TracerMemoryTrace *memoryTrace = NULL;
 static MemTraceMemory *memoryAllocator = NULL;
 static TimeoutCounter *timeoutCounter = NULL;
 
+/**
+ * State of the iteration tagging mode, enabled by setting the environment
+ * variable LIBCAM_MEM_TRACE_ITERATION_TAGS.  Invocations of all loops are
+ * numbered from 0 in the order they start.  Only outermost loops are
+ * followed, loops nested inside them are part of their iterations.
+ **/
+static bool tagIterations = false;
+static bool loopRunning = false;
+static uint64_t loopDepth = 0;
+static uint64_t numLoopInvocations = 0;
+static uint64_t currIteration = 0;
+
+/**
+ * The loop trace of nesting level N only counts the instances made inside
+ * loops at depth N, so for each of the LIBCAM_LOOP_TRACE_LEVELS levels the
+ * ranges of instances of each trace made outside them, (first, count), are
+ * written to memory_accesses/outside_instances[.levelN].txt for cam to skip.
+ **/
+static uint64_t numLoopLevels = 1;
+static vector<map<pair<inst_id_t, bool>, vector<pair<uint64_t, uint64_t>>>> outsideInstances;
+
+/**
+ * Number of memory references recorded, used as the clock for deciding which
+ * instruction records are cold.
+ **/
+static uint64_t numRecordedReferences = 0;
+
+/**
+ * State of the invocation deduplication mode, enabled by setting the
+ * environment variable LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS.  The accesses of
+ * each outermost invocation, relative to its first address, are hashed
+ * along with their iterations and the calls made.  An invocation with the
+ * fingerprint of an earlier one is recorded as a reference to it, and listed
+ * in memory_accesses/repeated_invocations.txt so cam can skip its analysis,
+ * if all the outermost invocations are of one loop so that the loop trace
+ * numbers them in the same way.
+ **/
+static bool dedupInvocations = false;
+static uint64_t maxDedupTemplates = LIBCAM_DEDUP_TEMPLATES;
+static uint64_t invocationHash = 0;
+static uint64_t invocationAccesses = 0;
+static uintptr_t invocationBase = 0;
+static bool invocationDumped = false;
+static vector<TracerMemSet *> invocationSets;
+/* An invocation kept for later invocations to refer to, and its entries relative to its base */
+struct InvocationTemplate {
+  uint64_t invocation;
+  uintptr_t base;
+  vector<uint64_t> shape;
+};
+static map<pair<uint64_t, uint64_t>, InvocationTemplate> invocationTemplates;
+static vector<pair<uint64_t, uint64_t>> repeatedInvocations;
+static JITNINT dedupLoopID = 0;
+static bool dedupSingleLoop = true;
+
 void
 TracerMemSetEntry::init(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e)
 {
   base = b; stride = s; length = l; start = st; end = e;
+  rowStride = 0; rowLength = 0; kind = PATTERN_ENTRY;
 }
 
 uintptr_t TracerMemSetEntry::prediction(){
-  return base + stride*getNumInstances();
+  return getAccess(getNumInstances());
+}
+
+uintptr_t TracerMemSetEntry::getAccess(uint64_t n){
+  if(rowLength == 0)
+    return base + stride*n;
+  else
+    return base + rowStride*(n/rowLength) + stride*(n%rowLength);
 }
 
+bool TracerMemSetEntry::isNested() const { return rowLength != 0; }
+bool TracerMemSetEntry::isDeltaRun() const { return kind == DELTA_ENTRY; }
+bool TracerMemSetEntry::isTagged() const { return kind == TAGGED_ENTRY; }
+bool TracerMemSetEntry::isReference() const { return kind == REFERENCE_ENTRY; }
+bool TracerMemSetEntry::isTemplate() const { return kind == TEMPLATE_ENTRY; }
+void TracerMemSetEntry::setKind(TracerEntryKind x) { kind = x; }
+
 uintptr_t TracerMemSetEntry::getBase() const { return base; }
 intptr_t TracerMemSetEntry::getStride() const { return stride; }
 uintptr_t TracerMemSetEntry::getLength() const { return length; }
 uintptr_t TracerMemSetEntry::getStart() const { return start; }
 uintptr_t TracerMemSetEntry::getEnd() const {return end; }
+intptr_t TracerMemSetEntry::getRowStride() const { return rowStride; }
+uint64_t TracerMemSetEntry::getRowLength() const { return rowLength; }
 void TracerMemSetEntry::setBase(uintptr_t x) { base = x; }
 void TracerMemSetEntry::setStride(intptr_t x) { stride = x; }
 void TracerMemSetEntry::setLength(uint64_t x) { length = x; }
 void TracerMemSetEntry::setStart(uint64_t x) { start = x; }
 void TracerMemSetEntry::setEnd(uint64_t x) { end = x; }
+void TracerMemSetEntry::setRowStride(intptr_t x) { rowStride = x; }
+void TracerMemSetEntry::setRowLength(uint64_t x) { rowLength = x; }
 
 uintptr_t TracerMemSetEntry::getNumInstances(){
   return end - start + 1;
 }
 void TracerMemSetEntry::incEnd() { end++; }
 
+void TracerDeltaEntry::initDeltas(uintptr_t b, uint64_t l, uint64_t st){
+  init(b, 0, l, st, st);
+  setKind(DELTA_ENTRY);
+  deltas = (uint8_t *)memoryAllocator->allocMem(LIBCAM_DELTA_BUFFER_SIZE);
+  size = 0;
+  capacity = LIBCAM_DELTA_BUFFER_SIZE;
+  lastAddr = b;
+  lastDelta = 0;
+  equalDeltas = 0;
+  equalDeltasOffset = 0;
+}
+
+void TracerDeltaEntry::freeDeltas(){
+  memoryAllocator->freeMem(deltas);
+  deltas = NULL;
+}
+
+void TracerDeltaEntry::appendDeltas(vector<uint64_t> &shape){
+  shape.push_back(size);
+  for(uint32_t i = 0; i < size; i += 8){
+    uint64_t word = 0;
+    memcpy(&word, deltas + i, min<uint32_t>(8, size - i));
+    shape.push_back(word);
+  }
+}
+
+void TracerDeltaEntry::append(uintptr_t addr){
+  intptr_t delta = addr - lastAddr;
+  if(equalDeltas > 0 && delta == lastDelta)
+    equalDeltas++;
+  else {
+    lastDelta = delta;
+    equalDeltas = 1;
+    equalDeltasOffset = size;
+  }
+  /* A 64 bit value never takes more than 10 bytes */
+  if(size + 10 > capacity){
+    uint8_t *grown = (uint8_t *)memoryAllocator->allocMem(capacity * 2);
+    memcpy(grown, deltas, size);
+    memoryAllocator->freeMem(deltas);
+    deltas = grown;
+    capacity *= 2;
+  }
+  uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  while(zigzag >= 0x80){
+    deltas[size++] = (uint8_t)(zigzag | 0x80);
+    zigzag >>= 7;
+  }
+  deltas[size++] = (uint8_t)zigzag;
+  lastAddr = addr;
+  incEnd();
+}
+
+bool TracerDeltaEntry::isStable() const { return equalDeltas >= LIBCAM_STABLE_DELTA_THRESHOLD; }
+intptr_t TracerDeltaEntry::getLastDelta() const { return lastDelta; }
+uint32_t TracerDeltaEntry::getNumEqualDeltas() const { return equalDeltas; }
+
+uintptr_t TracerDeltaEntry::removeStableRun(){
+  uintptr_t first = lastAddr - (equalDeltas - 1)*lastDelta;
+  size = equalDeltasOffset;
+  setEnd(getEnd() - equalDeltas);
+  lastAddr = first - lastDelta;
+  equalDeltas = 0;
+  return first;
+}
+
+void TracerTaggedEntry::initTags(uintptr_t b, uint64_t l, uint64_t st){
+  init(b, 0, l, st, st);
+  setKind(TAGGED_ENTRY);
+  inLoop = loopRunning;
+  invocation = numLoopInvocations - 1;
+  firstIteration = currIteration;
+  lastIteration = currIteration;
+  perIteration = 0;
+}
+
+uint64_t TracerTaggedEntry::getInstancesInLastIteration(){
+  return getNumInstances() - (lastIteration - firstIteration)*perIteration;
+}
+
+bool TracerTaggedEntry::canExtend(){
+  if(inLoop != loopRunning)
+    return false;
+  if(!inLoop)
+    return true;
+  if(invocation != numLoopInvocations - 1)
+    return false;
+  /* Within the first iteration anything goes, after that every iteration must match the first */
+  if(currIteration == lastIteration)
+    return lastIteration == firstIteration || getInstancesInLastIteration() < perIteration;
+  if(currIteration == lastIteration + 1)
+    return lastIteration == firstIteration || getInstancesInLastIteration() == perIteration;
+  return false;
+}
+
+void TracerTaggedEntry::extend(){
+  if(inLoop && currIteration != lastIteration){
+    if(lastIteration == firstIteration)
+      perIteration = getNumInstances();
+    lastIteration = currIteration;
+  }
+  incEnd();
+}
+
+uint64_t TracerTaggedEntry::removePartialIteration(){
+  if(lastIteration == firstIteration || getInstancesInLastIteration() == perIteration)
+    return 0;
+  uint64_t partial = getInstancesInLastIteration();
+  setEnd(getEnd() - partial);
+  lastIteration--;
+  return partial;
+}
+
+void TracerTaggedEntry::copyTags(TracerTaggedEntry *other, uint64_t iteration){
+  inLoop = other->inLoop;
+  invocation = other->invocation;
+  firstIteration = iteration;
+  lastIteration = iteration;
+}
+
+bool TracerTaggedEntry::isInLoop() const { return inLoop; }
+uint64_t TracerTaggedEntry::getLastIteration() const { return lastIteration; }
+uint64_t TracerTaggedEntry::getIterationSpan() const { return lastIteration - firstIteration + 1; }
+
+void TracerTaggedEntry::dumpTags(char *buf){
+  snprintf(buf, DIM_BUF, " %" PRIu64 " %" PRIu64 " %" PRIu64 ",", invocation, firstIteration, getIterationSpan());
+}
+
+void TracerReferenceEntry::initReference(uintptr_t b, uint64_t st, uint64_t e, uint64_t inv, intptr_t off){
+  init(b, 0, 0, st, e);
+  setKind(REFERENCE_ENTRY);
+  invocation = inv;
+  offset = off;
+}
+
+void TracerReferenceEntry::dumpReference(char *buf){
+  snprintf(buf, DIM_BUF, "r %" PRIu64 " %" PRIdPTR " %" PRIu64 ",", invocation, offset, getNumInstances());
+}
+
+void TracerTemplateEntry::initTemplate(uintptr_t b, uint64_t st, uint64_t e, uint64_t inv){
+  init(b, 0, 0, st, e);
+  setKind(TEMPLATE_ENTRY);
+  invocation = inv;
+}
+
+void TracerTemplateEntry::dumpTemplate(char *buf){
+  snprintf(buf, DIM_BUF, "i %" PRIu64 " %" PRIu64 ",", invocation, getNumInstances());
+}
+
 TracerMemSet::~TracerMemSet(){
   for(TracerMemSet::const_iterator i = begin(); i != end(); i++) {
-    memoryAllocator->deleteMem(*i);
+    deleteEntry(*i);
   }
   erase(begin(), end());
 }
 
+void TracerMemSet::deleteEntry(TracerMemSetEntry *entry){
+  if(entry->isDeltaRun()){
+    TracerDeltaEntry *run = static_cast<TracerDeltaEntry *>(entry);
+    run->freeDeltas();
+    memoryAllocator->deleteMem(run);
+  }
+  else if(entry->isTagged())
+    memoryAllocator->deleteMem(static_cast<TracerTaggedEntry *>(entry));
+  else if(entry->isReference())
+    memoryAllocator->deleteMem(static_cast<TracerReferenceEntry *>(entry));
+  else if(entry->isTemplate())
+    memoryAllocator->deleteMem(static_cast<TracerTemplateEntry *>(entry));
+  else
+    memoryAllocator->deleteMem(entry);
+}
+
 void TracerMemSet::newMemSetEntry(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e){
     TracerMemSetEntry *entry = memoryAllocator->newMem<TracerMemSetEntry>();
     entry->init(b, s, l, st, e);
     push_back(entry);
 }
 
+void TracerMemSet::closeLastEntry(){
+  TracerMemSetEntry *last = back();
+  if (last->isDeltaRun() || last->isReference()) {
+    return;
+  }
+  if (last->isTagged()) {
+    /* Tagged patterns only ever hold complete iterations, move a partial last iteration into its own entry */
+    TracerTaggedEntry *tagged = static_cast<TracerTaggedEntry *>(last);
+    uint64_t partial = tagged->removePartialIteration();
+    if (partial > 0) {
+      TracerTaggedEntry *entry = memoryAllocator->newMem<TracerTaggedEntry>();
+      entry->initTags(tagged->getAccess(tagged->getNumInstances()), tagged->getLength(), tagged->getEnd() + 1);
+      entry->setStride(tagged->getStride());
+      entry->setEnd(tagged->getEnd() + partial);
+      entry->copyTags(tagged, tagged->getLastIteration() + 1);
+      push_back(entry);
+    }
+    return;
+  }
+  if (last->isNested()) {
+    /* Nested patterns only ever hold complete rows, move a partially matched row into its own entry */
+    uint64_t partialRow = last->getNumInstances() % last->getRowLength();
+    if (partialRow > 0) {
+      uint64_t firstPartial = last->getNumInstances() - partialRow;
+      last->setEnd(last->getEnd() - partialRow);
+      newMemSetEntry(last->getAccess(firstPartial), last->getStride(), last->getLength(), last->getEnd() + 1, last->getEnd() + partialRow);
+    }
+    return;
+  }
+  /* Entries of different invocations are never merged */
+  if (size() < invocationFirstEntry + 2) {
+    return;
+  }
+  TracerMemSetEntry *prev = (*this)[size() - 2];
+  if (!prev->isNested() && !prev->isDeltaRun() && last->getNumInstances() > 1 &&
+      prev->getLength() == last->getLength() &&
+      prev->getStride() == last->getStride() &&
+      prev->getNumInstances() == last->getNumInstances()) {
+    /* Two identical rows, turn prev into a nested pattern and drop last */
+    prev->setRowStride(last->getBase() - prev->getBase());
+    prev->setRowLength(prev->getNumInstances());
+    prev->setEnd(last->getEnd());
+    memoryAllocator->deleteMem(last);
+    pop_back();
+  }
+}
+
+bool TracerMemSet::isIrregular(uint64_t l){
+  if (size() < invocationFirstEntry + LIBCAM_IRREGULAR_PATTERN_THRESHOLD) {
+    return false;
+  }
+  for(size_t i = size() - LIBCAM_IRREGULAR_PATTERN_THRESHOLD; i < size(); i++){
+    TracerMemSetEntry *entry = (*this)[i];
+    if(entry->isDeltaRun() || entry->isNested() || entry->getNumInstances() > 2 || entry->getLength() != l)
+      return false;
+  }
+  return true;
+}
+
+void TracerMemSet::startDeltaRun(uintptr_t addr, uint64_t l){
+  size_t first = size() - LIBCAM_IRREGULAR_PATTERN_THRESHOLD;
+  TracerDeltaEntry *run = memoryAllocator->newMem<TracerDeltaEntry>();
+  run->initDeltas((*this)[first]->getBase(), l, (*this)[first]->getStart());
+  for(size_t i = first; i < size(); i++){
+    TracerMemSetEntry *entry = (*this)[i];
+    for(uint64_t n = (i == first ? 1 : 0); n < entry->getNumInstances(); n++)
+      run->append(entry->getAccess(n));
+    deleteEntry(entry);
+  }
+  resize(first);
+  push_back(run);
+  run->append(addr);
+}
+
+void TracerMemSet::recordTaggedMemoryReference(uintptr_t addr, uint64_t len){
+  uint64_t next = 0;
+  if (!empty()) {
+    TracerTaggedEntry *prev = static_cast<TracerTaggedEntry *>(back());
+    if (prev->getLength() == len && prev->canExtend()) {
+      if (prev->getStart() == prev->getEnd()) {
+        prev->setStride(addr - prev->getBase());
+        prev->extend();
+        return;
+      }
+      if (prev->prediction() == addr) {
+        prev->extend();
+        return;
+      }
+    }
+    closeLastEntry();
+    next = back()->getEnd() + 1;
+  }
+  TracerTaggedEntry *entry = memoryAllocator->newMem<TracerTaggedEntry>();
+  entry->initTags(addr, len, next);
+  push_back(entry);
+}
+
+void TracerMemSet::startInvocation(uint64_t inv){
+  if (!empty()) {
+    closeLastEntry();
+    breakPattern = true;
+  }
+  invocation = inv;
+  invocationFirstEntry = size();
+  invocationFirstInstance = empty() ? 0 : back()->getEnd() + 1;
+  if (inv != 0)
+    invocationSets.push_back(this);
+}
+
+void TracerMemSet::replaceInvocation(uint64_t inv, intptr_t offset){
+  closeLastEntry();
+  uint64_t end = back()->getEnd();
+  uintptr_t lastBase = back()->getBase();
+  for(size_t i = invocationFirstEntry; i < size(); i++)
+    deleteEntry((*this)[i]);
+  resize(invocationFirstEntry);
+  TracerReferenceEntry *ref = memoryAllocator->newMem<TracerReferenceEntry>();
+  ref->initReference(lastBase, invocationFirstInstance, end, inv, offset - lastReferenceOffset);
+  push_back(ref);
+  lastReferenceOffset = offset;
+}
+
+void TracerMemSetEntry::appendShape(uintptr_t b, vector<uint64_t> &shape){
+  shape.push_back(kind);
+  shape.push_back(base - b);
+  shape.push_back(stride);
+  shape.push_back(length);
+  shape.push_back(getNumInstances());
+  shape.push_back(rowStride);
+  shape.push_back(rowLength);
+  if(isDeltaRun())
+    static_cast<TracerDeltaEntry *>(this)->appendDeltas(shape);
+}
+
+void TracerMemSet::appendInvocationShape(uintptr_t b, vector<uint64_t> &shape){
+  shape.push_back(owner);
+  shape.push_back(size() - invocationFirstEntry);
+  for(size_t i = invocationFirstEntry; i < size(); i++)
+    (*this)[i]->appendShape(b, shape);
+}
+
+void TracerMemSet::markInvocation(uint64_t inv){
+  TracerTemplateEntry *marker = memoryAllocator->newMem<TracerTemplateEntry>();
+  marker->initTemplate(invocationFirstEntry > 0 ? (*this)[invocationFirstEntry - 1]->getBase() : 0, invocationFirstInstance, back()->getEnd(), inv);
+  insert(begin() + invocationFirstEntry, marker);
+  invocationFirstEntry++;
+}
+
 void TracerMemSet::recordMemoryReference(uintptr_t addr, uint64_t len){
+  if (tagIterations) {
+    recordTaggedMemoryReference(addr, len);
+    return;
+  }
+  if (dedupInvocations) {
+    uint64_t inv = loopRunning ? numLoopInvocations : 0;
+    if (inv != invocation)
+      startInvocation(inv);
+    if (breakPattern) {
+      breakPattern = false;
+      newMemSetEntry(addr, 0, len, back()->getEnd() + 1, back()->getEnd() + 1);
+      return;
+    }
+  }
   if (size() == 0) {
     newMemSetEntry(addr, 0, len, 0, 0);
   } else {
     TracerMemSetEntry *prev = back();
     if (prev->getLength() != len) {
       /* Data widths do not match, a new pattern must be started */
+      closeLastEntry();
+      prev = back();
       newMemSetEntry(addr, 0, len, prev->getEnd() + 1, prev->getEnd() + 1);
     }
+    else if(prev->isDeltaRun()){
+      /* Irregular accesses are appended to the run until the deltas settle into a stride */
+      TracerDeltaEntry *run = static_cast<TracerDeltaEntry *>(prev);
+      run->append(addr);
+      if(run->isStable()){
+        intptr_t stride = run->getLastDelta();
+        uint64_t count = run->getNumEqualDeltas();
+        uintptr_t first = run->removeStableRun();
+        newMemSetEntry(first, stride, len, run->getEnd() + 1, run->getEnd() + count);
+      }
+    }
     else if(prev->getStart() == prev->getEnd()){
       /* prev is the first entry for this pattern, establish the stride */
       prev->setStride(addr - prev->getBase());
@@ -191,7 +850,15 @@ void TracerMemSet::recordMemoryReference(uintptr_t addr, uint64_t len){
       if(prev->prediction() == addr)
         prev->incEnd();
       else {
-        newMemSetEntry(addr, 0, len, prev->getEnd() + 1, prev->getEnd() + 1);
+        /* The row just ended may start or continue a nested pattern */
+        closeLastEntry();
+        prev = back();
+        if(prev->isNested() && prev->prediction() == addr)
+          prev->incEnd();
+        else if(isIrregular(len))
+          startDeltaRun(addr, len);
+        else
+          newMemSetEntry(addr, 0, len, prev->getEnd() + 1, prev->getEnd() + 1);
       }
     }
   }
@@ -200,6 +867,38 @@ void TracerMemSet::recordMemoryReference(uintptr_t addr, uint64_t len){
 TracerMemSet &TracerStaticInstRec::getReadSet() { return readSet; }
 TracerMemSet &TracerStaticInstRec::getWriteSet() { return writeSet; }
 
+size_t
+TracerMemSetEntry::getMemUsage()
+{
+  switch (kind) {
+    case DELTA_ENTRY:
+      return sizeof(TracerDeltaEntry) + static_cast<TracerDeltaEntry *>(this)->getCapacity();
+    case TAGGED_ENTRY:
+      return sizeof(TracerTaggedEntry);
+    case REFERENCE_ENTRY:
+      return sizeof(TracerReferenceEntry);
+    case TEMPLATE_ENTRY:
+      return sizeof(TracerTemplateEntry);
+    default:
+      return sizeof(TracerMemSetEntry);
+  }
+}
+
+size_t
+TracerMemSet::getMemUsage()
+{
+  size_t usage = capacity() * sizeof(TracerMemSetEntry *);
+  for(const_iterator i = begin(); i != end(); i++)
+    usage += (*i)->getMemUsage();
+  return usage;
+}
+
+size_t
+TracerStaticInstRec::getMemUsage()
+{
+  return sizeof(TracerStaticInstRec) + readSet.getMemUsage() + writeSet.getMemUsage();
+}
+
 
 TracerMemoryTrace::~TracerMemoryTrace()
 {
@@ -213,6 +912,10 @@ TracerMemoryTrace::clear(void)
     memoryAllocator->deleteMem(i->second);
   }
   erase(begin(), end());
+
+  /* The entries of the current invocation are gone, it can not be deduplicated */
+  invocationSets.clear();
+  invocationDumped = true;
 }
 
 
@@ -220,7 +923,27 @@ void
 TracerMemSetEntry::dumpInitialEntry(BZFILE *compressedFile)
 {
   char buf[DIM_BUF];
-  snprintf(buf, DIM_BUF, "%" PRIuPTR " %" PRIdPTR " %" PRIu64 " %" PRIu64 ",", base, stride, length, end - start + 1);
+  if(isReference() || isTemplate()){
+    dumpDedupEntry(compressedFile);
+    return;
+  }
+  if(isDeltaRun()){
+    snprintf(buf, DIM_BUF, "d %" PRIuPTR " %" PRIu32 " %" PRIu64, base, length, end - start + 1);
+    writeCompressedFile(compressedFile, buf);
+    static_cast<TracerDeltaEntry *>(this)->dumpDeltas(compressedFile);
+    return;
+  }
+  if(isTagged() && static_cast<TracerTaggedEntry *>(this)->isInLoop()){
+    snprintf(buf, DIM_BUF, "t %" PRIuPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64, base, stride, length, end - start + 1);
+    writeCompressedFile(compressedFile, buf);
+    static_cast<TracerTaggedEntry *>(this)->dumpTags(buf);
+    writeCompressedFile(compressedFile, buf);
+    return;
+  }
+  if(isNested())
+    snprintf(buf, DIM_BUF, "n %" PRIuPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64 " %" PRIdPTR " %" PRIu64 ",", base, stride, length, end - start + 1, rowStride, rowLength);
+  else
+    snprintf(buf, DIM_BUF, "%" PRIuPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64 ",", base, stride, length, end - start + 1);
   writeCompressedFile(compressedFile, buf);
 }
 
@@ -228,7 +951,62 @@ void
 TracerMemSetEntry::dumpEntry(BZFILE *compressedFile, TracerMemSetEntry* prev)
 {
   char buf[DIM_BUF];
-  snprintf(buf, DIM_BUF, "%" PRIdPTR " %" PRIdPTR " %" PRIu64 " %" PRIu64 ",", (intptr_t)(base) - (intptr_t)(prev->base), stride, length, end - start + 1);
+  if(isReference() || isTemplate()){
+    dumpDedupEntry(compressedFile);
+    return;
+  }
+  if(isDeltaRun()){
+    snprintf(buf, DIM_BUF, "d %" PRIdPTR " %" PRIu32 " %" PRIu64, (intptr_t)(base) - (intptr_t)(prev->base), length, end - start + 1);
+    writeCompressedFile(compressedFile, buf);
+    static_cast<TracerDeltaEntry *>(this)->dumpDeltas(compressedFile);
+    return;
+  }
+  if(isTagged() && static_cast<TracerTaggedEntry *>(this)->isInLoop()){
+    snprintf(buf, DIM_BUF, "t %" PRIdPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64, (intptr_t)(base) - (intptr_t)(prev->base), stride, length, end - start + 1);
+    writeCompressedFile(compressedFile, buf);
+    static_cast<TracerTaggedEntry *>(this)->dumpTags(buf);
+    writeCompressedFile(compressedFile, buf);
+    return;
+  }
+  if(isNested())
+    snprintf(buf, DIM_BUF, "n %" PRIdPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64 " %" PRIdPTR " %" PRIu64 ",", (intptr_t)(base) - (intptr_t)(prev->base), stride, length, end - start + 1, rowStride, rowLength);
+  else
+    snprintf(buf, DIM_BUF, "%" PRIdPTR " %" PRIdPTR " %" PRIu32 " %" PRIu64 ",", (intptr_t)(base) - (intptr_t)(prev->base), stride, length, end - start + 1);
+  writeCompressedFile(compressedFile, buf);
+}
+
+void
+TracerMemSetEntry::dumpDedupEntry(BZFILE *compressedFile)
+{
+  char buf[DIM_BUF];
+  if(isReference())
+    static_cast<TracerReferenceEntry *>(this)->dumpReference(buf);
+  else
+    static_cast<TracerTemplateEntry *>(this)->dumpTemplate(buf);
+  writeCompressedFile(compressedFile, buf);
+}
+
+void
+TracerDeltaEntry::dumpDeltas(BZFILE *compressedFile)
+{
+  char buf[DIM_BUF];
+  int pos = 0;
+  uint32_t i = 0;
+  while(i < size){
+    uint64_t zigzag = 0;
+    int shift = 0;
+    do {
+      zigzag |= (uint64_t)(deltas[i] & 0x7f) << shift;
+      shift += 7;
+    } while(deltas[i++] & 0x80);
+    intptr_t delta = (intptr_t)((zigzag >> 1) ^ -(zigzag & 1));
+    pos += snprintf(buf + pos, DIM_BUF - pos, " %" PRIdPTR, delta);
+    if(pos > DIM_BUF - 32){
+      writeCompressedFile(compressedFile, buf);
+      pos = 0;
+    }
+  }
+  snprintf(buf + pos, DIM_BUF - pos, ",");
   writeCompressedFile(compressedFile, buf);
 }
 
@@ -237,6 +1015,8 @@ void
 TracerMemSet::dumpSet(BZFILE *compressedFile)
 {
   char buf[DIM_BUF];
+  if(!empty())
+    closeLastEntry();
   snprintf(buf, DIM_BUF, "%zu ", size());
   writeCompressedFile(compressedFile, buf);
   if(!empty()){
@@ -300,38 +1080,125 @@ void closeCompressedStream(pair<FILE *, BZFILE *> stream){
 }
 
 void
-TracerMemoryTrace::dumpMemoryTrace(void)
+TracerMemoryTrace::dumpRecord(uintptr_t id, TracerStaticInstRec *rec)
 {
   char buf[DIM_BUF];
 
+  /* The summaries and instance counts outlive the record */
+  pair<AccessSummary, AccessSummary> &summary = summaries[id];
+  summary.first.merge(rec->getReadSummary());
+  summary.second.merge(rec->getWriteSummary());
+  instanceCounts[id] = pair<uint64_t, uint64_t>(rec->getNumReads(), rec->getNumWrites());
+
+  /* Dump read trace */
+  if(rec->getReadSet().size() > 0){
+    pair<FILE *, BZFILE*> stream = openCompressedStream(
+      outputDirectory + "/memory_accesses/memory_accesses." + to_string(id) + ".r.txt.bz2");
+    /* Write compressed data */
+    snprintf(buf, DIM_BUF, "%" PRIuPTR "\n", id);
+    writeCompressedFile(stream.second, buf);
+    rec->dumpReadSet(stream.second);
+    snprintf(buf, DIM_BUF, "0\n");
+    writeCompressedFile(stream.second, buf);
+    closeCompressedStream(stream);
+  }
+  /* Dump write trace */
+  if(rec->getWriteSet().size() > 0){
+    pair<FILE *, BZFILE*> stream = openCompressedStream(
+      outputDirectory + "/memory_accesses/memory_accesses." + to_string(id) + ".w.txt.bz2");
+    /* Write compressed data */
+    snprintf(buf, DIM_BUF, "%" PRIuPTR "\n", id);
+    writeCompressedFile(stream.second, buf);
+    snprintf(buf, DIM_BUF, "0\n");
+    writeCompressedFile(stream.second, buf);
+    rec->dumpWriteSet(stream.second);
+    closeCompressedStream(stream);
+  }
+}
+
+void
+TracerMemoryTrace::dumpMemoryTrace(void)
+{
   /* Dump the trace. */
   for(TracerMemoryTrace::const_iterator i = begin(); i != end(); i++) {
-    
-    /* Dump read trace */
-    if(i->second->getReadSet().size() > 0){
-      pair<FILE *, BZFILE*> stream = openCompressedStream(
-        outputDirectory + "/memory_accesses/memory_accesses." + to_string(i->first) + ".r.txt.bz2");
-      /* Write compressed data */
-      snprintf(buf, DIM_BUF, "%" PRIuPTR "\n", i->first);
-      writeCompressedFile(stream.second, buf);
-      i->second->dumpReadSet(stream.second);
-      snprintf(buf, DIM_BUF, "0\n");
-      writeCompressedFile(stream.second, buf);
-      closeCompressedStream(stream);
+    dumpRecord(i->first, i->second);
+  }
+}
+
+void
+TracerMemoryTrace::dumpSummaries(void)
+{
+  FILE *f = fopen((outputDirectory + "/memory_accesses/" ACCESS_SUMMARY_FILE).c_str(), "w");
+  if (!f) {
+    cerr << "Could not open " ACCESS_SUMMARY_FILE "\n";
+    abort();
+  }
+  for(auto i = summaries.begin(); i != summaries.end(); i++) {
+    for(int write = 0; write < 2; write++) {
+      AccessSummary &summary = write ? i->second.second : i->second.first;
+      if(summary.empty())
+        continue;
+      fprintf(f, "%" PRIuPTR " %c %" PRIuPTR " %" PRIuPTR, i->first, write ? 'w' : 'r', summary.lowest, summary.highest);
+      for(int w = 0; w < ACCESS_SUMMARY_WORDS; w++)
+        fprintf(f, " %" PRIx64, summary.pages[w]);
+      fprintf(f, "\n");
     }
-    /* Dump write trace */
-    if(i->second->getWriteSet().size() > 0){
-      pair<FILE *, BZFILE*> stream = openCompressedStream(
-        outputDirectory + "/memory_accesses/memory_accesses." + to_string(i->first) + ".w.txt.bz2");
-      /* Write compressed data */
-      snprintf(buf, DIM_BUF, "%" PRIuPTR "\n", i->first);
-      writeCompressedFile(stream.second, buf);
-      snprintf(buf, DIM_BUF, "0\n");
-      writeCompressedFile(stream.second, buf);
-      i->second->dumpWriteSet(stream.second);
-      closeCompressedStream(stream);
+  }
+  fclose(f);
+}
+
+void
+TracerMemoryTrace::dumpOutsideInstances(void)
+{
+  for(uint64_t level = 0; level < outsideInstances.size(); level++) {
+    if(outsideInstances[level].empty())
+      continue;
+    string suffix = level == 0 ? "" : ".level" + to_string(level);
+    ofstream outputFile((outputDirectory + "/memory_accesses/outside_instances" + suffix + ".txt").c_str());
+    for(auto i = outsideInstances[level].begin(); i != outsideInstances[level].end(); i++) {
+      outputFile << i->first.first << " " << (i->first.second ? 'w' : 'r');
+      for(auto range = i->second.begin(); range != i->second.end(); range++)
+        outputFile << " " << range->first << " " << range->second;
+      outputFile << "\n";
     }
+    outputFile.close();
+  }
+}
+
+void
+TracerMemoryTrace::restoreInstanceCounts(uintptr_t id, TracerStaticInstRec *rec)
+{
+  auto counts = instanceCounts.find(id);
+  if(counts != instanceCounts.end()) {
+    rec->getNumReads() = counts->second.first;
+    rec->getNumWrites() = counts->second.second;
+  }
+}
+
+void
+TracerMemoryTrace::evictRecords(JITUINT64 target)
+{
+  /* Records are ranked by their size scaled by the time since they were last
+   * seen, so that small, well compressed, records of instructions that are
+   * still running are kept */
+  vector<pair<double, uintptr_t>> ranked;
+  ranked.reserve(size());
+  for(TracerMemoryTrace::const_iterator i = begin(); i != end(); i++) {
+    double age = numRecordedReferences - i->second->getLastActive() + 1;
+    ranked.push_back(pair<double, uintptr_t>(i->second->getMemUsage() * age, i->first));
+  }
+  sort(ranked.begin(), ranked.end(), greater<pair<double, uintptr_t>>());
+
+  for(auto i = ranked.begin(); i != ranked.end() && memoryAllocator->memUsed > target; i++) {
+    TracerMemoryTrace::iterator rec = find(i->second);
+    dumpRecord(rec->first, rec->second);
+    memoryAllocator->deleteMem(rec->second);
+    erase(rec);
   }
+
+  /* Some of the entries of the current invocation may be gone, it can not be deduplicated */
+  invocationSets.clear();
+  invocationDumped = true;
 }
 
 
@@ -341,8 +1208,7 @@ MemTraceMemory::checkDumpTrace(void)
   // static JITNINT numDumps = 0;
   if (memUsed > dumpTraceMemUsage) {
     // cerr << "Dumping memory trace " << numDumps << " with allocation of " << memUsed  << endl;
-    memoryTrace->dumpMemoryTrace();
-    memoryTrace->clear();
+    memoryTrace->evictRecords(evictTraceMemUsage);
     // numDumps += 1;
   }
 }
@@ -355,34 +1221,208 @@ CAM_forceMemTraceDump(){
 
 
 /**
- * Record an instruction accessing memory.
+ * Add a value to the fingerprint of the current invocation.
+ **/
+static inline void
+fingerprintValue(uint64_t value)
+{
+  invocationHash = (invocationHash ^ value) * 0x9e3779b97f4a7c15ULL;
+  invocationHash ^= invocationHash >> 29;
+}
+
+
+/**
+ * Add a memory reference to the fingerprint of the current invocation, with
+ * its addresses relative to the first address of the invocation.
+ **/
+static void
+fingerprintReference(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen)
+{
+  if (invocationAccesses++ == 0)
+    invocationBase = rlen1 > 0 ? raddr1 : (rlen2 > 0 ? raddr2 : waddr);
+  fingerprintValue(id);
+  fingerprintValue(currIteration);
+  fingerprintValue(rlen1 > 0 ? raddr1 - invocationBase : 0);
+  fingerprintValue(rlen1);
+  fingerprintValue(rlen2 > 0 ? raddr2 - invocationBase : 0);
+  fingerprintValue(rlen2);
+  fingerprintValue(wlen > 0 ? waddr - invocationBase : 0);
+  fingerprintValue(wlen);
+}
+
+
+/**
+ * At the end of an outermost invocation, replace its entries by a reference
+ * to an earlier invocation with the same fingerprint, or keep them for
+ * later invocations to refer to.  The entries are compared with those of the
+ * earlier invocation, so a collision of fingerprints can not lose accesses.
+ **/
+static void
+deduplicateInvocation(void)
+{
+  uint64_t inv = numLoopInvocations - 1;
+  pair<uint64_t, uint64_t> fingerprint(invocationHash, invocationAccesses);
+  if (!invocationDumped && !invocationSets.empty()) {
+    auto match = invocationTemplates.find(fingerprint);
+    vector<uint64_t> shape;
+    if (match != invocationTemplates.end() || invocationTemplates.size() < maxDedupTemplates) {
+      for (auto i = invocationSets.begin(); i != invocationSets.end(); i++)
+        (*i)->appendInvocationShape(invocationBase, shape);
+    }
+    if (match != invocationTemplates.end()) {
+      if (match->second.shape == shape) {
+        for (auto i = invocationSets.begin(); i != invocationSets.end(); i++)
+          (*i)->replaceInvocation(match->second.invocation, invocationBase - match->second.base);
+        repeatedInvocations.push_back(pair<uint64_t, uint64_t>(inv, match->second.invocation));
+      }
+    } else if (invocationTemplates.size() < maxDedupTemplates) {
+      InvocationTemplate &invTemplate = invocationTemplates[fingerprint];
+      invTemplate.invocation = inv;
+      invTemplate.base = invocationBase;
+      invTemplate.shape.swap(shape);
+      for (auto i = invocationSets.begin(); i != invocationSets.end(); i++)
+        (*i)->markInvocation(inv);
+    }
+  }
+  invocationSets.clear();
+}
+
+
+/**
+ * Record that instances [first, first + count) of a trace were made at the
+ * current loop depth, outside the loops of each deeper level.
+ **/
+static void
+recordOutsideInstances(inst_id_t id, bool write, uint64_t first, uint64_t count)
+{
+  for (uint64_t level = loopDepth; level < numLoopLevels; level++) {
+    vector<pair<uint64_t, uint64_t>> &ranges = outsideInstances[level][pair<inst_id_t, bool>(id, write)];
+    if (!ranges.empty() && ranges.back().first + ranges.back().second == first)
+      ranges.back().second += count;
+    else
+      ranges.push_back(pair<uint64_t, uint64_t>(first, count));
+  }
+}
+
+
+/**
+ * Record a memory reference without checking for a timeout.
  **/
 void
-CAM_mem(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen)
+memory_trace_record(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen)
 {
-  if(timeoutCounter->recordOperation())
-    return;
+  if (dedupInvocations && loopRunning)
+    fingerprintReference(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
 
-  TracerStaticInstRec *rec;
-  if (memoryTrace->find(id) == memoryTrace->end()) {
+  /* A single lookup both finds and inserts the record */
+  TracerStaticInstRec *&rec = (*memoryTrace)[id];
+  if (!rec) {
     rec = memoryAllocator->newMem<TracerStaticInstRec>();
-    (*memoryTrace)[id] = rec;
-  } else {
-    rec = (*memoryTrace)[id];
+    rec->getReadSet().setOwner(id, false);
+    rec->getWriteSet().setOwner(id, true);
+    memoryTrace->restoreInstanceCounts(id, rec);
   }
+  uint64_t numReads = (rlen1 > 0) + (rlen2 > 0);
+  if (loopDepth < numLoopLevels) {
+    if (numReads > 0)
+      recordOutsideInstances(id, false, rec->getNumReads(), numReads);
+    if (wlen > 0)
+      recordOutsideInstances(id, true, rec->getNumWrites(), 1);
+  }
+  rec->getNumReads() += numReads;
+  rec->getNumWrites() += wlen > 0;
   if(rlen1 > 0) {
     rec->getReadSet().recordMemoryReference(raddr1, rlen1);
+    rec->getReadSummary().add(raddr1, rlen1);
   }
   if(rlen2 > 0) {
     rec->getReadSet().recordMemoryReference(raddr2, rlen2);
+    rec->getReadSummary().add(raddr2, rlen2);
   }
   if(wlen > 0) {
     rec->getWriteSet().recordMemoryReference(waddr, wlen);
+    rec->getWriteSummary().add(waddr, wlen);
   }
+  rec->setLastActive(++numRecordedReferences);
   memoryAllocator->checkDumpTrace();
 }
 
 
+/**
+ * Check whether the memory tracer is initialised.
+ **/
+bool
+memory_trace_running(void)
+{
+  return memoryTrace != NULL;
+}
+
+
+/**
+ * Count an operation, returning true if the trace has timed out.
+ **/
+bool
+memory_trace_timed_out(void)
+{
+  return timeoutCounter->recordOperation();
+}
+
+
+/**
+ * Follow the loop events so that references can be tagged with iterations.
+ **/
+void
+memory_trace_loop_invocation_start(JITNINT loopID)
+{
+  if(loopDepth++ > 0)
+    return;
+  loopRunning = true;
+  numLoopInvocations++;
+  currIteration = -1;
+  if(dedupInvocations){
+    if(numLoopInvocations == 1)
+      dedupLoopID = loopID;
+    else if(loopID != dedupLoopID)
+      dedupSingleLoop = false;
+    invocationHash = 0;
+    invocationAccesses = 0;
+    invocationDumped = false;
+  }
+}
+
+void
+memory_trace_loop_invocation_end(void)
+{
+  if(--loopDepth > 0)
+    return;
+  loopRunning = false;
+  if(dedupInvocations)
+    deduplicateInvocation();
+}
+
+void
+memory_trace_loop_iteration_start(void)
+{
+  if(loopDepth > 1)
+    return;
+  currIteration++;
+}
+
+
+/**
+ * Follow the calls made, which are part of the fingerprint of an invocation
+ * as they decide which call instructions its accesses are attributed to.
+ **/
+void
+memory_trace_call_invocation_start(JITNINT instID)
+{
+  if(dedupInvocations && loopRunning){
+    fingerprintValue(~(uint64_t)0);
+    fingerprintValue(instID);
+  }
+}
+
+
 /**
  * Initialisation.
  **/
@@ -391,6 +1431,26 @@ memory_trace_init(void)
 {
   memoryAllocator = new MemTraceMemory();
   memoryTrace = memoryAllocator->newMem<TracerMemoryTrace>();
+  tagIterations = getenv("LIBCAM_MEM_TRACE_ITERATION_TAGS") != NULL;
+  dedupInvocations = getenv("LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS") != NULL;
+  if (tagIterations && dedupInvocations) {
+    cerr << "LIBCAM_MEM_TRACE_ITERATION_TAGS and LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS can not be combined\n";
+    abort();
+  }
+  char *env = getenv("LIBCAM_MEM_TRACE_DEDUP_TEMPLATES");
+  if (env) {
+    maxDedupTemplates = atoi(env);
+  }
+  env = getenv("LIBCAM_LOOP_TRACE_LEVELS");
+  if (env) {
+    numLoopLevels = atoi(env);
+  }
+  outsideInstances.clear();
+  outsideInstances.resize(numLoopLevels);
+  loopRunning = false;
+  loopDepth = 0;
+  numLoopInvocations = 0;
+  numRecordedReferences = 0;
 
   timeoutCounter = new TimeoutCounter();
 }
@@ -406,13 +1466,22 @@ memory_trace_shutdown(void)
   delete timeoutCounter;
 
   if (memoryTrace) {
+    if (dedupInvocations && dedupSingleLoop) {
+      ofstream outputFile((memoryTrace->getOutputDirectory() + "/memory_accesses/repeated_invocations.txt").c_str());
+      for (auto i = repeatedInvocations.begin(); i != repeatedInvocations.end(); i++)
+        outputFile << i->first << " " << i->second << "\n";
+      outputFile.close();
+    }
     if(memoryTrace->size() > 0) {
       memoryTrace->dumpMemoryTrace();
     } else {
       cerr << "LIBCAM: Memory tracer recorded no instructions\n";
     }
+    memoryTrace->dumpSummaries();
+    memoryTrace->dumpOutsideInstances();
     memoryAllocator->deleteMem(memoryTrace);
     delete memoryAllocator;
+    memoryTrace = NULL;
   } else {
     cerr << "LIBCAM: Attempt to shut down non-existent memory tracer\n";
   }
@@ -20,10 +20,25 @@
 #ifndef MEMORYTRACER_H
 #define MEMORYTRACER_H
 
+#include "cam.h"
+
 /* Initialisation. */
 void memory_trace_init(void);
 
 /* Shut down. */
 void memory_trace_shutdown(void);
 
+/* Used by CAM_mem and CAM_memSeenInstruction, which check the timeout before recording. */
+bool memory_trace_running(void);
+bool memory_trace_timed_out(void);
+void memory_trace_record(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen);
+
+/* Loop events, used to tag references with iterations (see LIBCAM_MEM_TRACE_ITERATION_TAGS). */
+void memory_trace_loop_invocation_start(JITNINT loopID);
+void memory_trace_loop_invocation_end(void);
+void memory_trace_loop_iteration_start(void);
+
+/* Call events, used to fingerprint invocations (see LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS). */
+void memory_trace_call_invocation_start(JITNINT instID);
+
 #endif
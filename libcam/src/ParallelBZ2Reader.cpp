@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ParallelBZ2Reader.h"
+#include "WorkerPool.h"
+#include <bzlib.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+/**
+ * Magic numbers starting a bzip2 block and ending a stream, both 48 bits.
+ **/
+#define BZ2_BLOCK_MAGIC 0x314159265359ULL
+#define BZ2_END_MAGIC 0x177245385090ULL
+#define BZ2_MAGIC_MASK 0xffffffffffffULL
+
+/**
+ * Number of blocks decoded ahead of the reader for each thread.
+ **/
+#define PARALLEL_BLOCKS_PER_THREAD 4
+
+#define NO_BLOCK UINT64_MAX
+
+
+/**
+ * Appends bits to a byte vector, most significant first as in bzip2.
+ **/
+class BitWriter{
+  vector<uint8_t>& out;
+  uint64_t acc;
+  int numBits;
+public:
+  BitWriter(vector<uint8_t>& _out) : out(_out), acc(0), numBits(0) {}
+
+  void write(uint64_t value, int n){
+    for(int i = n - 1; i >= 0; i--){
+      acc = (acc << 1) | ((value >> i) & 1);
+      if(++numBits == 8){
+        out.push_back(acc);
+        acc = 0;
+        numBits = 0;
+      }
+    }
+  }
+
+  /* Copy the bits [startBit, endBit) of src, of length size bytes */
+  void copy(const uint8_t *src, uint64_t size, uint64_t startBit, uint64_t endBit){
+    for(uint64_t bit = startBit; bit < endBit; bit += 8){
+      uint64_t byte = bit >> 3;
+      int shift = bit & 7;
+      unsigned int bits = (unsigned int)src[byte] << shift;
+      if(shift && byte + 1 < size)
+        bits |= src[byte + 1] >> (8 - shift);
+      int n = endBit - bit < 8 ? endBit - bit : 8;
+      write((bits & 0xff) >> (8 - n), n);
+    }
+  }
+
+  void flush(){
+    if(numBits > 0)
+      write(0, 8 - numBits);
+  }
+};
+
+
+ParallelBZ2Reader::ParallelBZ2Reader(const char *_filename, const char *_compressed, uint64_t _size)
+  : filename(_filename)
+  , compressed((const uint8_t *)_compressed)
+  , size(_size)
+  , scanByte(0)
+  , scanRegister(0)
+  , blockStart(NO_BLOCK)
+  , scanned(false)
+  , maxWindow(PARALLEL_BLOCKS_PER_THREAD * WorkerPool::shared().size())
+  , currentPos(0)
+{
+}
+
+ParallelBZ2Reader::~ParallelBZ2Reader(){
+  /* The blocks being decoded refer to the compressed data */
+  for(auto i = window.begin(); i != window.end(); i++)
+    WorkerPool::shared().wait((*i)->done);
+}
+
+bool ParallelBZ2Reader::findMagic(uint64_t& bit, bool& endOfStream){
+  while(scanByte < size){
+    scanRegister = (scanRegister << 8) | compressed[scanByte];
+    uint64_t byte = scanByte++;
+    if(byte < 5)
+      continue;
+    /* Try each alignment, earliest first, of a magic number ending in this byte */
+    for(int shift = 7; shift >= 0; shift--){
+      if(8*byte + 7 - shift < 47)
+        continue;
+      uint64_t candidate = (scanRegister >> shift) & BZ2_MAGIC_MASK;
+      if(candidate == BZ2_BLOCK_MAGIC || candidate == BZ2_END_MAGIC){
+        bit = 8*byte + 7 - shift - 47;
+        endOfStream = candidate == BZ2_END_MAGIC;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool ParallelBZ2Reader::nextBlock(uint64_t& startBit, uint64_t& endBit){
+  uint64_t bit;
+  bool endOfStream;
+  /* Skip the end of one stream and the header of the next */
+  while(blockStart == NO_BLOCK){
+    if(!findMagic(bit, endOfStream)){
+      scanned = true;
+      return false;
+    }
+    if(!endOfStream)
+      blockStart = bit;
+  }
+  startBit = blockStart;
+  if(findMagic(bit, endOfStream)){
+    endBit = bit;
+    blockStart = endOfStream ? NO_BLOCK : bit;
+  }
+  else {
+    /* A truncated file, this block will fail to decode */
+    endBit = 8*size;
+    blockStart = NO_BLOCK;
+  }
+  return true;
+}
+
+bool ParallelBZ2Reader::decodeBlock(const uint8_t *compressed, uint64_t size, uint64_t startBit, uint64_t endBit, string& data){
+  /* Wrap the block in a stream header and trailer. The CRC of a stream of a
+   * single block is that of the block, which follows the block magic */
+  vector<uint8_t> stream;
+  stream.reserve((endBit - startBit)/8 + 16);
+  BitWriter writer(stream);
+  writer.write('B', 8);
+  writer.write('Z', 8);
+  writer.write('h', 8);
+  writer.write('9', 8);
+  writer.copy(compressed, size, startBit, endBit);
+  writer.write(BZ2_END_MAGIC, 48);
+  writer.copy(compressed, size, startBit + 48, startBit + 80);
+  writer.flush();
+
+  bz_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  if(BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+    return false;
+  strm.next_in = (char *)&stream[0];
+  strm.avail_in = stream.size();
+  size_t produced = 0;
+  data.resize(stream.size() * 4 + 4096);
+  int status;
+  while(true){
+    strm.next_out = &data[produced];
+    strm.avail_out = data.size() - produced;
+    status = BZ2_bzDecompress(&strm);
+    produced = data.size() - strm.avail_out;
+    if(status != BZ_OK)
+      break;
+    if(strm.avail_out == 0)
+      data.resize(data.size() * 2);
+    else if(strm.avail_in == 0){
+      status = BZ_UNEXPECTED_EOF;
+      break;
+    }
+  }
+  BZ2_bzDecompressEnd(&strm);
+  data.resize(produced);
+  return status == BZ_STREAM_END;
+}
+
+void ParallelBZ2Reader::fillWindow(){
+  uint64_t startBit, endBit;
+  while(window.size() < maxWindow && !scanned && nextBlock(startBit, endBit)){
+    shared_ptr<Block> block = make_shared<Block>();
+    block->startBit = startBit;
+    block->endBit = endBit;
+    block->ok = false;
+    const uint8_t *data = compressed;
+    uint64_t dataSize = size;
+    block->done = WorkerPool::shared().submit([block, data, dataSize](){
+      block->ok = decodeBlock(data, dataSize, block->startBit, block->endBit, block->data);
+    });
+    window.push_back(block);
+  }
+}
+
+size_t ParallelBZ2Reader::read(char *out, size_t len){
+  size_t produced = 0;
+  while(produced < len){
+    if(current && currentPos < current->data.size()){
+      size_t n = min(len - produced, current->data.size() - currentPos);
+      memcpy(out + produced, current->data.data() + currentPos, n);
+      produced += n;
+      currentPos += n;
+      continue;
+    }
+    fillWindow();
+    if(window.empty())
+      break;
+    current = window.front();
+    window.pop_front();
+    currentPos = 0;
+    WorkerPool::shared().wait(current->done);
+    /* The block was split at a magic number inside compressed data, merge it with the next */
+    while(!current->ok){
+      fillWindow();
+      if(window.empty()){
+        cerr << "Error decompressing: " << filename << endl;
+        abort();
+      }
+      shared_ptr<Block> next = window.front();
+      window.pop_front();
+      WorkerPool::shared().wait(next->done);
+      current->endBit = next->endBit;
+      current->ok = decodeBlock(compressed, size, current->startBit, current->endBit, current->data);
+    }
+  }
+  return produced;
+}
+
+bool ParallelBZ2Reader::finished(){
+  return scanned && window.empty() && (!current || currentPos >= current->data.size());
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef PARALLELBZ2READER_H
+#define PARALLELBZ2READER_H
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+
+/*
+ * Decompresses a bzip2 file held in memory on the WorkerPool.  The file is
+ * split at the bzip2 block headers, which are found by their magic number at
+ * any bit offset, covering both the blocks of a stream and the streams
+ * appended by each trace dump.  Each block is decoded as a stream of its own
+ * and the output is returned in order.  A block that does not decode, because
+ * a magic number turned up inside compressed data, is merged with the next.
+ */
+class ParallelBZ2Reader{
+  struct Block{
+    uint64_t startBit;
+    uint64_t endBit;
+    std::string data;
+    bool ok;
+    std::future<void> done;
+  };
+
+  const char *filename;
+  const uint8_t *compressed;
+  uint64_t size;
+  uint64_t scanByte;        /* Next byte to search for block headers */
+  uint64_t scanRegister;    /* The last bytes searched */
+  uint64_t blockStart;      /* Start of the block being searched for the end of, or UINT64_MAX if none */
+  bool scanned;             /* All the blocks have been found */
+  std::deque<std::shared_ptr<Block> > window;
+  size_t maxWindow;
+  std::shared_ptr<Block> current;
+  size_t currentPos;
+
+  /* Find the next block header or end of stream marker, returns false at the end of the file */
+  bool findMagic(uint64_t& bit, bool& endOfStream);
+
+  /* Find the next block, returns false if there are no more */
+  bool nextBlock(uint64_t& startBit, uint64_t& endBit);
+
+  /* Queue decoding of blocks until the window is full */
+  void fillWindow();
+
+  /* Decode the bits [startBit, endBit) as a block of its own */
+  static bool decodeBlock(const uint8_t *compressed, uint64_t size, uint64_t startBit, uint64_t endBit, std::string& data);
+
+public:
+  ParallelBZ2Reader(const char *_filename, const char *_compressed, uint64_t _size);
+  ~ParallelBZ2Reader();
+
+  /* Decompress up to len bytes into out, returns the number of bytes decompressed */
+  size_t read(char *out, size_t len);
+
+  bool finished();
+};
+
+#endif
@@ -484,7 +484,7 @@ uint64_t LoopTraceEntry::getNumberOfInvocations_slow(){
  * StreamParseLoopRec
 */ 
 
-StreamParseLoopRec::StreamParseLoopRec() : loopTraceEntriesSize(0), streamer(LoopTraceStreamer()) {}
+StreamParseLoopRec::StreamParseLoopRec(unsigned int level) : loopTraceEntriesSize(0), streamer(LoopTraceStreamer(level)) {}
 
 list<LoopTraceEntry>::iterator StreamParseLoopRec::erase(list<LoopTraceEntry>::iterator iter){
   loopTraceEntriesSize--;
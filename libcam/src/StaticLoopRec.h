@@ -224,7 +224,7 @@ class StreamParseLoopRec{
   RepetitionPatternSortedLookup<list<LoopTraceEntry>::iterator> lut;
   LoopTraceStreamer streamer;
 public:
-  StreamParseLoopRec();
+  StreamParseLoopRec(unsigned int level = 0);
 
   friend ostream& operator<<(ostream& os, const StreamParseLoopRec& loops);
 
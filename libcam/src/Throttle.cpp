@@ -0,0 +1,404 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "cam.h"
+#include "Throttle.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Default number of operations per timed operation.
+ **/
+#define THROTTLE_SAMPLE_PERIOD 1024
+
+/**
+ * Number of timed operations between checks of the slowdown.
+ **/
+#define THROTTLE_SAMPLES_PER_CHECK 64
+
+/**
+ * One in this many invocations or iterations is traced when they are skipped.
+ **/
+#define THROTTLE_SKIP_FACTOR 4
+
+/**
+ * Fidelity levels, see Throttle.h.
+ **/
+#define THROTTLE_FULL 0
+#define THROTTLE_SKIP_INVOCATIONS 1
+#define THROTTLE_SKIP_ITERATIONS 2
+#define THROTTLE_DROP_INSTRUCTIONS 3
+
+
+/**
+ * A cheap timestamp, in cycles where the time stamp counter is available.
+ **/
+static inline uint64_t
+readClock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+
+class Throttle {
+  /* Configuration */
+  double budget;
+  uint64_t samplePeriod;
+  unordered_set<inst_id_t> droppedInstructions;
+  int maxLevel;
+
+  /* Sampling of the time spent in the tracers */
+  uint64_t numOperations;
+  uint64_t numSamples;
+  uint64_t sampledTime;
+  uint64_t windowStart;
+
+  /* Fidelity, changes to the level wait for the next outermost invocation or iteration */
+  int level;
+  int pendingLevel;
+  double pendingSlowdown;
+
+  /* Position in the program, and whether it is being skipped */
+  uint64_t loopDepth;
+  uint64_t iterationInInvocation;
+  bool skipInvocation;
+  bool skipIteration;
+
+  /* Coverage */
+  uint64_t numInvocations;
+  uint64_t numRecordedInvocations;
+  uint64_t numIterations;
+  uint64_t numRecordedIterations;
+  uint64_t numDroppedEvents;
+  stringstream decisions;
+  string outputDirectory;
+
+  bool skipping() { return skipInvocation || skipIteration; }
+
+  /* Apply a change of level at an outermost invocation or iteration */
+  void
+  applyPendingLevel()
+  {
+    if (pendingLevel == level)
+      return;
+    level = pendingLevel;
+    decisions << numInvocations << "," << numIterations << ","
+              << numRecordedInvocations << "," << numRecordedIterations << ","
+              << level << "," << pendingSlowdown << "\n";
+  }
+
+  /* Compare the slowdown over the last window with the budget */
+  void
+  checkSlowdown(uint64_t now)
+  {
+    uint64_t elapsed = now - windowStart;
+    uint64_t tracerTime = sampledTime * samplePeriod;
+    uint64_t applicationTime = elapsed > tracerTime ? elapsed - tracerTime : 1;
+    double slowdown = (double)elapsed / applicationTime;
+
+    /* A level is recovered once the tracing overhead is below half the budget's */
+    if (slowdown > budget && pendingLevel < maxLevel) {
+      pendingLevel++;
+      pendingSlowdown = slowdown;
+    } else if (slowdown < 1 + (budget - 1) / 2 && pendingLevel > THROTTLE_FULL) {
+      pendingLevel--;
+      pendingSlowdown = slowdown;
+    }
+    numSamples = 0;
+    sampledTime = 0;
+    windowStart = now;
+  }
+
+public:
+  Throttle(double b)
+    : budget(b), samplePeriod(THROTTLE_SAMPLE_PERIOD), maxLevel(THROTTLE_SKIP_ITERATIONS),
+      numOperations(0), numSamples(0), sampledTime(0), windowStart(readClock()),
+      level(THROTTLE_FULL), pendingLevel(THROTTLE_FULL), pendingSlowdown(0),
+      loopDepth(0), iterationInInvocation(0), skipInvocation(false), skipIteration(false),
+      numInvocations(0), numRecordedInvocations(0), numIterations(0), numRecordedIterations(0),
+      numDroppedEvents(0), outputDirectory(".")
+  {
+    char *env = getenv("LIBCAM_THROTTLE_SAMPLE_PERIOD");
+    if (env) {
+      samplePeriod = strtoull(env, NULL, 10);
+      if (samplePeriod < 1) {
+        cerr << "LIBCAM_THROTTLE_SAMPLE_PERIOD must be at least 1\n";
+        abort();
+      }
+    }
+    env = getenv("LIBCAM_THROTTLE_DROP_INSTRUCTIONS");
+    if (env) {
+      stringstream ids(env);
+      string id;
+      while (getline(ids, id, ',')) {
+        if (!id.empty())
+          droppedInstructions.insert(strtoull(id.c_str(), NULL, 10));
+      }
+    }
+    if (!droppedInstructions.empty())
+      maxLevel = THROTTLE_DROP_INSTRUCTIONS;
+    env = getenv("LIBCAM_OUTPUT_DIRECTORY");
+    if (env) {
+      outputDirectory = env;
+    }
+  }
+
+  bool
+  sampleStart(uint64_t &start)
+  {
+    if (++numOperations % samplePeriod != 0)
+      return false;
+    start = readClock();
+    return true;
+  }
+
+  void
+  sampleEnd(uint64_t start)
+  {
+    uint64_t now = readClock();
+    sampledTime += now - start;
+    if (++numSamples == THROTTLE_SAMPLES_PER_CHECK)
+      checkSlowdown(now);
+  }
+
+  bool
+  loopInvocationStart()
+  {
+    if (loopDepth++ > 0)
+      return !skipping();
+    applyPendingLevel();
+    skipInvocation = level >= THROTTLE_SKIP_INVOCATIONS && numInvocations % THROTTLE_SKIP_FACTOR != 0;
+    skipIteration = false;
+    iterationInInvocation = 0;
+    numInvocations++;
+    if (!skipInvocation)
+      numRecordedInvocations++;
+    return !skipInvocation;
+  }
+
+  bool
+  loopInvocationEnd()
+  {
+    if (loopDepth == 0)
+      return true;
+    if (--loopDepth > 0)
+      return !skipping();
+    /* The end of a traced invocation is traced, even if its last iteration was skipped */
+    bool record = !skipInvocation;
+    skipInvocation = false;
+    skipIteration = false;
+    return record;
+  }
+
+  bool
+  loopIterationStart()
+  {
+    if (loopDepth > 1)
+      return !skipping();
+    if (loopDepth == 0)
+      return true;
+    numIterations++;
+    if (skipInvocation)
+      return false;
+    applyPendingLevel();
+    /* The first iteration of an invocation is always traced */
+    skipIteration = level >= THROTTLE_SKIP_ITERATIONS && iterationInInvocation++ % THROTTLE_SKIP_FACTOR != 0;
+    if (!skipIteration)
+      numRecordedIterations++;
+    return !skipIteration;
+  }
+
+  bool
+  dropsInstructions()
+  {
+    return level >= THROTTLE_DROP_INSTRUCTIONS;
+  }
+
+  bool
+  drops(inst_id_t id)
+  {
+    return dropsInstructions() && droppedInstructions.count(id) > 0;
+  }
+
+  bool
+  records(inst_id_t id)
+  {
+    if (skipping())
+      return false;
+    if (drops(id)) {
+      numDroppedEvents++;
+      return false;
+    }
+    return true;
+  }
+
+  bool
+  recordsEvents()
+  {
+    return !skipping();
+  }
+
+  void
+  dumpStats()
+  {
+    ofstream outputFile;
+    outputFile.open(outputDirectory + "/throttle_stats.csv");
+    outputFile << "invocation,iteration,recorded_invocation,recorded_iteration,level,slowdown\n";
+    outputFile << decisions.str() << "\n";
+    outputFile << "budget,invocations,recorded_invocations,iterations,recorded_iterations,dropped_events\n";
+    outputFile << budget << ","
+               << numInvocations << "," << numRecordedInvocations << ","
+               << numIterations << "," << numRecordedIterations << ","
+               << numDroppedEvents << endl;
+    outputFile.close();
+    if (numRecordedInvocations < numInvocations || numRecordedIterations < numIterations || numDroppedEvents > 0) {
+      cerr << "Trace was throttled to keep within a slowdown of " << budget << ", traced "
+           << numRecordedInvocations << " of " << numInvocations << " invocations and "
+           << numRecordedIterations << " of " << numIterations << " iterations. See throttle_stats.csv for details." << endl;
+    }
+  }
+};
+
+
+/**
+ * The throttle, if LIBCAM_THROTTLE_BUDGET is set, shared by the tracers.
+ **/
+static Throttle *throttle = NULL;
+static int numThrottleUsers = 0;
+
+
+/**
+ * Timing of tracer operations.
+ **/
+bool
+throttle_sample_start(uint64_t &start)
+{
+  return throttle && throttle->sampleStart(start);
+}
+
+void
+throttle_sample_end(uint64_t start)
+{
+  throttle->sampleEnd(start);
+}
+
+
+/**
+ * Follow the loop events, deciding which invocations and iterations to trace.
+ **/
+bool
+throttle_loop_invocation_start(void)
+{
+  return !throttle || throttle->loopInvocationStart();
+}
+
+bool
+throttle_loop_invocation_end(void)
+{
+  return !throttle || throttle->loopInvocationEnd();
+}
+
+bool
+throttle_loop_iteration_start(void)
+{
+  return !throttle || throttle->loopIterationStart();
+}
+
+
+/**
+ * Decide whether instructions and other events are traced.
+ **/
+bool
+throttle_records(inst_id_t id)
+{
+  return !throttle || throttle->records(id);
+}
+
+bool
+throttle_drops_instructions(void)
+{
+  return throttle && throttle->dropsInstructions();
+}
+
+bool
+throttle_drops(inst_id_t id)
+{
+  return throttle && throttle->drops(id);
+}
+
+bool
+throttle_records_events(void)
+{
+  return !throttle || throttle->recordsEvents();
+}
+
+
+/**
+ * Initialisation, the throttle is shared by all the profiles initialised.
+ **/
+void
+throttle_init(void)
+{
+  if (numThrottleUsers++ > 0)
+    return;
+  char *env = getenv("LIBCAM_THROTTLE_BUDGET");
+  if (env) {
+    double budget = atof(env);
+    if (budget <= 1) {
+      cerr << "LIBCAM_THROTTLE_BUDGET must be greater than 1\n";
+      abort();
+    }
+    throttle = new Throttle(budget);
+  }
+}
+
+
+/**
+ * Shut down, writing throttle_stats.csv.
+ **/
+void
+throttle_shutdown(void)
+{
+  if (--numThrottleUsers > 0 || !throttle)
+    return;
+  throttle->dumpStats();
+  delete throttle;
+  throttle = NULL;
+}
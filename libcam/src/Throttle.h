@@ -0,0 +1,79 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include "cam.h"
+
+/*
+ * Overhead-adaptive throttling of the tracers, enabled by
+ * LIBCAM_THROTTLE_BUDGET, the slowdown of the application that may be spent
+ * tracing (e.g. 20).  The time spent in the tracers is sampled every
+ * LIBCAM_THROTTLE_SAMPLE_PERIOD operations and, while the budget is exceeded,
+ * fidelity is reduced one level at a time:
+ *   1. only one in THROTTLE_SKIP_FACTOR outermost loop invocations is traced,
+ *   2. only one in THROTTLE_SKIP_FACTOR outermost iterations is traced,
+ *   3. the instructions listed in LIBCAM_THROTTLE_DROP_INSTRUCTIONS are dropped.
+ * Everything in a skipped invocation or iteration is dropped, from all the
+ * tracers, so their traces stay consistent.  Each decision is written to
+ * throttle_stats.csv, which cam reads to report the coverage of the trace.
+ */
+
+/* Initialisation and shut down, once for each CAM_init and CAM_shutdown. */
+void throttle_init(void);
+void throttle_shutdown(void);
+
+/* Loop events, each returns whether the event should be traced. */
+bool throttle_loop_invocation_start(void);
+bool throttle_loop_invocation_end(void);
+bool throttle_loop_iteration_start(void);
+
+/* Whether an instruction, or a memory reference of it, should be traced. */
+bool throttle_records(inst_id_t id);
+
+/* Whether any instructions are being dropped, and whether an instruction is
+ * dropped, without counting it. */
+bool throttle_drops_instructions(void);
+bool throttle_drops(inst_id_t id);
+
+/* Whether calls and blocks should be traced. */
+bool throttle_records_events(void);
+
+/* Used by ThrottleSample. */
+bool throttle_sample_start(uint64_t &start);
+void throttle_sample_end(uint64_t start);
+
+/**
+ * Times the tracer for the lifetime of the object, for one operation in each
+ * sample period.
+ **/
+class ThrottleSample {
+  uint64_t start;
+  bool timed;
+
+public:
+  ThrottleSample() : timed(throttle_sample_start(start)) {}
+  ~ThrottleSample() {
+    if (timed)
+      throttle_sample_end(start);
+  }
+};
+
+#endif
@@ -0,0 +1,151 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "TraceTokenizer.h"
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Numbers of at most this many digits are converted a digit at a time.
+ **/
+#define SHORT_NUMBER_DIGITS 4
+
+static inline uint64_t
+convertDigitsScalar(const char *digits, size_t numDigits)
+{
+  uint64_t value = 0;
+  for(size_t i = 0; i < numDigits; i++)
+    value = value*10 + (digits[i] - '0');
+  return value;
+}
+
+size_t skipSeparatorsScalar(const char *text, size_t length){
+  size_t pos = 0;
+  while(pos < length && !isTraceDigit(text[pos]) && !isTraceMarker(text[pos]) && text[pos] != '-')
+    pos++;
+  return pos;
+}
+
+size_t parseNumberScalar(const char *text, int64_t &value){
+  size_t sign = text[0] == '-';
+  size_t numDigits = 0;
+  while(isTraceDigit(text[sign + numDigits]))
+    numDigits++;
+  uint64_t magnitude = convertDigitsScalar(text + sign, numDigits);
+  value = sign ? -(int64_t)magnitude : (int64_t)magnitude;
+  return sign + numDigits;
+}
+
+#if defined(__SSE2__)
+
+/* Bit i is set if byte i lies in [lower, upper] */
+static inline unsigned int
+rangeMask(__m128i chunk, char lower, char upper)
+{
+  __m128i aboveLower = _mm_cmpgt_epi8(chunk, _mm_set1_epi8(lower - 1));
+  __m128i belowUpper = _mm_cmplt_epi8(chunk, _mm_set1_epi8(upper + 1));
+  return _mm_movemask_epi8(_mm_and_si128(aboveLower, belowUpper));
+}
+
+/* Bit i is set if byte i may start a token */
+static inline unsigned int
+tokenMask(__m128i chunk)
+{
+  return rangeMask(chunk, '0', '9') | rangeMask(chunk, 'a', 'z') |
+         _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('-')));
+}
+
+/* Converts 16 digits, the most significant first, pairs of digits are
+ * combined, then pairs of pairs, and so on */
+static inline uint64_t
+convertDigits16(__m128i chunk)
+{
+  __m128i digits = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+  __m128i zero = _mm_setzero_si128();
+  __m128i tens = _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1);
+  __m128i pairs = _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(digits, zero), tens),
+                                  _mm_madd_epi16(_mm_unpackhi_epi8(digits, zero), tens));
+  __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  quads = _mm_packs_epi32(quads, quads);
+  __m128i octets = _mm_madd_epi16(quads, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+  uint64_t high = (uint32_t)_mm_cvtsi128_si32(octets);
+  uint64_t low = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(octets, 4));
+  return high*100000000 + low;
+}
+
+#endif
+
+size_t skipSeparators(const char *text, size_t length){
+  size_t pos = 0;
+#if defined(__AVX2__)
+  while(pos + 32 <= length){
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(text + pos));
+    __m256i digits = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('a' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), chunk));
+    __m256i minus = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('-'));
+    unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(digits, letters), minus));
+    if(mask)
+      return pos + __builtin_ctz(mask);
+    pos += 32;
+  }
+#endif
+#if defined(__SSE2__)
+  while(pos + 16 <= length){
+    unsigned int mask = tokenMask(_mm_loadu_si128((const __m128i *)(text + pos)));
+    if(mask)
+      return pos + __builtin_ctz(mask);
+    pos += 16;
+  }
+#endif
+  return pos + skipSeparatorsScalar(text + pos, length - pos);
+}
+
+size_t parseNumber(const char *text, size_t length, int64_t &value){
+#if defined(__SSE2__)
+  size_t sign = text[0] == '-';
+  if(length >= sign + 16){
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(text + sign));
+    /* Numbers of 16 or more digits are left to the scalar version */
+    unsigned int numDigits = __builtin_ctz(~rangeMask(chunk, '0', '9'));
+    if(numDigits < 16){
+      uint64_t magnitude;
+      if(numDigits <= SHORT_NUMBER_DIGITS)
+        magnitude = convertDigitsScalar(text + sign, numDigits);
+      else{
+        /* Move the digits to the end of a window of leading zeros */
+        char window[32];
+        memset(window, '0', 16);
+        _mm_storeu_si128((__m128i *)(window + 16), chunk);
+        magnitude = convertDigits16(_mm_loadu_si128((const __m128i *)(window + numDigits)));
+      }
+      value = sign ? -(int64_t)magnitude : (int64_t)magnitude;
+      return sign + numDigits;
+    }
+  }
+#endif
+  return parseNumberScalar(text, value);
+}
@@ -0,0 +1,51 @@
+
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef TRACETOKENIZER_H
+#define TRACETOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Splitting of the text of a trace into tokens, numbers and single letter
+ * markers, everything else separates them.  Where SSE2 is available windows
+ * of 16 bytes, or 32 with AVX2, are classified at once to find the next
+ * token, and all but the shortest numbers are converted 16 digits at a time.
+ * The scalar versions are used otherwise, and near the end of the text.  The
+ * text must be followed by a byte that is not a digit, e.g. the NULL after
+ * the blocks of BZ2ParserState::readBlock.
+ */
+
+/* Whether the character starts a number or is a marker */
+static inline bool isTraceDigit(char c){ return c >= '0' && c <= '9'; }
+static inline bool isTraceMarker(char c){ return c >= 'a' && c <= 'z'; }
+
+/* Returns the number of separators at the start of the text */
+size_t skipSeparators(const char *text, size_t length);
+size_t skipSeparatorsScalar(const char *text, size_t length);
+
+/* Converts the number at the start of the text, a digit or '-' followed by a
+ * digit, returns the number of characters read.  Numbers of more than 20
+ * digits wrap, as strtoull does not */
+size_t parseNumber(const char *text, size_t length, int64_t &value);
+size_t parseNumberScalar(const char *text, int64_t &value);
+
+#endif
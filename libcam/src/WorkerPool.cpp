@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "WorkerPool.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+using namespace std;
+
+WorkerPool::WorkerPool(unsigned int numThreads) : stopping(false) {
+  /* The thread submitting the tasks helps run them while it waits */
+  for(unsigned int i = 1; i < numThreads; i++)
+    workers.push_back(thread(&WorkerPool::work, this));
+}
+
+WorkerPool::~WorkerPool(){
+  {
+    unique_lock<mutex> guard(lock);
+    stopping = true;
+  }
+  available.notify_all();
+  for(auto i = workers.begin(); i != workers.end(); i++)
+    i->join();
+}
+
+WorkerPool& WorkerPool::shared(){
+  static WorkerPool *pool = NULL;
+  static once_flag created;
+  call_once(created, [](){
+    unsigned int numThreads = thread::hardware_concurrency();
+    char *env = getenv("LIBCAM_ANALYSIS_THREADS");
+    if(env)
+      numThreads = atoi(env);
+    if(numThreads < 1)
+      numThreads = 1;
+    /* Never destroyed, tasks may still be referenced by static objects at exit */
+    pool = new WorkerPool(numThreads);
+  });
+  return *pool;
+}
+
+unsigned int WorkerPool::size() const {
+  return workers.size() + 1;
+}
+
+void WorkerPool::work(){
+  while(true){
+    function<void()> task;
+    {
+      unique_lock<mutex> guard(lock);
+      available.wait(guard, [this](){ return stopping || !tasks.empty(); });
+      if(tasks.empty())
+        return;
+      task = move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+bool WorkerPool::runTask(){
+  function<void()> task;
+  {
+    unique_lock<mutex> guard(lock);
+    if(tasks.empty())
+      return false;
+    task = move(tasks.front());
+    tasks.pop_front();
+  }
+  task();
+  return true;
+}
+
+future<void> WorkerPool::submit(function<void()> task){
+  shared_ptr<packaged_task<void()> > packaged = make_shared<packaged_task<void()> >(task);
+  future<void> result = packaged->get_future();
+  {
+    unique_lock<mutex> guard(lock);
+    tasks.push_back([packaged](){ (*packaged)(); });
+  }
+  available.notify_one();
+  return result;
+}
+
+void WorkerPool::wait(future<void>& result){
+  while(result.wait_for(chrono::seconds(0)) != future_status::ready){
+    if(!runTask())
+      result.wait_for(chrono::milliseconds(1));
+  }
+  result.get();
+}
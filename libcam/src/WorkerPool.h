@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2012 - 2015  Niall Murphy
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Threads shared by the parts of the analysis that run in parallel.  The
+ * number of threads is set by the environment variable
+ * LIBCAM_ANALYSIS_THREADS, by default one per core.  A thread waiting for a
+ * task runs queued tasks meanwhile, so tasks may wait for other tasks.
+ */
+class WorkerPool{
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()> > tasks;
+  std::mutex lock;
+  std::condition_variable available;
+  bool stopping;
+
+  void work();
+
+  /* Run one queued task, returns false if there were none */
+  bool runTask();
+
+public:
+  WorkerPool(unsigned int numThreads);
+  ~WorkerPool();
+
+  /* The pool shared by the analysis */
+  static WorkerPool& shared();
+
+  /* Number of threads running tasks, counting the thread waiting for them */
+  unsigned int size() const;
+
+  std::future<void> submit(std::function<void()> task);
+
+  /* Wait for a task to finish, running other tasks meanwhile */
+  void wait(std::future<void>& result);
+};
+
+/*
+ * A queue passing work between two stages of the analysis running on their
+ * own threads.  It holds at most capacity items, so the first stage cannot
+ * run further ahead of the second, and the memory it holds is bounded.
+ */
+template<class T> class BoundedQueue{
+  std::deque<T> items;
+  size_t capacity;
+  bool closed;
+  std::mutex lock;
+  std::condition_variable notFull;
+  std::condition_variable notEmpty;
+
+public:
+  BoundedQueue(size_t _capacity) : capacity(_capacity), closed(false) {}
+
+  /* Wait for space for the item, returns false if the queue has been closed */
+  bool push(T item){
+    std::unique_lock<std::mutex> guard(lock);
+    notFull.wait(guard, [this](){ return closed || items.size() < capacity; });
+    if(closed)
+      return false;
+    items.push_back(item);
+    notEmpty.notify_one();
+    return true;
+  }
+
+  /* Wait for an item, returns false once the queue is closed and empty */
+  bool pop(T& item){
+    std::unique_lock<std::mutex> guard(lock);
+    notEmpty.wait(guard, [this](){ return closed || !items.empty(); });
+    if(items.empty())
+      return false;
+    item = items.front();
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  /* No more items are pushed, waiting threads are woken */
+  void close(){
+    std::unique_lock<std::mutex> guard(lock);
+    closed = true;
+    notFull.notify_all();
+    notEmpty.notify_all();
+  }
+};
+
+#endif
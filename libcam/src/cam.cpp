@@ -24,6 +24,8 @@
 #include <fstream>
 #include "cam.h"
 #include "MemoryTracer.h"
+#include "DependenceTracer.h"
+#include "Throttle.h"
 #include "loop_trace.hh"
 
 using namespace std;
@@ -40,10 +42,13 @@ static void setSegFaultHandler(){
 
 void CAM_init (cam_mode_t mode) {
   setSegFaultHandler();
+  throttle_init();
   if (mode == CAM_MEMORY_PROFILE) {
     memory_trace_init();
   } else if (mode == CAM_LOOP_PROFILE) {
     loop_trace_init();
+  } else if (mode == CAM_DEPENDENCE_PROFILE || mode == CAM_SIGNATURE_PROFILE) {
+    dependence_trace_init(mode == CAM_SIGNATURE_PROFILE);
   }
 }
 
@@ -52,5 +57,37 @@ void CAM_shutdown (cam_mode_t mode) {
     memory_trace_shutdown();
   } else if (mode == CAM_LOOP_PROFILE) {
     loop_trace_shutdown();
+  } else if (mode == CAM_DEPENDENCE_PROFILE || mode == CAM_SIGNATURE_PROFILE) {
+    dependence_trace_shutdown();
   }
+  throttle_shutdown();
+}
+
+void CAM_mem(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen) {
+  ThrottleSample sample;
+  if (!throttle_records(id))
+    return;
+  if (dependence_trace_running()) {
+    dependence_trace_record(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
+    return;
+  }
+  if (memory_trace_timed_out())
+    return;
+  memory_trace_record(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
+}
+
+void CAM_memSeenInstruction(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen) {
+  ThrottleSample sample;
+  if (!throttle_records(id))
+    return;
+  /* Only the second call and throttle check are saved.  The tracers keep
+   * their own timeout counters and dump checks, as the loop tracer counts
+   * loop events and only the instructions seen inside loops, so sharing a
+   * check would change where each trace times out */
+  if (dependence_trace_running())
+    dependence_trace_record(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
+  else if (memory_trace_running() && !memory_trace_timed_out())
+    memory_trace_record(id, raddr1, rlen1, raddr2, rlen2, waddr, wlen);
+  if (loop_trace_running())
+    loop_trace_seen_instruction(id, true);
 }
@@ -34,7 +34,17 @@ typedef uintptr_t inst_id_t;
  * Global library functions.
  **/
 
-typedef enum {CAM_MEMORY_PROFILE, CAM_LOOP_PROFILE} cam_mode_t;
+// CAM_DEPENDENCE_PROFILE finds the dependences carried by loops while the
+// program runs, using shadow memory, instead of recording traces for cam -p.
+// It is used on its own, with the same calls as the memory and loop profiles,
+// and writes dependence_pairs.txt on shutdown.
+// CAM_SIGNATURE_PROFILE is a quick, probabilistic, version using bounded
+// memory, it writes the suspected dependences and the number of iterations
+// they were seen in to suspected_dependences.txt.
+// If LIBCAM_THROTTLE_BUDGET is set, the profiles trace fewer loop invocations,
+// iterations and instructions while they slow the program down by more than
+// the budget, see Throttle.h, and cam reports the coverage of the traces.
+typedef enum {CAM_MEMORY_PROFILE, CAM_LOOP_PROFILE, CAM_DEPENDENCE_PROFILE, CAM_SIGNATURE_PROFILE} cam_mode_t;
 
 // Init
 void CAM_init (cam_mode_t mode);
@@ -50,6 +60,12 @@ void CAM_shutdown (cam_mode_t mode);
 // Register a memory reference
 void CAM_mem(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen);
 
+// Register a memory reference and the instruction as being executed, with a
+// single call. Equivalent to CAM_mem followed by CAM_profileLoopSeenInstruction,
+// including the timeout of each trace, either half is skipped if the
+// corresponding profile is not initialised.
+void CAM_memSeenInstruction(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, uint64_t rlen2, uintptr_t waddr, uint64_t wlen);
+
 // Entry of the dumped file
 // <inst id>
 // N [ <loc>* ]			// Reads
@@ -65,7 +81,13 @@ void CAM_mem(inst_id_t id, uintptr_t raddr1, uint64_t rlen1, uintptr_t raddr2, u
  *
  **/
 
-// Register a loop invocation starting.
+// The loop and call traces are written as text, or in a binary format that is
+// faster to write and to parse if LIBCAM_BINARY_TRACES=1, cam reads either.
+
+// Register a loop invocation starting. Loops may be nested, the trace of
+// nesting level N (N < LIBCAM_LOOP_TRACE_LEVELS, default 1) records the loops
+// at that depth and records each loop directly inside them as a call of its
+// loop ID, so loop IDs must not clash with call instruction IDs.
 void CAM_profileLoopInvocationStart(JITNINT loopID);
 
 // Register a loop invocation ending.
@@ -77,6 +99,12 @@ void CAM_profileLoopIterationStart(void);
 // Register an instruction as being executed.
 void CAM_profileLoopSeenInstruction(JITNINT instID);
 
+// Register the ordered list of instructions making up a basic block.
+void CAM_profileLoopRegisterBlock(JITNINT blockID, const JITNINT *instIDs, JITUINT32 numInsts);
+
+// Register all instructions of a registered basic block as being executed.
+void CAM_profileLoopSeenBlock(JITNINT blockID);
+
 // Register a call as being made.
 void CAM_profileCallInvocationStart(JITNINT instID);
 
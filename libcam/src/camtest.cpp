@@ -18,6 +18,7 @@
  */
 
 #include <iostream>
+#include <fstream>
 #include "cam.h"
 #include "memory_allocator.hh"
 #include <assert.h>
@@ -28,9 +29,12 @@
 #include "LoopTraceStreamer.h"
 #include "CallTraceStreamer.h"
 #include "CallTrace.h"
+#include "dependence_analysis.h"
 
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
+#include <thread>
+#include <functional>
 
 using namespace std;
 
@@ -388,13 +392,23 @@ void seenInst(uintptr_t ID, vector<vector<vector<uintptr_t>>>& input, vector<vec
   input.back().back().push_back(ID);
   inputCounts.back().back()[ID]++;
 }
+/* Block ID executes instructions ID*100 to ID*100 + block_size - 1 */
+void seenBlock(uintptr_t ID, int block_size, set<uintptr_t>& ids, vector<vector<vector<uintptr_t>>>& input, vector<vector<map<uintptr_t, uint64_t>>>& inputCounts){
+  CAM_profileLoopSeenBlock(ID);
+  for(int k = 0; k < block_size; k++){
+    ids.insert(ID*100 + k);
+    input.back().back().push_back(ID*100 + k);
+    inputCounts.back().back()[ID*100 + k]++;
+  }
+}
 
-void loopTraceRandomTest_impl(int num_instructions, int num_instances, int num_invocations, int num_iterations, int num_dumps, int tag=0){
+void loopTraceRandomTest_impl(int num_instructions, int num_instances, int num_invocations, int num_iterations, int num_dumps, int tag=0, int block_size=0){
   cout << " num_instructions: " << num_instructions 
        << " num_instances: " << num_instances
        << " num_invocations: " << num_invocations 
        << " num_iterations: " << num_iterations  
-       << " num_dumps: " << num_dumps  << endl;
+       << " num_dumps: " << num_dumps
+       << " block_size: " << block_size << endl;
 
   set<uintptr_t> ids;
 
@@ -402,6 +416,14 @@ void loopTraceRandomTest_impl(int num_instructions, int num_instances, int num_i
   vector<vector<vector<uintptr_t>>> input;
   vector<vector<map<uintptr_t, uint64_t>>> inputCounts;
   CAM_init(CAM_LOOP_PROFILE);
+  if(block_size){
+    for(JITNINT ID = 1; ID <= num_instructions + 1; ID++){
+      vector<JITNINT> insts;
+      for(int k = 0; k < block_size; k++)
+        insts.push_back(ID*100 + k);
+      CAM_profileLoopRegisterBlock(ID, insts.data(), insts.size());
+    }
+  }
   startInv(input, inputCounts);
   startIter(input, inputCounts);
   for(int i = 0; i < num_instances; i++){
@@ -420,8 +442,12 @@ void loopTraceRandomTest_impl(int num_instructions, int num_instances, int num_i
       continue;
     }
     uintptr_t ID = (1 + i%num_instructions) + randomMangler(100);
-    ids.insert(ID);
-    seenInst(ID, input, inputCounts);
+    if(block_size)
+      seenBlock(ID, block_size, ids, input, inputCounts);
+    else{
+      ids.insert(ID);
+      seenInst(ID, input, inputCounts);
+    }
   }
   endInv(input, inputCounts);
   CAM_shutdown(CAM_LOOP_PROFILE);
@@ -474,6 +500,7 @@ void loopTraceRandomTest(){
   loopTraceRandomTest_impl(5, 100000, 1, 10000, 2, 4);
   loopTraceRandomTest_impl(5, 10000000, 1, 10000, 10, 5);
   loopTraceRandomTest_impl(5, 10000, 10, 100, 1000, 6);
+  loopTraceRandomTest_impl(5, 100000, 100, 100, 2, 7, 8);
 
 }
 
@@ -702,6 +729,19 @@ void callTraceRandomTest(){
   callTraceRandomTest_impl(5, 5, 100000, 1, 10, 10, 1000, 4);
 }
 
+void binaryTraceRandomTest(){
+  cout << " ** Binary trace random test **\n";
+
+  setenv("LIBCAM_BINARY_TRACES", "1", 1);
+  loopTraceRandomTest_impl(5, 100000, 100, 100, 2);
+  loopTraceRandomTest_impl(5, 10000, 10, 100, 1000);
+  loopTraceRandomTest_impl(5, 100000, 100, 100, 2, 0, 8);
+  callTraceRandomTest_impl(1, 5, 10000, 10, 10, 10, 2);
+  callTraceRandomTest_impl(5, 5, 100000, 1, 10, 10, 1000);
+  unsetenv("LIBCAM_BINARY_TRACES");
+  if(system("rm -f loop_trace.bin.bz2 call_trace.bin.bz2")) abort();
+}
+
 void memoryTraceRandomTest(int compressibility){
   int num_instructions = 500;
   uintptr_t min_address = 1000000;
@@ -789,6 +829,917 @@ void memoryTraceRandomTest(int compressibility){
   cout << "SUCCESS!\n";
 }
 
+/* An access made by a memory trace test, with the iteration it was made in
+ * if the trace is tagged with iterations */
+struct TracedAccess{
+  uintptr_t addr;
+  uint64_t len;
+  uint64_t iteration;
+  TracedAccess(uintptr_t a, uint64_t l = 8, uint64_t i = 0) : addr(a), len(l), iteration(i) {}
+};
+
+/* For each instruction, its accesses split into the chunks they are read back in */
+typedef map<uintptr_t, vector<vector<TracedAccess>>> TracedAccesses;
+
+string writeTracePath(uintptr_t ID){
+  return "memory_accesses/memory_accesses." + to_string(ID) + ".w.txt.bz2";
+}
+
+/* Read the write trace of an instruction back a chunk at a time, as the
+ * analysis does, checking the number, address and width of every instance.
+ * If the trace is tagged, each entry must be tagged with its chunk as the
+ * invocation and each instance with its iteration.  Every entry is also
+ * passed to onEntry.  Returns the first mismatch, or an empty string, so
+ * that traces can be checked on several threads */
+string readBackMemoryTrace(uintptr_t ID, const vector<vector<TracedAccess>> &chunks, bool tagged = false,
+    function<void(MemSetEntry &)> onEntry = function<void(MemSetEntry &)>()){
+  MemoryTraceStreamer streamer(ID, writeTracePath(ID), true);
+  uint64_t n = 0;
+  for(uint64_t c = 0; c < chunks.size(); c++){
+    const vector<TracedAccess> &accesses = chunks[c];
+    if(accesses.empty())
+      continue;
+    string where = "instruction " + to_string(ID) + " chunk " + to_string(c);
+    MemSet chunk = streamer.getNextChunk(accesses.size(), tagged);
+    uint64_t first = n;
+    for(auto e = chunk.begin(); e != chunk.end(); e++){
+      if(e->getStart() != n)
+        return "Entry of " + where + " starts at instance " + to_string(e->getStart()) + " instead of " + to_string(n);
+      if(tagged && (!e->hasIterationTags() || e->getTagInvocation() != c))
+        return "Entry of " + where + " is not tagged with its invocation";
+      uint64_t perIteration = tagged ? e->getNumInstances()/e->getTagIterationSpan() : 1;
+      for(uint64_t k = 0; k < e->getNumInstances(); k++, n++){
+        if(n - first >= accesses.size())
+          return "Too many accesses for " + where;
+        const TracedAccess &access = accesses[n - first];
+        if(e->getAccessLower(k) != access.addr || e->getLength() != access.len ||
+           (tagged && e->getTagFirstIteration() + k/perIteration != access.iteration))
+          return "Mismatch for " + where + " access " + to_string(n - first);
+      }
+      if(onEntry)
+        onEntry(*e);
+    }
+    if(n - first != accesses.size())
+      return "Missing accesses for " + where;
+  }
+  return "";
+}
+
+/* Check the write trace of every instruction, see readBackMemoryTrace */
+void verifyMemoryTraceReadBack(const TracedAccesses &input, bool tagged = false,
+    function<void(MemSetEntry &)> onEntry = function<void(MemSetEntry &)>()){
+  for(auto in = input.begin(); in != input.end(); in++){
+    string error = readBackMemoryTrace(in->first, in->second, tagged, onEntry);
+    if(!error.empty()){
+      cout << error << endl;
+      abort();
+    }
+  }
+}
+
+/* Irregular accesses, recorded as delta runs, alternate with strided ones,
+ * which leave the runs once their deltas settle, and every instance is read
+ * back with its number, address and width */
+void memoryTraceDeltaRunTest(){
+  int num_instructions = 4;
+  int num_phases = 200;
+
+  cout << " ** Memory trace delta run test **\n";
+
+  cout << "simulating trace\n";
+  /* For each instruction, its accesses in chunks of random length */
+  TracedAccesses input;
+  auto record = [&input] (uintptr_t ID, uintptr_t addr, uint64_t len) {
+    if(input[ID].empty() || randomMangler(20))
+      input[ID].push_back(vector<TracedAccess>());
+    input[ID].back().push_back(TracedAccess(addr, len));
+    CAM_mem(ID, 0, 0, 0, 0, addr, len);
+  };
+  uint64_t num_strided = 0;
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int phase = 0; phase < num_phases; phase++){
+    uintptr_t ID = 1000*(1 + rand()%num_instructions);
+    uint64_t len = randomMangler(10) ? 4 : 8;
+    int num_accesses = 1 + rand()%100;
+    if(phase%2 == 0){
+      /* Deltas of every size and sign, so the varints take from one to several bytes */
+      for(int a = 0; a < num_accesses; a++)
+        record(ID, 0x10000000000 + (((uintptr_t)rand() << 16) ^ rand())%((uintptr_t)1 << (4 + rand()%36)), len);
+    }
+    else{
+      uintptr_t addr = 0x20000000000 + 8*(rand()%100000);
+      intptr_t stride = 8*(rand()%64 - 32);
+      for(int a = 0; a < num_accesses; a++, addr += stride)
+        record(ID, addr, len);
+      num_strided += num_accesses;
+    }
+    if(randomMangler(20))
+      CAM_forceMemTraceDump();
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+
+  cout << "verifying\n";
+  uint64_t num_in_strides = 0;
+  verifyMemoryTraceReadBack(input, false, [&num_in_strides] (MemSetEntry &e) {
+    if(e.getNumInstances() > 2)
+      num_in_strides += e.getNumInstances();
+  });
+  uint64_t num_delta_runs = 0;
+  for(auto in = input.begin(); in != input.end(); in++){
+    BZ2ParserState parser(writeTracePath(in->first).c_str());
+    char *text;
+    for(size_t length = parser.readBlock(text); length > 0; length = parser.readBlock(text))
+      num_delta_runs += count(text, text + length, 'd');
+  }
+  if(num_delta_runs == 0){
+    cout << "No delta runs were recorded\n";
+    abort();
+  }
+  /* The strided accesses follow delta runs, which must give them up */
+  if(num_in_strides < num_strided/2){
+    cout << "Only " << num_in_strides << " of " << num_strided << " strided accesses were in strided entries\n";
+    abort();
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Each access is recorded with the invocation and iteration it was made in, and
+ * the memory trace is read back an invocation at a time as the analysis does */
+void memoryTraceIterationTagTest(){
+  int num_instructions = 5;
+  int num_invocations = 50;
+  int max_iterations = 100;
+
+  cout << " ** Memory trace iteration tag test **\n";
+
+  cout << "simulating trace\n";
+  /* For each instruction, the accesses of each invocation */
+  TracedAccesses input;
+  setenv("LIBCAM_MEM_TRACE_ITERATION_TAGS", "1", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    for(int i = 0; i < num_instructions; i++)
+      input[(i + 1)*1000].push_back(vector<TracedAccess>());
+    int num_iterations = 1 + rand()%max_iterations;
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      for(int i = 0; i < num_instructions; i++){
+        uintptr_t ID = (i + 1)*1000;
+        /* Mostly regular, sometimes an iteration does more or less work */
+        int num_accesses = i + randomMangler(10)*(rand()%3);
+        for(int a = 0; a < num_accesses; a++){
+          uintptr_t addr = 1000000*(i + 1) + 8*(iter*(i + 1) + a) + (randomMangler(50) ? 4096 : 0);
+          input[ID].back().push_back(TracedAccess(addr, 8, iter));
+          CAM_mem(ID, 0, 0, 0, 0, addr, 8);
+        }
+      }
+      if(randomMangler(1000))
+        CAM_forceMemTraceDump();
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_ITERATION_TAGS");
+
+  cout << "verifying\n";
+  verifyMemoryTraceReadBack(input, true);
+
+  cout << "SUCCESS!\n";
+}
+
+void memoryTraceDedupTest(){
+  int num_instructions = 4;
+  int num_invocations = 60;
+  int num_shapes = 3;
+  int num_iterations = 30;
+
+  cout << " ** Memory trace invocation deduplication test **\n";
+
+  cout << "simulating trace\n";
+  /* For each instruction, the accesses of each invocation */
+  TracedAccesses input;
+  vector<int> shapes;
+  setenv("LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS", "1", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    /* Most invocations repeat one of a few shapes at a different base, some are unique */
+    int shape = randomMangler(10) ? num_shapes + inv : rand()%num_shapes;
+    shapes.push_back(shape);
+    uintptr_t base = 1000000 + 65536*(rand()%1000);
+    for(int i = 0; i < num_instructions; i++)
+      input[(i + 1)*1000].push_back(vector<TracedAccess>());
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      for(int i = 0; i < num_instructions; i++){
+        uintptr_t ID = (i + 1)*1000;
+        /* Strided, nested and irregular accesses */
+        for(int a = 0; a < i + 1; a++){
+          uintptr_t addr = base + 8192*i + 8*(iter*(i + 1) + a);
+          if(i == 3)
+            addr = base + 8192*i + 8*((iter*7919 + a*31 + shape*101)%997);
+          input[ID].back().push_back(TracedAccess(addr));
+          CAM_mem(ID, 0, 0, 0, 0, addr, 8);
+        }
+      }
+    }
+    CAM_profileLoopInvocationEnd();
+    if(randomMangler(20))
+      CAM_forceMemTraceDump();
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS");
+
+  cout << "verifying\n";
+  verifyMemoryTraceReadBack(input);
+
+  /* Only invocations of the same shape are found to repeat each other */
+  ifstream f("memory_accesses/repeated_invocations.txt");
+  uint64_t inv, earlier, numRepeated = 0;
+  while(f >> inv >> earlier){
+    if(earlier >= inv || shapes[inv] != shapes[earlier]){
+      cout << "Invocation " << inv << " does not repeat invocation " << earlier << endl;
+      abort();
+    }
+    numRepeated++;
+  }
+  if(numRepeated == 0){
+    cout << "No repeated invocations found\n";
+    abort();
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Number of bzip2 streams appended to a file */
+int countCompressedStreams(const char *path){
+  ifstream f(path, ios::binary);
+  string data((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+  int n = 0;
+  for(size_t pos = data.find("BZh91AY&SY"); pos != string::npos; pos = data.find("BZh91AY&SY", pos + 1))
+    n++;
+  return n;
+}
+
+void memoryTraceEvictionTest(){
+  int num_instructions = 6;
+  int num_accesses = 20000;
+
+  cout << " ** Memory trace eviction test **\n";
+
+  cout << "simulating trace\n";
+  /* Instruction 1000 is hot and regular, the others are irregular, each is read back at once */
+  TracedAccesses input;
+  setenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE", "16384", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int a = 0; a < num_accesses; a++){
+    uintptr_t ID = randomMangler(2) ? 1000 : 1000*(1 + rand()%num_instructions);
+    if(input[ID].empty())
+      input[ID].push_back(vector<TracedAccess>());
+    uintptr_t addr = ID == 1000 ? 100000 + 8*input[ID][0].size() : 1000000 + 8*(rand()%100000);
+    input[ID][0].push_back(TracedAccess(addr));
+    CAM_mem(ID, 0, 0, 0, 0, addr, 8);
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE");
+
+  cout << "verifying\n";
+  verifyMemoryTraceReadBack(input);
+  int num_evictions = 0;
+  for(auto in = input.begin(); in != input.end(); in++){
+    int streams = countCompressedStreams(writeTracePath(in->first).c_str());
+    if(in->first == 1000 && streams != 1){
+      cout << "Hot instruction was written " << streams << " times\n";
+      abort();
+    }
+    num_evictions += streams - 1;
+  }
+  if(num_evictions == 0){
+    cout << "No instructions were evicted\n";
+    abort();
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* The tracer summarises the accesses of each instruction over the whole
+ * trace, including the records it evicted, and the summaries of instructions
+ * accessing disjoint memory do not intersect */
+void accessSummaryTest(){
+  int num_instructions = 8;
+  int num_accesses = 20000;
+
+  cout << " ** Access summary test **\n";
+
+  cout << "simulating trace\n";
+  /* Instruction i writes region i and reads regions i and i + 1, regions of 64 pages */
+  map<pair<uintptr_t, bool>, set<uintptr_t>> input;
+  setenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE", "16384", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int a = 0; a < num_accesses; a++){
+    int i = rand()%num_instructions;
+    uintptr_t ID = 1000*(i + 1);
+    uintptr_t raddr = 0x1000000 + (uintptr_t)((i + rand()%2)*64 + rand()%64)*4096 + 8*(rand()%512);
+    uintptr_t waddr = 0x1000000 + (uintptr_t)(i*64 + rand()%64)*4096 + 8*(rand()%512);
+    input[pair<uintptr_t, bool>(ID, false)].insert(raddr);
+    input[pair<uintptr_t, bool>(ID, true)].insert(waddr);
+    CAM_mem(ID, raddr, 8, 0, 0, waddr, 8);
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE");
+
+  cout << "verifying\n";
+  map<pair<uintptr_t, bool>, AccessSummary> summaries = parse_access_summaries();
+  if(summaries.size() != input.size()){
+    cout << "Found " << summaries.size() << " summaries for " << input.size() << " traces\n";
+    abort();
+  }
+  for(auto in = input.begin(); in != input.end(); in++){
+    AccessSummary &summary = summaries[in->first];
+    if(summary.lowest != *in->second.begin() || summary.highest != *in->second.rbegin() + 8){
+      cout << "Wrong extent for instruction " << in->first.first << endl;
+      abort();
+    }
+  }
+  for(int i = 0; i < num_instructions; i++){
+    for(int j = 0; j < num_instructions; j++){
+      AccessSummary &write = summaries[pair<uintptr_t, bool>(1000*(i + 1), true)];
+      bool meet = write.mayIntersect(summaries[pair<uintptr_t, bool>(1000*(j + 1), false)]);
+      if(meet != (j == i || j + 1 == i)){
+        cout << "Writes of instruction " << 1000*(i + 1) << (meet ? " intersect" : " do not intersect")
+             << " reads of instruction " << 1000*(j + 1) << endl;
+        abort();
+      }
+      meet = write.mayIntersect(summaries[pair<uintptr_t, bool>(1000*(j + 1), true)]);
+      if(meet != (j == i)){
+        cout << "Writes of instructions " << 1000*(i + 1) << " and " << 1000*(j + 1)
+             << (meet ? " intersect" : " do not intersect") << endl;
+        abort();
+      }
+    }
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* The memory traces of all the instructions are decoded at once, each on a
+ * thread of its own, while chunks are decoded ahead on the worker pool */
+void memoryTraceConcurrentDecodeTest(){
+  int num_instructions = 8;
+  int num_invocations = 40;
+  int num_iterations = 50;
+
+  cout << " ** Memory trace concurrent decode test **\n";
+
+  /* Few descriptors and little buffer memory, shared by the decoders */
+  setenv("LIBCAM_ANALYSIS_THREADS", "4", 1);
+  setenv("LIBCAM_MAX_OPEN_TRACES", "2", 1);
+  setenv("LIBCAM_PARSER_BUFFER_MEMORY", "65536", 1);
+
+  cout << "simulating trace\n";
+  /* For each instruction, the accesses of each invocation */
+  TracedAccesses input;
+  setenv("LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS", "1", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    uintptr_t base = 1000000 + 65536*(rand()%1000);
+    for(int i = 0; i < num_instructions; i++)
+      input[(i + 1)*1000].push_back(vector<TracedAccess>());
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      for(int i = 0; i < num_instructions; i++){
+        uintptr_t ID = (i + 1)*1000;
+        /* Strided, nested, repeated and irregular accesses */
+        for(int a = 0; a < i%4 + 1; a++){
+          uintptr_t addr = base + 8192*i + 8*(iter*(i%4 + 1) + a);
+          if(i%4 == 3)
+            addr = base + 8192*i + 8*((iter*7919 + a*31 + (inv%3)*101)%997);
+          if(i >= 4 && randomMangler(5))
+            addr = 1000000 + 8*(rand()%100000);
+          input[ID].back().push_back(TracedAccess(addr));
+          CAM_mem(ID, 0, 0, 0, 0, addr, 8);
+        }
+      }
+    }
+    CAM_profileLoopInvocationEnd();
+    if(randomMangler(10))
+      CAM_forceMemTraceDump();
+  }
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS");
+
+  cout << "verifying\n";
+  vector<thread> decoders;
+  vector<string> errors(input.size());
+  size_t index = 0;
+  for(auto in = input.begin(); in != input.end(); in++, index++){
+    decoders.push_back(thread([in, index, &errors](){
+      errors[index] = readBackMemoryTrace(in->first, in->second);
+    }));
+  }
+  for(auto d = decoders.begin(); d != decoders.end(); d++)
+    d->join();
+  for(auto e = errors.begin(); e != errors.end(); e++){
+    if(!e->empty()){
+      cout << *e << endl;
+      abort();
+    }
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Per iteration instruction counts of a loop trace, as parsed */
+vector<vector<map<uintptr_t, uint64_t>>> parseLoopTraceCounts(unsigned int level, set<uintptr_t>& ids){
+  vector<vector<map<uintptr_t, uint64_t>>> counts;
+  StreamParseLoopRec sloop(level);
+  for(auto invi = sloop.ii_begin(); invi != sloop.ii_end(); invi = sloop.ii_next(invi)){
+    counts.push_back(vector<map<uintptr_t, uint64_t>>());
+    InvocationGroupCfc& invGroup = *invi.first->getInvocationGroupPointer();
+    for(auto iteri = invGroup.iterationIteratorBegin(); iteri != invGroup.iterationIteratorEnd(); iteri = invGroup.iterationIteratorNext(iteri)){
+      counts.back().push_back(map<uintptr_t, uint64_t>());
+      for(auto id : ids)
+        if(invGroup.getNumInstancesFromII(iteri, id) > 0)
+          counts.back().back()[id] = invGroup.getNumInstancesFromII(iteri, id);
+    }
+  }
+  return counts;
+}
+
+void nestedLoopTraceTest(){
+  int num_instructions = 5;
+  int num_invocations = 20;
+  int max_iterations = 50;
+  uintptr_t innerLoopID = 900;
+
+  cout << " ** Nested loop trace test **\n";
+
+  cout << "simulating trace\n";
+  set<uintptr_t> outerIDs, innerIDs;
+  outerIDs.insert(innerLoopID);
+  /* Instruction counts of each outer iteration, inner loop instructions of each outer iteration and each inner iteration */
+  vector<vector<map<uintptr_t, uint64_t>>> outerCounts, subCounts, innerCounts;
+  setenv("LIBCAM_LOOP_TRACE_LEVELS", "2", 1);
+  CAM_init(CAM_LOOP_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    outerCounts.push_back(vector<map<uintptr_t, uint64_t>>());
+    subCounts.push_back(vector<map<uintptr_t, uint64_t>>());
+    int num_iterations = 1 + rand()%max_iterations;
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      outerCounts.back().push_back(map<uintptr_t, uint64_t>());
+      subCounts.back().push_back(map<uintptr_t, uint64_t>());
+      for(int i = 0; i < num_instructions; i++){
+        uintptr_t ID = 1 + i;
+        outerIDs.insert(ID);
+        CAM_profileLoopSeenInstruction(ID);
+        outerCounts.back().back()[ID]++;
+
+        /* Sometimes run the inner loop, which is itself seen as an instruction of the outer loop */
+        if(randomMangler(3)){
+          CAM_profileLoopInvocationStart(innerLoopID);
+          outerCounts.back().back()[innerLoopID]++;
+          innerCounts.push_back(vector<map<uintptr_t, uint64_t>>());
+          int num_inner_iterations = 1 + rand()%max_iterations;
+          for(int innerIter = 0; innerIter < num_inner_iterations; innerIter++){
+            CAM_profileLoopIterationStart();
+            innerCounts.back().push_back(map<uintptr_t, uint64_t>());
+            for(int j = 0; j < num_instructions; j++){
+              uintptr_t innerID = 100 + j + randomMangler(10);
+              innerIDs.insert(innerID);
+              CAM_profileLoopSeenInstruction(innerID);
+              subCounts.back().back()[innerID]++;
+              innerCounts.back().back()[innerID]++;
+            }
+          }
+          CAM_profileLoopInvocationEnd();
+        }
+      }
+      if(randomMangler(200))
+        CAM_forceLoopTraceDump();
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_LOOP_PROFILE);
+  unsetenv("LIBCAM_LOOP_TRACE_LEVELS");
+
+  cout << "verifying\n";
+  if(parseLoopTraceCounts(0, outerIDs) != outerCounts) { cout << "Outer loop trace mismatch\n"; abort(); }
+  if(parseLoopTraceCounts(1, innerIDs) != innerCounts) { cout << "Inner loop trace mismatch\n"; abort(); }
+
+  /* The inner loop is a call in the outer loop trace */
+  set<uintptr_t> callIDs;
+  callIDs.insert(innerLoopID);
+  map<uintptr_t, uint64_t> subInstrRunningCount;
+  StreamParseCallTrace ct = parseCallTrace();
+  ct.buildLuts();
+  StreamParseLoopRec sloop;
+  for(auto invi = sloop.ii_begin(); invi != sloop.ii_end(); invi = sloop.ii_next(invi)){
+    CallTraceLoopInvocationGroup invocCallTrace = ct.getInvocCallTraceFromInvocNumber(invi.second);
+    InvocationGroupCfc* invocGroup = invi.first->getInvocationGroupPointer();
+    invocCallTrace.buildCallTraceCache(*invocGroup, subInstrRunningCount, callIDs);
+    vector<map<uintptr_t, uint64_t>> counts(invocGroup->getNumberOfIterations());
+    for(auto instrID : innerIDs){
+      for(auto cii = invocCallTrace.callInstanceIteratorBegin(instrID); 
+               cii != invocCallTrace.callInstanceIteratorEnd(instrID); 
+               cii = invocCallTrace.callInstanceIteratorNext(cii)){
+        uint64_t iter = invocGroup->getIterationNumber(invocCallTrace.getCallIDFromCII(cii), invocCallTrace.getCallInstanceFromCII(cii));
+        counts[iter][instrID] += invocCallTrace.getNumInstancesFromCII(cii);
+      }
+    }
+    if(counts != subCounts[invi.second]) { cout << "Inner loop call trace mismatch in invocation " << invi.second << endl; abort(); }
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Instructions of the inner loop also run between its invocations, outside
+ * the loops analysed at level 1, which must not shift their memory traces */
+void nestedLoopMemoryTraceTest(){
+  int num_invocations = 10;
+  int num_iterations = 32;
+  uint64_t A[64], B[64];
+
+  cout << " ** Nested loop memory trace test **\n";
+
+  cout << "simulating trace\n";
+  setenv("LIBCAM_LOOP_TRACE_LEVELS", "2", 1);
+  setenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE", "16384", 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  CAM_init(CAM_LOOP_PROFILE);
+  CAM_memSeenInstruction(20, 0, 0, 0, 0, (uintptr_t)&A[63], 8);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    int num_outer_iterations = 1 + rand()%4;
+    for(int iter = 0; iter < num_outer_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      /* Outside the inner loop, 20 writes an element which 30 later reads */
+      int num_outside = rand()%3;
+      for(int i = 0; i < num_outside; i++)
+        CAM_memSeenInstruction(20, 0, 0, 0, 0, (uintptr_t)&A[5], 8);
+      CAM_profileLoopInvocationStart(900);
+      for(int j = 0; j < num_iterations; j++){
+        CAM_profileLoopIterationStart();
+        CAM_memSeenInstruction(20, 0, 0, 0, 0, (uintptr_t)&A[j], 8);
+        CAM_memSeenInstruction(30, (uintptr_t)&A[j], 8, 0, 0, 0, 0);
+        CAM_memSeenInstruction(40, 0, 0, 0, 0, (uintptr_t)&B[j], 8);
+        if(j > 0)
+          CAM_memSeenInstruction(50, (uintptr_t)&B[j - 1], 8, 0, 0, 0, 0);
+      }
+      CAM_profileLoopInvocationEnd();
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_LOOP_PROFILE);
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  unsetenv("LIBCAM_MEM_TRACE_MAX_MEM_USAGE");
+  unsetenv("LIBCAM_LOOP_TRACE_LEVELS");
+
+  cout << "analysing level 1\n";
+  map<string, unsigned int> args;
+  args["level"] = 1;
+  args["deppairs"] = 1;
+  pair<set<uintptr_t>, uint64_t> instrListAndNumInvoc = parseLoopTraceForInstrList(args["level"]);
+  pair<set<uintptr_t>, set<uintptr_t>> callTraceList = parseCallTraceForInstrList(args["level"]);
+  StreamParseCallTrace callTraces = parseCallTrace(args["level"]);
+  dependence_analysis(args, callTraces, instrListAndNumInvoc.first, instrListAndNumInvoc.second, callTraceList.first, callTraceList.second);
+
+  cout << "verifying\n";
+  set<pair<uintptr_t, uintptr_t>> rw, ww;
+  rw.insert(pair<uintptr_t, uintptr_t>(40, 50));
+  pair<set<pair<uintptr_t, uintptr_t>>, set<pair<uintptr_t, uintptr_t>>> pairs = parse_dependence_pairs();
+  if(pairs.first != rw) { cout << "RAW/WAR dependence pairs mismatch\n"; abort(); }
+  if(pairs.second != ww) { cout << "WAW dependence pairs mismatch\n"; abort(); }
+
+  cout << "SUCCESS!\n";
+}
+
+string readWholeFile(string path){
+  ifstream f(path.c_str(), ios::binary);
+  return string((istreambuf_iterator<char>(f)), istreambuf_iterator<char>());
+}
+
+/* Trace the same loop into outputDirectory, either with CAM_memSeenInstruction
+ * or with CAM_mem followed by CAM_profileLoopSeenInstruction, and return the
+ * timeout stats of the memory and loop tracers */
+pair<string, string> fusedCallTrace(string outputDirectory, bool fused, int num_instructions){
+  int num_invocations = 20;
+  int num_iterations = 300;
+  vector<uint64_t> counts(num_instructions);
+
+  setenv("LIBCAM_OUTPUT_DIRECTORY", outputDirectory.c_str(), 1);
+  CAM_init(CAM_MEMORY_PROFILE);
+  CAM_init(CAM_LOOP_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      for(int i = 0; i < 200; i++){
+        uintptr_t ID = 1 + i%num_instructions;
+        uintptr_t addr = 0x100000*ID + 8*counts[ID - 1]++;
+        if(fused)
+          CAM_memSeenInstruction(ID, 0, 0, 0, 0, addr, 8);
+        else{
+          CAM_mem(ID, 0, 0, 0, 0, addr, 8);
+          CAM_profileLoopSeenInstruction(ID);
+        }
+      }
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  /* Both tracers write timeout_stats.csv */
+  CAM_shutdown(CAM_MEMORY_PROFILE);
+  string memoryStats = readWholeFile(outputDirectory + "/timeout_stats.csv");
+  CAM_shutdown(CAM_LOOP_PROFILE);
+  string loopStats = readWholeFile(outputDirectory + "/timeout_stats.csv");
+  unsetenv("LIBCAM_OUTPUT_DIRECTORY");
+  return pair<string, string>(memoryStats, loopStats);
+}
+
+/* CAM_memSeenInstruction leaves the same traces and timeout stats as the two
+ * calls it replaces, with a timeout that expires on the millionth operation
+ * of each tracer */
+void memSeenInstructionTimeoutTest(){
+  int num_instructions = 8;
+
+  cout << " ** Fused call timeout test **\n";
+
+  cout << "simulating traces\n";
+  setenv("LIBCAM_TIMEOUT", "-1", 1);
+  pair<string, string> separateStats = fusedCallTrace("separate_calls", false, num_instructions);
+  pair<string, string> fusedStats = fusedCallTrace("fused_calls", true, num_instructions);
+  unsetenv("LIBCAM_TIMEOUT");
+
+  cout << "verifying\n";
+  if(separateStats.first.find("\n-1,1,1000000,") == string::npos || separateStats.second.find("\n-1,1,1000000,") == string::npos){
+    cout << "Tracers did not time out\n";
+    abort();
+  }
+  if(fusedStats.first != separateStats.first) { cout << "Memory tracer timeout stats mismatch\n"; abort(); }
+  if(fusedStats.second != separateStats.second) { cout << "Loop tracer timeout stats mismatch\n"; abort(); }
+  vector<string> traces;
+  traces.push_back("loop_trace.txt.bz2");
+  traces.push_back("call_trace.txt.bz2");
+  for(int i = 0; i < num_instructions; i++)
+    traces.push_back("memory_accesses/memory_accesses." + to_string(1 + i) + ".w.txt.bz2");
+  for(auto t = traces.begin(); t != traces.end(); t++){
+    if(readWholeFile("fused_calls/" + *t) != readWholeFile("separate_calls/" + *t)){
+      cout << "Trace " << *t << " mismatch\n";
+      abort();
+    }
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+void dependenceTraceTest(){
+  int num_invocations = 5;
+  int num_iterations = 50;
+  static uint64_t X[64], Y[64], Z[64], S, T, U, V;
+  static uint32_t W[64];
+
+  cout << " ** Dependence trace test **\n";
+
+  cout << "simulating trace\n";
+  CAM_init(CAM_DEPENDENCE_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    vector<int> perm;
+    for(int i = 0; i < num_iterations; i++)
+      perm.push_back(i);
+    random_shuffle(perm.begin(), perm.end());
+    CAM_profileLoopInvocationStart(133);
+    for(int i = 0; i < num_iterations; i++){
+      CAM_profileLoopIterationStart();
+      /* RAW carried by the loop */
+      CAM_mem(10, 0, 0, 0, 0, (uintptr_t)&X[i], 8);
+      if(i > 0) CAM_mem(20, (uintptr_t)&X[i - 1], 8, 0, 0, 0, 0);
+      /* WAR carried by the loop */
+      CAM_mem(30, (uintptr_t)&Y[i + 1], 8, 0, 0, 0, 0);
+      CAM_mem(40, 0, 0, 0, 0, (uintptr_t)&Y[i], 8);
+      /* Irregular accesses within an iteration only */
+      CAM_mem(50, 0, 0, 0, 0, (uintptr_t)&Z[perm[i]], 8);
+      CAM_mem(60, (uintptr_t)&Z[perm[i]], 8, 0, 0, 0, 0);
+      /* WAW inside a call, attributed to the call */
+      CAM_profileCallInvocationStart(70);
+      CAM_mem(71, 0, 0, 0, 0, (uintptr_t)&S, 8);
+      CAM_profileCallInvocationEnd();
+      /* WAW of partially overlapping, unaligned accesses */
+      CAM_mem(90, 0, 0, 0, 0, (uintptr_t)&W[i], 8);
+      /* Dependences between invocations are not carried by the loop */
+      if(inv%2 == 0 && i == num_iterations - 1) CAM_mem(100, 0, 0, 0, 0, (uintptr_t)&T, 8);
+      if(inv%2 == 1 && i == 0) CAM_mem(110, (uintptr_t)&T, 8, 0, 0, 0, 0);
+      /* Every earlier writer and reader of a byte is a partner, not only the last */
+      if(i == 1){
+        CAM_mem(120, 0, 0, 0, 0, (uintptr_t)&U, 8);
+        CAM_mem(130, 0, 0, 0, 0, (uintptr_t)&U, 8);
+        CAM_mem(150, (uintptr_t)&V, 8, 0, 0, 0, 0);
+        CAM_mem(160, (uintptr_t)&V, 8, 0, 0, 0, 0);
+      }
+      if(i == 2){
+        CAM_mem(140, (uintptr_t)&U, 8, 0, 0, 0, 0);
+        CAM_mem(170, 0, 0, 0, 0, (uintptr_t)&V, 8);
+      }
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_DEPENDENCE_PROFILE);
+
+  cout << "verifying\n";
+  set<pair<uintptr_t, uintptr_t>> rw, ww;
+  rw.insert(pair<uintptr_t, uintptr_t>(10, 20));
+  rw.insert(pair<uintptr_t, uintptr_t>(40, 30));
+  rw.insert(pair<uintptr_t, uintptr_t>(120, 140));
+  rw.insert(pair<uintptr_t, uintptr_t>(130, 140));
+  rw.insert(pair<uintptr_t, uintptr_t>(170, 150));
+  rw.insert(pair<uintptr_t, uintptr_t>(170, 160));
+  ww.insert(pair<uintptr_t, uintptr_t>(70, 70));
+  ww.insert(pair<uintptr_t, uintptr_t>(90, 90));
+  pair<set<pair<uintptr_t, uintptr_t>>, set<pair<uintptr_t, uintptr_t>>> pairs = parse_dependence_pairs();
+  if(pairs.first != rw) { cout << "RAW/WAR dependence pairs mismatch\n"; abort(); }
+  if(pairs.second != ww) { cout << "WAW dependence pairs mismatch\n"; abort(); }
+
+  cout << "SUCCESS!\n";
+}
+
+void signatureTraceTest(){
+  int num_invocations = 5;
+  int num_iterations = 100;
+  static uint64_t A[8*128], B[8*128];
+
+  cout << " ** Signature trace test **\n";
+
+  cout << "simulating trace\n";
+  CAM_init(CAM_SIGNATURE_PROFILE);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    for(int i = 0; i < num_iterations; i++){
+      CAM_profileLoopIterationStart();
+      /* Each iteration uses its own cache line of A and B, and reads the line of A written by the previous iteration */
+      CAM_mem(10, 0, 0, 0, 0, (uintptr_t)&A[8*(i + 1)], 8);
+      CAM_mem(20, (uintptr_t)&A[8*i], 8, 0, 0, 0, 0);
+      CAM_mem(30, 0, 0, 0, 0, (uintptr_t)&B[8*i], 8);
+      CAM_mem(40, (uintptr_t)&B[8*i], 8, 0, 0, 0, 0);
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_SIGNATURE_PROFILE);
+
+  cout << "verifying\n";
+  ifstream f("suspected_dependences.txt");
+  uint64_t numRW, numWW, write, read, count;
+  f >> numRW >> write >> read >> count >> numWW;
+  if(numRW != 1 || write != 10 || read != 20 || count != (uint64_t)num_invocations*(num_iterations - 1) || numWW != 0){
+    cout << "Unexpected suspected dependences\n";
+    abort();
+  }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Trace a loop whose iterations repeat a body longer than the initial
+ * compression window, each iteration rotating the body so that none
+ * match, returns the size of the uncompressed loop trace */
+uint64_t compressionTunerTest_impl(){
+  int body_length = 120;
+  int num_repetitions = 3;
+  int num_iterations = 20*COMPRESSION_TUNER_EPOCH;
+
+  set<uintptr_t> ids;
+  vector<vector<map<uintptr_t, uint64_t>>> counts(1);
+  CAM_init(CAM_LOOP_PROFILE);
+  CAM_profileLoopInvocationStart(133);
+  for(int iter = 0; iter < num_iterations; iter++){
+    CAM_profileLoopIterationStart();
+    counts.back().push_back(map<uintptr_t, uint64_t>());
+    for(int rep = 0; rep < num_repetitions; rep++){
+      for(int i = 0; i < body_length; i++){
+        uintptr_t ID = 1000 + (i + iter)%body_length;
+        ids.insert(ID);
+        CAM_profileLoopSeenInstruction(ID);
+        counts.back().back()[ID]++;
+      }
+    }
+  }
+  CAM_profileLoopInvocationEnd();
+  CAM_shutdown(CAM_LOOP_PROFILE);
+
+  if(parseLoopTraceCounts(0, ids) != counts) { cout << "Loop trace mismatch\n"; abort(); }
+
+  FILE *fp = popen("bzcat loop_trace.txt.bz2 | wc -c", "r");
+  uint64_t size = 0;
+  if(fscanf(fp, "%" SCNu64, &size) != 1) abort();
+  pclose(fp);
+  return size;
+}
+
+void compressionTunerTest(){
+  cout << " ** Compression tuner test **\n";
+
+  setenv("LIBCAM_COMPRESSION_WINDOW_MIN", "50", 1);
+  setenv("LIBCAM_COMPRESSION_WINDOW_MAX", "50", 1);
+  setenv("LIBCAM_RECENT_ITER_MATCHES_MIN", "32", 1);
+  setenv("LIBCAM_RECENT_ITER_MATCHES_MAX", "32", 1);
+  uint64_t fixedSize = compressionTunerTest_impl();
+  unsetenv("LIBCAM_COMPRESSION_WINDOW_MIN");
+  unsetenv("LIBCAM_COMPRESSION_WINDOW_MAX");
+  unsetenv("LIBCAM_RECENT_ITER_MATCHES_MIN");
+  unsetenv("LIBCAM_RECENT_ITER_MATCHES_MAX");
+  uint64_t adaptedSize = compressionTunerTest_impl();
+  cout << "fixed trace size: " << fixedSize << " adapted trace size: " << adaptedSize << endl;
+  if(adaptedSize * 2 > fixedSize) { cout << "Adapting the window did not improve compression\n"; abort(); }
+
+  cout << "SUCCESS!\n";
+}
+
+/* Throttle a trace with a budget it can not meet, every traced iteration
+ * must be whole and the trace must match the coverage reported */
+void throttleTest(){
+  int num_invocations = 200;
+  int num_iterations = 20;
+  uintptr_t innerLoopID = 900, blockID = 50;
+  JITNINT droppedID = 6;
+  JITNINT block[] = {7, droppedID, 8};
+
+  cout << " ** Throttle test **\n";
+
+  cout << "simulating trace\n";
+  setenv("LIBCAM_THROTTLE_BUDGET", "1.01", 1);
+  setenv("LIBCAM_THROTTLE_SAMPLE_PERIOD", "1", 1);
+  setenv("LIBCAM_THROTTLE_DROP_INSTRUCTIONS", "6", 1);
+  set<uintptr_t> ids;
+  CAM_init(CAM_LOOP_PROFILE);
+  CAM_profileLoopRegisterBlock(blockID, block, 3);
+  for(int inv = 0; inv < num_invocations; inv++){
+    CAM_profileLoopInvocationStart(133);
+    for(int iter = 0; iter < num_iterations; iter++){
+      CAM_profileLoopIterationStart();
+      for(uintptr_t ID = 1; ID <= 5; ID++){
+        ids.insert(ID);
+        CAM_profileLoopSeenInstruction(ID);
+      }
+      CAM_profileLoopSeenInstruction(droppedID);
+      CAM_profileLoopSeenBlock(blockID);
+      CAM_profileCallInvocationStart(20);
+      CAM_profileLoopSeenInstruction(21);
+      CAM_profileCallInvocationEnd();
+      CAM_profileLoopInvocationStart(innerLoopID);
+      CAM_profileLoopIterationStart();
+      CAM_profileLoopSeenInstruction(100);
+      CAM_profileLoopInvocationEnd();
+    }
+    CAM_profileLoopInvocationEnd();
+  }
+  CAM_shutdown(CAM_LOOP_PROFILE);
+  unsetenv("LIBCAM_THROTTLE_BUDGET");
+  unsetenv("LIBCAM_THROTTLE_SAMPLE_PERIOD");
+  unsetenv("LIBCAM_THROTTLE_DROP_INSTRUCTIONS");
+
+  cout << "verifying\n";
+  ifstream f("throttle_stats.csv");
+  string line;
+  int level = 0;
+  getline(f, line);
+  while(getline(f, line) && !line.empty())
+    level = atoi(line.substr(line.rfind(',', line.rfind(',') - 1) + 1).c_str());
+  getline(f, line);
+  double budget;
+  uint64_t invocations, recordedInvocations, iterations, recordedIterations, droppedEvents;
+  char sep;
+  f >> budget >> sep >> invocations >> sep >> recordedInvocations >> sep >> iterations >> sep >> recordedIterations >> sep >> droppedEvents;
+  if(level != 3 || invocations != (uint64_t)num_invocations || iterations != (uint64_t)num_invocations*num_iterations
+      || recordedInvocations >= invocations || recordedIterations >= iterations || droppedEvents == 0){
+    cout << "Unexpected throttle stats\n";
+    abort();
+  }
+
+  /* Each iteration is whole, with or without the dropped instruction, which is also in the block */
+  ids.insert(droppedID);
+  ids.insert(7);
+  ids.insert(8);
+  ids.insert(innerLoopID);
+  map<uintptr_t, uint64_t> whole, dropped;
+  for(auto id : ids)
+    whole[id] = 1;
+  whole[droppedID] = 2;
+  dropped = whole;
+  dropped.erase(droppedID);
+  vector<vector<map<uintptr_t, uint64_t>>> counts = parseLoopTraceCounts(0, ids);
+  uint64_t numIterations = 0;
+  for(auto inv : counts){
+    for(auto iter : inv){
+      if(iter != whole && iter != dropped) { cout << "Partially traced iteration\n"; abort(); }
+      numIterations++;
+    }
+  }
+  if(counts.size() != recordedInvocations || numIterations != recordedIterations) { cout << "Trace does not match the coverage reported\n"; abort(); }
+
+  cout << "SUCCESS!\n";
+}
+
 void testCallTraceLarge(){
   srand(time(NULL));
   CAM_init(CAM_LOOP_PROFILE);
@@ -1013,6 +1964,34 @@ int main(int argc, char **argv){
       loopTraceRandomTest();
     if(args["random"] == 3)
       callTraceRandomTest();
+    if(args["random"] == 4)
+      memoryTraceIterationTagTest();
+    if(args["random"] == 5)
+      nestedLoopTraceTest();
+    if(args["random"] == 6)
+      dependenceTraceTest();
+    if(args["random"] == 7)
+      signatureTraceTest();
+    if(args["random"] == 8)
+      binaryTraceRandomTest();
+    if(args["random"] == 9)
+      compressionTunerTest();
+    if(args["random"] == 10)
+      throttleTest();
+    if(args["random"] == 11)
+      memoryTraceDedupTest();
+    if(args["random"] == 12)
+      memoryTraceEvictionTest();
+    if(args["random"] == 13)
+      memoryTraceConcurrentDecodeTest();
+    if(args["random"] == 14)
+      accessSummaryTest();
+    if(args["random"] == 15)
+      nestedLoopMemoryTraceTest();
+    if(args["random"] == 16)
+      memSeenInstructionTimeoutTest();
+    if(args["random"] == 17)
+      memoryTraceDeltaRunTest();
   }
   else
     testCallTrace();
@@ -22,12 +22,13 @@
 #include "cam_system.h"
 #include "dynamic_gcd.h"
 #include "TimeoutCounter.h"
-#include "IntervalTree.h"
 #include "MemoryTraceStreamer.h"
+#include "WorkerPool.h"
 #include <fstream>
 #include <list>
 #include <set>
 #include <assert.h>
+#include <stdlib.h>
 #include <algorithm>
 #include <xanlib.h>
 
@@ -39,6 +40,17 @@
 #define ptrToInt(ptr) ((JITNINT)(ptr))
 #define ptrToUint(ptr) ((JITNUINT)(ptr))
 
+/**
+ * Number of instruction pairs checked by each task of the parallel analysis.
+ **/
+#define PAIR_CHECKS_PER_TASK 8
+
+/**
+ * Number of invocations decoded ahead of the one being analysed, if
+ * LIBCAM_PIPELINE_DEPTH is not set.
+ **/
+#define DEFAULT_PIPELINE_DEPTH 2
+
 MemSetEntry &AliasRec::getSetA() const { return setA; }
 MemSetEntry &AliasRec::getSetB() const { return setB; }
 uintptr_t AliasRec::getInstrA() const { return instrA; }
@@ -368,6 +380,37 @@ void outputDependencePairs(set<pair<uintptr_t, uintptr_t>> &rw_dependence_pairs,
   outputFile.close();
 }
 
+/* Report the coverage of a trace throttled by the tracer, see throttle_stats.csv */
+void reportThrottledCoverage(){
+  ifstream inputFile("throttle_stats.csv");
+  if(!inputFile.is_open())
+    return;
+
+  /* The decisions, then a blank line, then the totals */
+  string line;
+  uint64_t numDecisions = 0;
+  getline(inputFile, line);
+  while(getline(inputFile, line) && !line.empty())
+    numDecisions++;
+  getline(inputFile, line);
+  double budget;
+  uint64_t invocations, recordedInvocations, iterations, recordedIterations, droppedEvents;
+  char sep;
+  if(!(inputFile >> budget >> sep >> invocations >> sep >> recordedInvocations >> sep
+        >> iterations >> sep >> recordedIterations >> sep >> droppedEvents)){
+    cerr << "Malformed throttle_stats.csv\n";
+    abort();
+  }
+  if(numDecisions == 0)
+    return;
+  cerr << "The trace was throttled (" << numDecisions << " changes of fidelity), it covers "
+       << recordedInvocations << " of " << invocations << " invocations and "
+       << recordedIterations << " of " << iterations << " iterations";
+  if(droppedEvents > 0)
+    cerr << ", with " << droppedEvents << " instruction events dropped";
+  cerr << ". Dependences outside this coverage are not found." << endl;
+}
+
 bool isAliasBruteForce(MemSetEntry& write, MemSetEntry& read){
   /* Brute force approach, check all possible combinations */
   for(uintptr_t j = 0; j < read.getNumInstances(); j++)
@@ -377,13 +420,30 @@ bool isAliasBruteForce(MemSetEntry& write, MemSetEntry& read){
   return false;
 }
 
+/* Alias test for accesses of different lengths, or not aligned to their length */
+bool isAliasUnaligned(MemSetEntry& write, MemSetEntry& read){
+  return dynamic_gcd_intervals(write.getBase(), write.getStride(), write.isNested() ? write.getRowLength() : write.getNumInstances(),
+                               write.getRowStride(), write.getNumRows(), write.getLength(),
+                               read.getBase(), read.getStride(), read.isNested() ? read.getRowLength() : read.getNumInstances(),
+                               read.getRowStride(), read.getNumRows(), read.getLength());
+}
+
 bool isAlias(MemSetEntry& write, MemSetEntry& read){
+  if(write.isNested() || read.isNested()){
+    if(write.getLength() != read.getLength() || !write.isAlignedPattern() || !read.isAlignedPattern())
+      return isAliasUnaligned(write, read);
+    return dynamic_gcd_nested(write.getBase(), write.getStride(), write.isNested() ? write.getRowLength() : write.getNumInstances(), 
+                              write.getRowStride(), write.getNumRows(),
+                              read.getBase(), read.getStride(), read.isNested() ? read.getRowLength() : read.getNumInstances(), 
+                              read.getRowStride(), read.getNumRows());
+  }
+
   if(write.getStride() == 0 && read.getStride() == 0)
     return true;
 
-  /* If accesses are different lengths or not aligned do brute force check */
-  if (write.getLength() != read.getLength() || !write.isAligned() || !read.isAligned()){
-    return isAliasBruteForce(write, read);
+  /* If accesses are different lengths or not aligned, check the distances between them */
+  if (write.getLength() != read.getLength() || !write.isAlignedPattern() || !read.isAlignedPattern()){
+    return isAliasUnaligned(write, read);
   }
 
   MemSetEntry normalWrite;
@@ -414,7 +474,10 @@ vector<AliasRec*> getAliasRecs(uintptr_t instrA, uintptr_t instrB, vector<pair<M
     MemSetEntry &write = msePair->first;
     MemSetEntry &read = msePair->second;
     if(bruteForceOnly || 
-        (write.getLength() != read.getLength() || !write.isAligned() || !read.isAligned())){
+        (write.getLength() != read.getLength() || !write.isAlignedPattern() || !read.isAlignedPattern())){
+      /* Only enumerate the clashes of patterns which do alias */
+      if(!isAlias(write, read))
+        continue;
       auto bruteForceResults = doBruteForceAliasAnalysis(write, read);
       if(bruteForceResults.size() > 0){
         aliases.push_back(new BruteForceAlias(instrA, write, instrB, read, bruteForceResults));
@@ -444,11 +507,11 @@ vector<AliasRec*> getAliasRecs(uintptr_t instrA, uintptr_t instrB, vector<pair<M
 }
 
 void recordOverlaps(vector<AccessMultiMap> &clashes, MemSetEntry &mentry, MemSetEntry::intervalTree *tree, uintptr_t id1, uintptr_t id2){
-  MemSetEntry::intervalVector overlaps;
+  vector<MemSetEntry *> overlaps;
   tree->findOverlapping(mentry.getLowerExtent(), mentry.getUpperExtent(), overlaps);
   vector<AccessRange> accessClashes;
-  for(MemSetEntry::intervalVector::iterator ivlIt = overlaps.begin(); ivlIt != overlaps.end(); ivlIt++)
-    accessClashes.push_back(AccessRange(id2, *(ivlIt->value)));
+  for(vector<MemSetEntry *>::iterator ivlIt = overlaps.begin(); ivlIt != overlaps.end(); ivlIt++)
+    accessClashes.push_back(AccessRange(id2, **ivlIt));
   if(accessClashes.size() > 0)
     clashes.push_back(AccessMultiMap(id1, mentry, accessClashes));
 }
@@ -458,11 +521,11 @@ vector<pair<MemSetEntry&, MemSetEntry&>> findClashes(uintptr_t instrA, uintptr_t
   MemSet &readsB = WAW ? memoryTraces[instrB].getWriteSet() : memoryTraces[instrB].getReadSet();
   MemSetEntry::intervalTree *writeTreeA = memoryTraces[instrA].getWriteTree();
   for(auto memIt = readsB.begin(); memIt != readsB.end(); memIt++){
-    MemSetEntry::intervalVector overlaps;
+    vector<MemSetEntry *> overlaps;
     writeTreeA->findOverlapping(memIt->getLowerExtent(), memIt->getUpperExtent(), overlaps);
     for(auto ivlIt = overlaps.begin(); ivlIt != overlaps.end(); ivlIt++){
-      if(ivlIt->value->getIterationNumber() != memIt->getIterationNumber())
-        clashes.push_back(pair<MemSetEntry&, MemSetEntry&>(*(ivlIt->value), *memIt));
+      if((*ivlIt)->getIterationNumber() != memIt->getIterationNumber())
+        clashes.push_back(pair<MemSetEntry&, MemSetEntry&>(**ivlIt, *memIt));
     }
   }
   return clashes;
@@ -627,199 +690,256 @@ uint64_t getNumInstancesInInvocation(uintptr_t id, InvocationGroupCfc& invocGrou
            : invocCallTrace.getNumInstances(id);
 }
 
-void invocation_analysis_memeff(InvocationGroupCfc &invocGroup, uint64_t invocNum, MemoryTrace &invMemoryTrace, 
-    map<pair<uintptr_t, bool>, MemoryTraceStreamer*>& memtraceStreamers, 
-    vector<uintptr_t> memtraceInstrList,
-    CallTraceLoopInvocationGroup &invocCallTrace, 
-    vector<pair<uintptr_t, uintptr_t>> &pairMenu, set<uintptr_t> &instrList, set<uintptr_t> callList, set<uintptr_t>subInstrList,
-    bool WAW, set<pair<uintptr_t, uintptr_t>> &dependence_pairs, map<string, unsigned int> &args){
+/* The check of an instruction pair in an invocation, and its result */
+struct PairCheck{
+  size_t menuIndex;
+  StaticInstRec *writer;
+  MemSet *reads;
+  bool removable;
+  vector<pair<uintptr_t, uintptr_t>> found;
+  bool remove;
+};
+
+/*
+ * Check for aliases between the write tree of the first instruction of a pair
+ * and the accesses of the second, in different iterations.  Only reads the
+ * memory trace, so pairs can be checked in parallel.
+ */
+void checkInstrPair(PairCheck &check, bool adjacent){
+  XanBitSet* iterationsWithAdjacentDependence = xanBitSet_new(1);
+
+  /* For each overlap in the tree, check if there is an alias and record it */
+  MemSetEntry::intervalTree *writeTreeA = check.writer->getWriteTree();
+  auto extent = [](MemSetEntry &read, uint64_t &lower, uint64_t &upper){
+    lower = read.getLowerExtent();
+    upper = read.getUpperExtent();
+  };
+  auto visit = [&](MemSetEntry &read, MemSetEntry *write){
+    if(write->getIterationNumber() == read.getIterationNumber())
+      return true;
+    /* Found an overlap, now check if it is an alias */
+    if(!isAlias(*write, read))
+      return true;
+    if(adjacent){
+      int64_t it1 = write->getIterationNumber();
+      int64_t it2 = read.getIterationNumber();
+      if(abs(it1 - it2) < 2){
+        xanBitSet_setBit(iterationsWithAdjacentDependence, write->getIterationNumber());
+        xanBitSet_setBit(iterationsWithAdjacentDependence, read.getIterationNumber());
+      }
+      return true;
+    }
+    /* Record dependence pair */
+    check.found.push_back(pair<uintptr_t, uintptr_t>(write->getEffectiveInstrID(), read.getEffectiveInstrID()));
+    /* If neither instruction was inside a call, remove pair from menu so it is not checked again */
+    if(check.removable){
+      check.remove = true;
+      return false;
+    }
+    return true;
+  };
+  writeTreeA->findOverlappingBatch(check.reads->begin(), check.reads->end(), extent, visit);
+
+  if(adjacent){
+    if(xanBitSet_getCountOfBitsSet(iterationsWithAdjacentDependence) != xanBitSet_length(iterationsWithAdjacentDependence))
+      check.remove = true;
+  }
+  xanBitSet_free(iterationsWithAdjacentDependence);
+}
 
-  /* Cache the number of instances of each instruction */
+/* An invocation read from the traces by the decoding stage, ready to be analysed */
+struct DecodedInvocation{
+  uint64_t invocNum;
+  bool empty;
+  bool repeated;
+  /* The memory accesses of this invocation */
+  MemoryTrace memoryTrace;
+  /* The number of instances of each instruction */
   map<uintptr_t, uint64_t> instructionInstances;
-  for(auto i = memtraceInstrList.begin(); i != memtraceInstrList.end(); i++){
-    instructionInstances[*i] = getNumInstancesInInvocation(*i, invocGroup, invocCallTrace, subInstrList);
+  /* Whether each instruction inside a call was always inside the same call */
+  map<uintptr_t, bool> constantCallIDs;
+};
+
+/*
+ * Remove the pairs of instructions whose accesses, summarised over the whole
+ * trace by the memory tracer, do not intersect.  Pairs of instructions
+ * without summaries, as in traces from before these were written, are kept.
+ */
+void prunePairMenuBySummaries(pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> &pairMenu,
+    const map<pair<uintptr_t, bool>, AccessSummary> &summaries){
+  if(summaries.empty())
+    return;
+  auto disjoint = [&summaries] (uintptr_t first, uintptr_t second, bool WAW) {
+    auto write = summaries.find(pair<uintptr_t, bool>(first, true));
+    auto other = summaries.find(pair<uintptr_t, bool>(second, WAW));
+    return write != summaries.end() && other != summaries.end() && !write->second.mayIntersect(other->second);
+  };
+  auto rwEnd = remove_if(pairMenu.first.begin(), pairMenu.first.end(),
+      [&disjoint] (const pair<uintptr_t, uintptr_t> &p) { return disjoint(p.first, p.second, false); });
+  auto wwEnd = remove_if(pairMenu.second.begin(), pairMenu.second.end(),
+      [&disjoint] (const pair<uintptr_t, uintptr_t> &p) { return disjoint(p.first, p.second, true); });
+  PDEBUG("Access summaries removed %zu RAW/WAR and %zu WAW pairs\n",
+      (size_t)(pairMenu.first.end() - rwEnd), (size_t)(pairMenu.second.end() - wwEnd));
+  pairMenu.first.erase(rwEnd, pairMenu.first.end());
+  pairMenu.second.erase(wwEnd, pairMenu.second.end());
+}
+
+/* Whether a pair of the menu reads the read or write trace of an instruction */
+bool isTraceInPairMenu(pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> &pairMenu,
+    uintptr_t id, bool write){
+  for(auto p = pairMenu.first.begin(); p != pairMenu.first.end(); p++){
+    if(write ? p->first == id : p->second == id)
+      return true;
+  }
+  for(auto p = pairMenu.second.begin(); write && p != pairMenu.second.end(); p++){
+    if(p->first == id || p->second == id)
+      return true;
   }
+  return false;
+}
+
+/*
+ * Get the memory trace chunks for an invocation of the instructions of each
+ * pair in turn, the streamers are read serially.
+ */
+void fetch_invocation_memeff(DecodedInvocation &inv, InvocationGroupCfc &invocGroup,
+    map<pair<uintptr_t, bool>, MemoryTraceStreamer*>& memtraceStreamers,
+    CallTraceLoopInvocationGroup &invocCallTrace,
+    vector<pair<uintptr_t, uintptr_t>> &pairMenu, set<uintptr_t> &subInstrList, bool WAW, bool levelZero){
 
-  /* Analyse each instruction pair in turn */
-  for(auto instrPair = pairMenu.begin(); instrPair != pairMenu.end();){
+  MemoryTrace &invMemoryTrace = inv.memoryTrace;
+  map<uintptr_t, uint64_t> &instructionInstances = inv.instructionInstances;
+  for(auto instrPair = pairMenu.begin(); instrPair != pairMenu.end(); instrPair++){
 
-    if(instructionInstances[instrPair->first] == 0 && instructionInstances[instrPair->second] == 0){
-      instrPair++;
+    if(instructionInstances[instrPair->first] == 0 && instructionInstances[instrPair->second] == 0)
       continue;
-    }
 
-    /* Get the memory trace chunk for this invocation and these instruction */
     PDEBUG("  Get memory trace chunk\n");
-    //uint64_t instrAInstances = getNumInstancesInInvocation(instrPair->first, invocGroup, invocCallTrace, subInstrList);
-    //uint64_t instrBInstances = getNumInstancesInInvocation(instrPair->second, invocGroup, invocCallTrace, subInstrList);
-    //uint64_t instrAInstances = instructionInstances[instrPair->first];
-    //uint64_t instrBInstances = instructionInstances[instrPair->second];
     if(!invMemoryTrace[instrPair->first].hasWriteSet()){
       MemSet slice = memtraceStreamers[pair<uintptr_t, bool>(instrPair->first, true)]->getNextChunk(instructionInstances[instrPair->first]);
       slice.initialiseSliceIterator();
-      invMemoryTrace[instrPair->first].setWriteSet(slice.getInvocationSliceWithIterTags(instrPair->first, invocGroup, 0, invocCallTrace));
+      invMemoryTrace[instrPair->first].setWriteSet(slice.getInvocationSliceWithIterTags(instrPair->first, invocGroup, 0, invocCallTrace, levelZero));
     }
     if(WAW){
       if(!invMemoryTrace[instrPair->second].hasWriteSet()){
         MemSet slice = memtraceStreamers[pair<uintptr_t, bool>(instrPair->second, true)]->getNextChunk(instructionInstances[instrPair->second]);
         slice.initialiseSliceIterator();
-        invMemoryTrace[instrPair->second].setWriteSet(slice.getInvocationSliceWithIterTags(instrPair->second, invocGroup, 0, invocCallTrace));
+        invMemoryTrace[instrPair->second].setWriteSet(slice.getInvocationSliceWithIterTags(instrPair->second, invocGroup, 0, invocCallTrace, levelZero));
       }
     }
     else{
       if(!invMemoryTrace[instrPair->second].hasReadSet()){
         MemSet slice = memtraceStreamers[pair<uintptr_t, bool>(instrPair->second, false)]->getNextChunk(instructionInstances[instrPair->second]);
         slice.initialiseSliceIterator();
-        invMemoryTrace[instrPair->second].setReadSet(slice.getInvocationSliceWithIterTags(instrPair->second, invocGroup, 0, invocCallTrace));
+        invMemoryTrace[instrPair->second].setReadSet(slice.getInvocationSliceWithIterTags(instrPair->second, invocGroup, 0, invocCallTrace, levelZero));
       }
     }
 
-#if 0
-    /* Get memory trace slice for these instructions */
-    PDEBUG("  Get memory trace slices\n");
-    MemoryTrace invMemoryTrace2;
-    if(!invMemoryTrace2.hasStaticInstRec(instrPair->first)){
-      invMemoryTrace2[instrPair->first] = masterMemoryTrace.getInvocationSliceWithIterTags(invocGroup, 0, invocCallTrace, instrPair->first);
-      //cout << instrPair->first << ": \n";
-      //invMemoryTrace2[instrPair->first].printWithIterInfo();
-    }
-    if(!invMemoryTrace2.hasStaticInstRec(instrPair->second)){
-      invMemoryTrace2[instrPair->second] = masterMemoryTrace.getInvocationSliceWithIterTags(invocGroup, 0, invocCallTrace, instrPair->second);
-      //cout << instrPair->second << ": \n";
-      //invMemoryTrace2[instrPair->second].printWithIterInfo();
-    }
-    cout << invMemoryTrace2 << endl;
-    cout << endl << endl << endl;
-#endif
+    /* Look up whether the instructions of the pair were inside the same call
+     * while the call trace of the invocation is at hand */
+    if(inv.repeated)
+      continue;
+    if(subInstrList.find(instrPair->first) != subInstrList.end())
+      inv.constantCallIDs[instrPair->first] = invocCallTrace.isConstantCallID(instrPair->first);
+    if(subInstrList.find(instrPair->second) != subInstrList.end())
+      inv.constantCallIDs[instrPair->second] = invocCallTrace.isConstantCallID(instrPair->second);
+  }
+}
 
-    /* For each instruction, build interval trees for read and write sets */
-    PDEBUG("  Build interval trees\n");
-    if(!invMemoryTrace[instrPair->first].hasWriteTree())
-      invMemoryTrace[instrPair->first].buildWriteTree();
-
-    XanBitSet* iterationsWithAdjacentDependence = xanBitSet_new(1);
-
-    /* For each overlap in the tree, check if there is an alias and record it */
-    PDEBUG("  Do alias checking\n");
-    //uint64_t totalOverlaps = 0, aliases = 0, sameIter = 0, diffIter = 0;
-    MemSet &readsB = WAW ? invMemoryTrace[instrPair->second].getWriteSet() : invMemoryTrace[instrPair->second].getReadSet();
-    MemSetEntry::intervalTree *writeTreeA = invMemoryTrace[instrPair->first].getWriteTree();
-    bool pairComplete = false;
-    for(auto memIt = readsB.begin(); memIt != readsB.end(); memIt++){
-      for(auto oiter = writeTreeA->overlapIteratorBegin(memIt->getLowerExtent(), memIt->getUpperExtent());
-               oiter != writeTreeA->overlapIteratorEnd();
-               oiter = writeTreeA->overlapIteratorNext(memIt->getLowerExtent(), memIt->getUpperExtent(), oiter)){
-        auto ivlIt = oiter.second;
-        //totalOverlaps++;
-        if(ivlIt->value->getIterationNumber() != memIt->getIterationNumber()){
-          /* Found an overlap, now check if it is an alias */
-          if(isAlias(*(ivlIt->value), *memIt)){
-            //aliases++;
-            if(args["adjacent"]){
-              int64_t it1 = ivlIt->value->getIterationNumber();
-              int64_t it2 = memIt->getIterationNumber();
-              if(abs(it1 - it2) < 2){
-                xanBitSet_setBit(iterationsWithAdjacentDependence, ivlIt->value->getIterationNumber());
-                xanBitSet_setBit(iterationsWithAdjacentDependence, memIt->getIterationNumber());
-              }
-            }
-            else{
-              /* Record dependence pair */
-              recordDependencePair(ivlIt->value->getEffectiveInstrID(), memIt->getEffectiveInstrID(), dependence_pairs, WAW);
-              /* If neither instruction was inside a call, remove pair from menu so it is not checked again */
-              if((subInstrList.find(instrPair->first) == subInstrList.end() || invocCallTrace.isConstantCallID(instrPair->first)) && 
-                 (subInstrList.find(instrPair->second) == subInstrList.end() || invocCallTrace.isConstantCallID(instrPair->second))){
-                instrPair = pairMenu.erase(instrPair);
-                pairComplete = true;
-                break;
-              }
-            }
-          }
-          //else
-          //  diffIter++;
-        }
-        //else
-        //  sameIter++;
-      }
-      if(pairComplete)
-        break;
-    }
-    //cout << "totalOverlaps: " << totalOverlaps << ", aliases: " << aliases << ", sameIter: " << sameIter << ", diffIter: " << diffIter << endl;
-
-    if(args["adjacent"]){
-      if(xanBitSet_getCountOfBitsSet(iterationsWithAdjacentDependence) != xanBitSet_length(iterationsWithAdjacentDependence)){
-        //cout << "Erasing pair " << instrPair->first << ", " << instrPair->second << endl;
-        //cout << xanBitSet_getCountOfBitsSet(iterationsWithAdjacentDependence) << ", " << xanBitSet_length(iterationsWithAdjacentDependence) << endl;
-        instrPair = pairMenu.erase(instrPair);
-        pairComplete = true;
-      }
-      //else
-      //  cout << "Keeping pair " << instrPair->first << ", " << instrPair->second << endl;
-    }
-    xanBitSet_free(iterationsWithAdjacentDependence);
+/* The write trees of each instruction, kept from the last invocation that built them */
+typedef map<uintptr_t, MemSetEntry::intervalTree *> WriteTreeCache;
 
-    if(!pairComplete)
-      instrPair++;
+void invocation_analysis_memeff(DecodedInvocation &inv, vector<pair<uintptr_t, uintptr_t>> &pairMenu, set<uintptr_t> &subInstrList,
+    bool WAW, set<pair<uintptr_t, uintptr_t>> &dependence_pairs, WriteTreeCache &writeTrees, map<string, unsigned int> &args){
 
-#if 0
+  /* An invocation repeating an earlier one, shifted in memory, has the same
+   * aliases, which have been recorded, only its memory trace was read */
+  if(inv.repeated)
+    return;
 
-    /* Find all address range clashes (rw_clashes, ww_clashes) */
-    PDEBUG("  Find clashes\n");
-    vector<pair<MemSetEntry&, MemSetEntry&>> clashes = findClashes(instrPair->first, instrPair->second, invMemoryTrace, WAW); 
-    if(clashes.empty()){
-      instrPair++;
+  MemoryTrace &invMemoryTrace = inv.memoryTrace;
+  bool adjacent = args["adjacent"];
+  vector<PairCheck> checks;
+  for(size_t pairIndex = 0; pairIndex < pairMenu.size(); pairIndex++){
+    pair<uintptr_t, uintptr_t> *instrPair = &pairMenu[pairIndex];
+
+    if(inv.instructionInstances[instrPair->first] == 0 && inv.instructionInstances[instrPair->second] == 0)
       continue;
-    }
-    //for(auto c = clashes.begin(); c != clashes.end(); c++) {
-    //  cout << instrPair->first << ": "; c->first.printWithIterInfo(); 
-    //  cout << instrPair->second << ": "; c->second.printWithIterInfo(); 
-    //  cout << endl;
-    //}
-    //printClashes(clashes.first);
-
-    /* Find alias patterns in overlapping address ranges */
-    PDEBUG("  Get alias recs\n");
-    vector<AliasRec*> aliases = getAliasRecs(instrPair->first, instrPair->second, clashes, args["bruteforce"]);
-    clashes.clear();
-    //for(auto a = rw_aliases.begin(); a != rw_aliases.end(); a++){
-    //  cout << **a << endl;
-    //  cout << (**a).getSetA() << " " << (**a).getSetB() << endl;
-    //}
-    //if(rw_aliases.size() > 0) exit(0);
-
-    //for(auto invocGroup = rw_aliases.begin(); invocGroup != rw_aliases.end(); invocGroup++)
-    //  cout << **invocGroup << endl;
-    //for(auto invocGroup = ww_aliases.begin(); invocGroup != ww_aliases.end(); invocGroup++)
-    //  cout << **invocGroup << endl;
-
-    /* If we are running the check mode, output aliases related to the check instructions */
-    if(args["check"] != 0){
-      for(auto a = aliases.begin(); a != aliases.end(); a++){
-        if(((**a).getSetA().getEffectiveInstrID() == args["check"] && (**a).getSetB().getEffectiveInstrID() == args["checkarg"]) ||
-           ((**a).getSetA().getEffectiveInstrID() == args["checkarg"] && (**a).getSetB().getEffectiveInstrID() == args["check"]))
-          cout << **a << endl;
-      }
-    }
 
-    if(aliases.size() > 0){
-      /* Add any new dependence pairs to the sets */
-      PDEBUG("  Add new dependence pairs\n");
-      recordDependencePairs(instrPair->first, instrPair->second, aliases, dependence_pairs, WAW, subInstrList);
+    /* Pairs whose pages in this invocation do not meet have no overlaps to look up in the
+     * tree, though the adjacent mode needs the check of every pair to update the menu */
+    AccessSummary &readSummary = WAW ? invMemoryTrace[instrPair->second].getWriteSummary() : invMemoryTrace[instrPair->second].getReadSummary();
+    if(!adjacent && !invMemoryTrace[instrPair->first].getWriteSummary().mayIntersect(readSummary))
+      continue;
 
-      /* Remove these instructions from the menu so they will not be checked again */
-      if(subInstrList.find(instrPair->first) == subInstrList.end() && subInstrList.find(instrPair->second) == subInstrList.end())
-        instrPair = pairMenu.erase(instrPair);
-      else
-        instrPair++;
+    PairCheck check;
+    check.menuIndex = pairIndex;
+    check.writer = &invMemoryTrace[instrPair->first];
+    check.reads = WAW ? &invMemoryTrace[instrPair->second].getWriteSet() : &invMemoryTrace[instrPair->second].getReadSet();
+    /* If neither instruction was inside a call, the pair is removed from the menu once a dependence is found */
+    check.removable = (subInstrList.find(instrPair->first) == subInstrList.end() || inv.constantCallIDs[instrPair->first]) && 
+                      (subInstrList.find(instrPair->second) == subInstrList.end() || inv.constantCallIDs[instrPair->second]);
+    check.remove = false;
+    checks.push_back(check);
+  }
+  if(checks.empty())
+    return;
+
+  /* Group the pairs by write instruction, so that each write tree is built once and shared */
+  map<uintptr_t, vector<PairCheck *>> checksByWriter;
+  for(auto check = checks.begin(); check != checks.end(); check++)
+    checksByWriter[pairMenu[check->menuIndex].first].push_back(&*check);
+
+  /* For each instruction, build interval trees for write sets.  The tree of
+   * an earlier invocation is updated rather than built again, which is cheap
+   * while the instruction writes to the same, or shifted, addresses */
+  PDEBUG("  Build interval trees\n");
+  WorkerPool& pool = WorkerPool::shared();
+  vector<future<void>> tasks;
+  for(auto writer = checksByWriter.begin(); writer != checksByWriter.end(); writer++){
+    StaticInstRec *rec = writer->second.front()->writer;
+    if(rec->hasWriteTree())
+      continue;
+    MemSetEntry::intervalTree *previous = NULL;
+    auto cached = writeTrees.find(writer->first);
+    if(cached != writeTrees.end()){
+      previous = cached->second;
+      writeTrees.erase(cached);
     }
-    else 
-      instrPair++;
-
-    
-    /* Cleanup */
-    freeAliasMemory(aliases);
-#endif
+    tasks.push_back(pool.submit([rec, previous](){ rec->buildWriteTree(previous); }));
+  }
+  for(auto task = tasks.begin(); task != tasks.end(); task++)
+    pool.wait(*task);
+  tasks.clear();
+
+  /* Check the pairs in parallel, in small batches so idle threads pick up the remaining work */
+  PDEBUG("  Do alias checking\n");
+  for(auto writer = checksByWriter.begin(); writer != checksByWriter.end(); writer++){
+    vector<PairCheck *>& group = writer->second;
+    for(size_t first = 0; first < group.size(); first += PAIR_CHECKS_PER_TASK){
+      vector<PairCheck *> batch(group.begin() + first, group.begin() + min(group.size(), first + PAIR_CHECKS_PER_TASK));
+      tasks.push_back(pool.submit([batch, adjacent](){
+        for(auto check = batch.begin(); check != batch.end(); check++)
+          checkInstrPair(**check, adjacent);
+      }));
+    }
+  }
+  for(auto task = tasks.begin(); task != tasks.end(); task++)
+    pool.wait(*task);
+
+  /* Record the dependences and update the menu in menu order, so the output does not depend on scheduling */
+  vector<bool> remove(pairMenu.size(), false);
+  for(auto check = checks.begin(); check != checks.end(); check++){
+    for(auto dep = check->found.begin(); dep != check->found.end(); dep++)
+      recordDependencePair(dep->first, dep->second, dependence_pairs, WAW);
+    remove[check->menuIndex] = check->remove;
   }
+  size_t kept = 0;
+  for(size_t pairIndex = 0; pairIndex < pairMenu.size(); pairIndex++){
+    if(!remove[pairIndex])
+      pairMenu[kept++] = pairMenu[pairIndex];
+  }
+  pairMenu.resize(kept);
 }
 
 void endOfInvocationCleanup(StreamParseLoopRec& sloop, list<LoopTraceEntry>::iterator sloopIterator, InvocationGroupCfc *i, uint64_t invocNum){
@@ -827,6 +947,117 @@ void endOfInvocationCleanup(StreamParseLoopRec& sloop, list<LoopTraceEntry>::ite
     sloopIterator = sloop.erase(sloopIterator);
 }
 
+/*
+ * The first stage of the analysis, reads each invocation from the loop, call
+ * and memory traces in turn and slices out its memory accesses.  Only the
+ * instructions of the pairs still on the menus are sliced, the second stage
+ * passes the menus back as it removes pairs.
+ */
+class InvocationDecoder{
+  StreamParseLoopRec sloop;
+  StreamParseLoopRec::invocation_iterator invi;
+  bool started;
+  StreamParseCallTrace &callTraces;
+  set<uintptr_t> &instrList;
+  set<uintptr_t> &callList;
+  set<uintptr_t> &subInstrList;
+  vector<uintptr_t> &memtraceInstrList;
+  map<pair<uintptr_t, bool>, MemoryTraceStreamer*> &memtraceStreamers;
+  set<uint64_t> &repeatedInvocations;
+  bool levelZero;
+
+  /* Empty call trace for when there is no call trace */
+  CallTraceLoopInvocationGroup emptyCallTrace;
+
+  /* A running count of instructions processed from the call trace, 
+   * this makes it easier to build the call trace cache later */
+  map<uintptr_t, uint64_t> subInstrRunningCount;
+
+  /* Dynamic instruction counts (count how many instances we've accounted for so far) */
+  map<uintptr_t, uint64_t> instrCounts;
+
+  /* The pairs still to be checked, shared with the second stage */
+  mutex menuLock;
+  pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> pairMenu;
+
+public:
+  InvocationDecoder(unsigned int level, StreamParseCallTrace &_callTraces,
+      set<uintptr_t> &_instrList, set<uintptr_t> &_callList, set<uintptr_t> &_subInstrList,
+      vector<uintptr_t> &_memtraceInstrList, map<pair<uintptr_t, bool>, MemoryTraceStreamer*> &_memtraceStreamers,
+      set<uint64_t> &_repeatedInvocations,
+      pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> &_pairMenu)
+    : sloop(level), started(false), callTraces(_callTraces), instrList(_instrList), callList(_callList), subInstrList(_subInstrList),
+      memtraceInstrList(_memtraceInstrList), memtraceStreamers(_memtraceStreamers), repeatedInvocations(_repeatedInvocations),
+      levelZero(level == 0), pairMenu(_pairMenu) {
+    for(auto i = subInstrList.begin(); i != subInstrList.end(); i++)
+      subInstrRunningCount[*i] = 0;
+    for(auto i = instrList.begin(); i != instrList.end(); i++)
+      instrCounts[*i] = 0;
+  }
+
+  /* Called by the second stage when pairs have been removed from the menus */
+  void updatePairMenu(pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> &menu){
+    unique_lock<mutex> guard(menuLock);
+    pairMenu = menu;
+  }
+
+  /* Decode the next invocation, returns NULL when there are no more */
+  DecodedInvocation *next(){
+    if(!started){
+      invi = sloop.ii_begin();
+      started = true;
+    }
+    else
+      invi = sloop.ii_next(invi);
+    if(invi == sloop.ii_end())
+      return NULL;
+
+    DecodedInvocation *inv = new DecodedInvocation;
+    inv->invocNum = invi.second;
+    inv->repeated = repeatedInvocations.count(inv->invocNum) > 0;
+    InvocationGroupCfc& invGroup = *invi.first->getInvocationGroupPointer();
+    inv->empty = invGroup.isEmpty();
+    if(inv->empty)
+      return inv;
+
+    /* Get the slice of the call trace relating to this invocation */
+    PDEBUG("Get call trace slice\n");
+    CallTraceLoopInvocationGroup* invocCallTrace;
+    if(!callTraces.empty())
+      invocCallTrace = &callTraces.getInvocCallTraceFromInvocNumber(inv->invocNum);
+    else
+      invocCallTrace = &emptyCallTrace;
+
+    /* Build cache to make looking up callId from from instrId more efficient */
+    if(!invocCallTrace->isCallTraceCacheBuilt())
+      invocCallTrace->buildCallTraceCache(invGroup, subInstrRunningCount, callList);
+
+    /* Cache the number of instances of each instruction */
+    for(auto i = memtraceInstrList.begin(); i != memtraceInstrList.end(); i++)
+      inv->instructionInstances[*i] = getNumInstancesInInvocation(*i, invGroup, *invocCallTrace, subInstrList);
+
+    /* Read the accesses needed for RAW/WAR analysis and WAW analysis in turn */
+    pair<vector<pair<uintptr_t, uintptr_t>>, vector<pair<uintptr_t, uintptr_t>>> menu;
+    {
+      unique_lock<mutex> guard(menuLock);
+      menu = pairMenu;
+    }
+    fetch_invocation_memeff(*inv, invGroup, memtraceStreamers, *invocCallTrace, menu.first, subInstrList, false, levelZero);
+    fetch_invocation_memeff(*inv, invGroup, memtraceStreamers, *invocCallTrace, menu.second, subInstrList, true, levelZero);
+
+    /* The accesses of a repeated invocation are read only to keep the streamers in step */
+    if(inv->repeated)
+      inv->memoryTrace.clear();
+
+    /* Update the instruction counts */
+    for(auto instr = instrList.begin(); instr != instrList.end(); instr++){
+      instrCounts[*instr] += invGroup.getNumInstances(*instr);
+    }
+
+    return inv;
+  }
+};
+
 void loop_analysis_memeff(map<string, unsigned int> &args, StreamParseCallTrace& callTraces, 
     set<uintptr_t> instrList, set<uintptr_t> callList, set<uintptr_t> subInstrList, uint64_t numInvocations){
  
@@ -860,38 +1091,45 @@ void loop_analysis_memeff(map<string, unsigned int> &args, StreamParseCallTrace&
     pairMenu = buildInstrPairMenu(instrList, subInstrList, memtraceInstrIDs);
   //printInstrPairMenu(pairMenu);
 
-  /* Empty call trace for when there is no call trace */
-  CallTraceLoopInvocationGroup emptyCallTrace;
-
   /* Sparse MemSetEntries with large strides are likely to cause false clashes, split these entries */
   //memoryTrace.splitLargeStrides();
 
-  /* Create a map to save a running count of instructions processed from the call trace, 
-   * this makes it easier to build the call trace cache later */
-  map<uintptr_t, uint64_t> subInstrRunningCount;
-  for(auto i = subInstrList.begin(); i != subInstrList.end(); i++)
-    subInstrRunningCount[*i] = 0;
-
   callTraces.buildLuts();
 
   ///* Initialise iterators for slicing out invocations from the memory trace */
   //memoryTrace.initialiseSliceIterators();
 
-  /* Create the memory trace streamers */
+  /* Drop the pairs whose accesses over the whole trace cannot meet */
+  if(!args["adjacent"])
+    prunePairMenuBySummaries(pairMenu, parse_access_summaries());
+
+  /* Create the memory trace streamers, of the traces read by the pairs left */
   map<pair<uintptr_t, bool>, MemoryTraceStreamer*> memtraceStreamers;
-  for(auto i = memtraceInstrIDs.first.begin(); i != memtraceInstrIDs.first.end(); i++)
-    memtraceStreamers[pair<uintptr_t, bool>(*i, false)] = new MemoryTraceStreamer(*i, "memory_accesses/memory_accesses." + to_string(*i) + ".r.txt.bz2",false);
-  for(auto i = memtraceInstrIDs.second.begin(); i != memtraceInstrIDs.second.end(); i++)
-    memtraceStreamers[pair<uintptr_t, bool>(*i, true)] = new MemoryTraceStreamer(*i, "memory_accesses/memory_accesses." + to_string(*i) + ".w.txt.bz2",true);
+  for(auto i = memtraceInstrIDs.first.begin(); i != memtraceInstrIDs.first.end(); i++){
+    if(isTraceInPairMenu(pairMenu, *i, false))
+      memtraceStreamers[pair<uintptr_t, bool>(*i, false)] = new MemoryTraceStreamer(*i, "memory_accesses/memory_accesses." + to_string(*i) + ".r.txt.bz2",false);
+  }
+  for(auto i = memtraceInstrIDs.second.begin(); i != memtraceInstrIDs.second.end(); i++){
+    if(isTraceInPairMenu(pairMenu, *i, true))
+      memtraceStreamers[pair<uintptr_t, bool>(*i, true)] = new MemoryTraceStreamer(*i, "memory_accesses/memory_accesses." + to_string(*i) + ".w.txt.bz2",true);
+  }
 
-  /* Create a map of dynamic instruction counts (count how many instances we've accounted for so far */
-  map<uintptr_t, uint64_t> instrCounts;
-  for(auto i = instrList.begin(); i != instrList.end(); i++)
-    instrCounts[*i] = 0;
+  /* The loop trace of the level does not count the instances made outside its loops */
+  auto outsideInstances = parse_outside_instances(args["level"]);
+  for(auto i = outsideInstances.begin(); i != outsideInstances.end(); i++){
+    auto streamer = memtraceStreamers.find(i->first);
+    if(streamer != memtraceStreamers.end())
+      streamer->second->setSkippedInstances(i->second);
+  }
 
   /* Create a TimeoutCounter to record percentage of analysis completed at timeout */
   TimeoutCounter timeoutCounter;
 
+  /* Invocations found by the memory tracer to repeat earlier ones (see LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS) */
+  set<uint64_t> repeatedInvocations;
+  if(args["level"] == 0)
+    repeatedInvocations = parse_repeated_invocations();
+
 
 #if 0
   // TODO Move this stuff to a separate function (probably should be part of StreamParseLoopRec)
@@ -950,16 +1188,55 @@ void loop_analysis_memeff(map<string, unsigned int> &args, StreamParseCallTrace&
       break;
 #endif
 
-  StreamParseLoopRec sloop;
+  /* Invocations are decoded by a thread of their own, up to LIBCAM_PIPELINE_DEPTH
+   * invocations ahead of the analysis, so reading the traces overlaps with the
+   * alias checks.  Only the decoding stage reads the traces.  With a depth of 0
+   * each invocation is decoded just before it is analysed */
+  InvocationDecoder decoder(args["level"], callTraces, instrList, callList, subInstrList,
+      memtraceInstrList, memtraceStreamers, repeatedInvocations, pairMenu);
+  unsigned int pipelineDepth = DEFAULT_PIPELINE_DEPTH;
+  char *env = getenv("LIBCAM_PIPELINE_DEPTH");
+  if(env)
+    pipelineDepth = atoi(env);
+  BoundedQueue<DecodedInvocation *> decoded(max(pipelineDepth, 1u));
+  thread decodeStage;
+  if(pipelineDepth > 0){
+    decodeStage = thread([&decoder, &decoded](){
+      DecodedInvocation *inv;
+      while((inv = decoder.next()) != NULL){
+        if(!decoded.push(inv)){
+          delete inv;
+          break;
+        }
+      }
+      decoded.close();
+    });
+  }
+
+  WriteTreeCache writeTrees;
   uint64_t invocNum = -1;
-  for(auto invi = sloop.ii_begin(); invi != sloop.ii_end(); invi = sloop.ii_next(invi)){
-    invocNum = invi.second;
-    InvocationGroupCfc& invGroup = *invi.first->getInvocationGroupPointer();
+  while(true){
+    DecodedInvocation *inv;
+    if(pipelineDepth > 0){
+      if(!decoded.pop(inv))
+        break;
+    }
+    else if((inv = decoder.next()) == NULL)
+      break;
+    invocNum = inv->invocNum;
 
     /* Check for timeouts */
     timeoutCounter.checkTime();
     if(timeoutCounter.isTimedOut()){
       timeoutCounter.dumpStats("cam_timeout_stats.csv", invocNum, numInvocations);
+      /* Stop the decoding stage first, it is using the streamers */
+      if(pipelineDepth > 0){
+        decoded.close();
+        decodeStage.join();
+      }
+      /* Their prefetches run on the WorkerPool and use the parser pools, which exit destroys */
+      for(auto s = memtraceStreamers.begin(); s != memtraceStreamers.end(); s++)
+        delete s->second;
       exit(0);
     }
 
@@ -971,42 +1248,28 @@ void loop_analysis_memeff(map<string, unsigned int> &args, StreamParseCallTrace&
         cout << "CAM: Invocation " << invocNum << " of " << numInvocations << endl;
     }
 
-    if(invGroup.isEmpty()){
-      //endOfInvocationCleanup(sloop, sloopIterator, i, invocNum);
-      //invocNum++;
-      continue;
-    }
+    if(!inv->empty){
+      /* Do RAW/WAR analysis and WAW analysis in turn */
+      size_t menuSize = pairMenu.first.size() + pairMenu.second.size();
+      invocation_analysis_memeff(*inv, pairMenu.first, subInstrList, false, rw_dependence_pairs, writeTrees, args);
+      invocation_analysis_memeff(*inv, pairMenu.second, subInstrList, true, ww_dependence_pairs, writeTrees, args);
 
-    //i->printNumInstancesLut();
+      /* The decoding stage need not read the accesses of pairs which have been removed */
+      if(pairMenu.first.size() + pairMenu.second.size() != menuSize)
+        decoder.updatePairMenu(pairMenu);
 
-    /* Get the slice of the call trace relating to this invocation */
-    PDEBUG("Get call trace slice\n");
-    CallTraceLoopInvocationGroup* invocCallTrace;
-    if(!callTraces.empty())
-      invocCallTrace = &callTraces.getInvocCallTraceFromInvocNumber(invocNum);
-    else
-      invocCallTrace = &emptyCallTrace;
-
-    /* Build cache to make looking up callId from from instrId more efficient */
-    if(!invocCallTrace->isCallTraceCacheBuilt())
-      invocCallTrace->buildCallTraceCache(invGroup, subInstrRunningCount, callList);
-
-    /* Create a memory trace to store this invocation's memory accesses */
-    MemoryTrace invMemoryTrace;
-
-    /* Do RAW/WAR analysis and WAW analysis in turn */
-    invocation_analysis_memeff(invGroup, invocNum, invMemoryTrace, memtraceStreamers, memtraceInstrList, *invocCallTrace, pairMenu.first, instrList, callList, subInstrList, false, rw_dependence_pairs, args);
-    invocation_analysis_memeff(invGroup, invocNum, invMemoryTrace, memtraceStreamers, memtraceInstrList, *invocCallTrace, pairMenu.second, instrList, callList, subInstrList, true, ww_dependence_pairs, args);
-
-    /* Update the instruction counts */
-    for(auto instr = instrList.begin(); instr != instrList.end(); instr++){
-      instrCounts[*instr] += invGroup.getNumInstances(*instr);
+      /* Keep the write trees for the next invocation */
+      for(auto rec = inv->memoryTrace.begin(); rec != inv->memoryTrace.end(); rec++){
+        if(rec->second.hasWriteTree())
+          writeTrees[rec->first] = rec->second.releaseWriteTree();
+      }
     }
-
-    //endOfInvocationCleanup(sloop, sloopIterator, i, invocNum);
-
-    //invocNum++;
+    delete inv;
   }
+  if(pipelineDepth > 0)
+    decodeStage.join();
+  for(auto tree = writeTrees.begin(); tree != writeTrees.end(); tree++)
+    delete tree->second;
 
   assert(invocNum + 1 == numInvocations);
 
@@ -1032,5 +1295,6 @@ void loop_analysis_memeff(map<string, unsigned int> &args, StreamParseCallTrace&
 void dependence_analysis(map<string, unsigned int> &args, StreamParseCallTrace &callTraces, 
     set<uintptr_t> instrList, uint64_t numInvocations, set<uintptr_t> callList, set<uintptr_t> subInstrList){
 
+  reportThrottledCoverage();
   loop_analysis_memeff(args, callTraces, instrList, callList, subInstrList, numInvocations);
 }
@@ -79,6 +79,11 @@ void dependence_analysis(map<string, unsigned int> &args, StreamParseCallTrace &
 //vector<uintptr_t> getInstructionIDs(MemoryTrace &memoryTrace, StaticLoopRec &loop, CallTraces &callTraces);
 
 
+/* Returns true if any access of write overlaps any access of read */
+bool isAlias(MemSetEntry& write, MemSetEntry& read);
+bool isAliasBruteForce(MemSetEntry& write, MemSetEntry& read);
+
 void outputDependencePairs(set<pair<uintptr_t, uintptr_t>> &rw_dependence_pairs, set<pair<uintptr_t, uintptr_t>> &ww_dependence_pairs);
+void reportThrottledCoverage();
 
 #endif
@@ -78,3 +78,131 @@ AliasT dynamic_gcd(uintptr_t low1, uintptr_t low2, uintptr_t high1, uintptr_t hi
   return AliasT(low2 + offset, lcm, count);
 }
 
+/*
+ * Floor and ceiling of n/d for d > 0
+ */
+static int64_t floor_div(int64_t n, int64_t d){
+  return n >= 0 ? n/d : -((-n + d - 1)/d);
+}
+
+static int64_t ceil_div(int64_t n, int64_t d){
+  return n >= 0 ? (n + d - 1)/d : -((-n)/d);
+}
+
+/*
+ * Reverse negative strides and collapse degenerate levels so that both strides are positive
+ * or the level has a single element
+ */
+static void normalise_nested(int64_t &base, int64_t &stride, int64_t &count, int64_t &rowStride, int64_t &numRows){
+  if(count <= 1 || stride == 0){ count = 1; stride = 0; }
+  if(numRows <= 1 || rowStride == 0){ numRows = 1; rowStride = 0; }
+  if(stride < 0){ base += stride*(count - 1); stride = -stride; }
+  if(rowStride < 0){ base += rowStride*(numRows - 1); rowStride = -rowStride; }
+}
+
+/*
+ * Returns true if the single level patterns (low1, stride1, count1) and (low2, stride2, count2)
+ * share an address, by solving low1 + i*stride1 == low2 + j*stride2 for the first solution
+ * inside the overlapping range.
+ */
+static bool rows_alias(int64_t low1, int64_t stride1, int64_t count1, int64_t low2, int64_t stride2, int64_t count2){
+  int64_t high1 = low1 + stride1*(count1 - 1);
+  int64_t high2 = low2 + stride2*(count2 - 1);
+  int64_t low = max(low1, low2), high = min(high1, high2);
+  if(low > high)
+    return false;
+  if(count1 == 1 || count2 == 1){
+    if(count1 == 1 && count2 == 1)
+      return low1 == low2;
+    if(count1 == 1)
+      return (low1 - low2)%stride2 == 0;
+    return (low2 - low1)%stride1 == 0;
+  }
+  int64_t gcd = euclid_gcd(stride1, stride2);
+  int64_t delta = low2 - low1;
+  if(delta%gcd != 0)
+    return false;
+  /* i = (delta/gcd) * inverse(stride1/gcd) mod (stride2/gcd) */
+  int64_t m = stride2/gcd;
+  __int128 inverse = extended_euclid(stride1/gcd, m).first;
+  __int128 i = ((((__int128)(delta/gcd))%m)*inverse)%m;
+  if(i < 0)
+    i += m;
+  int64_t lcm = (stride1/gcd)*stride2;
+  int64_t first = low1 + (int64_t)(i)*stride1;
+  /* Move the first solution to the lowest solution >= low */
+  first += ceil_div(low - first, lcm)*lcm;
+  return first <= high;
+}
+
+bool dynamic_gcd_nested(uintptr_t base1, intptr_t stride1, uint64_t count1, intptr_t rowStride1, uint64_t numRows1,
+                        uintptr_t base2, intptr_t stride2, uint64_t count2, intptr_t rowStride2, uint64_t numRows2){
+  int64_t b1 = base1, s1 = stride1, c1 = count1, rs1 = rowStride1, r1 = numRows1;
+  int64_t b2 = base2, s2 = stride2, c2 = count2, rs2 = rowStride2, r2 = numRows2;
+  normalise_nested(b1, s1, c1, rs1, r1);
+  normalise_nested(b2, s2, c2, rs2, r2);
+
+  /* Every address of either pattern is congruent to its base modulo the gcd of all strides */
+  int64_t gcd = euclid_gcd(euclid_gcd(s1, rs1), euclid_gcd(s2, rs2));
+  if(gcd == 0)
+    return b1 == b2;
+  if((b2 - b1)%gcd != 0)
+    return false;
+
+  /* Iterate over the rows of the pattern with fewer rows */
+  if(r2 < r1){
+    swap(b1, b2); swap(s1, s2); swap(c1, c2); swap(rs1, rs2); swap(r1, r2);
+  }
+  int64_t span1 = s1*(c1 - 1), span2 = s2*(c2 - 1);
+
+  if(r1 > 1 && rs1 == rs2){
+    /* Equal row strides: row j of pattern 1 and row j + d of pattern 2 are the same distance apart 
+     * for every j, so one representative pair of rows decides each row offset d */
+    int64_t delta = b2 - b1;
+    int64_t dmin = max(-(r1 - 1), ceil_div(-span2 - delta, rs1));
+    int64_t dmax = min(r2 - 1, floor_div(span1 - delta, rs1));
+    for(int64_t d = dmin; d <= dmax; d++){
+      int64_t j = max((int64_t)0, -d);
+      if(rows_alias(b1 + j*rs1, s1, c1, b2 + (j + d)*rs2, s2, c2))
+        return true;
+    }
+    return false;
+  }
+
+  /* Otherwise test each row of pattern 1 against only those rows of pattern 2 within its extent */
+  for(int64_t j = 0; j < r1; j++){
+    int64_t rowBase = b1 + j*rs1;
+    int64_t lmin = 0, lmax = 0;
+    if(r2 > 1){
+      lmin = max((int64_t)0, ceil_div(rowBase - span2 - b2, rs2));
+      lmax = min(r2 - 1, floor_div(rowBase + span1 - b2, rs2));
+    }
+    for(int64_t l = lmin; l <= lmax; l++){
+      if(rows_alias(rowBase, s1, c1, b2 + l*rs2, s2, c2))
+        return true;
+    }
+  }
+  return false;
+}
+
+bool dynamic_gcd_intervals(uintptr_t base1, intptr_t stride1, uint64_t count1, intptr_t rowStride1, uint64_t numRows1, uint64_t length1,
+                           uintptr_t base2, intptr_t stride2, uint64_t count2, intptr_t rowStride2, uint64_t numRows2, uint64_t length2){
+  int64_t b1 = base1, s1 = stride1, c1 = count1, rs1 = rowStride1, r1 = numRows1;
+  int64_t b2 = base2, s2 = stride2, c2 = count2, rs2 = rowStride2, r2 = numRows2;
+  normalise_nested(b1, s1, c1, rs1, r1);
+  normalise_nested(b2, s2, c2, rs2, r2);
+
+  /* Two accesses overlap when the distance from the first to the second is in [low, high] */
+  int64_t low = 1 - (int64_t)(length2), high = (int64_t)(length1) - 1;
+  int64_t gcd = euclid_gcd(euclid_gcd(s1, rs1), euclid_gcd(s2, rs2));
+  if(gcd == 0)
+    return b2 - b1 >= low && b2 - b1 <= high;
+
+  /* The distances are all congruent to b2 - b1 modulo the gcd of the strides, so only those in 
+   * the window need be checked, each as an exact test with the first pattern moved by it */
+  for(int64_t d = low + ((b2 - b1 - low)%gcd + gcd)%gcd; d <= high; d += gcd){
+    if(dynamic_gcd_nested(b1 + d, s1, c1, rs1, r1, b2, s2, c2, rs2, r2))
+      return true;
+  }
+  return false;
+}
@@ -28,3 +28,19 @@ using namespace std;
  */
 typedef tuple<uintptr_t, uintptr_t, uintptr_t> AliasT;
 AliasT dynamic_gcd(uintptr_t low1, uintptr_t low2, uintptr_t high1, uintptr_t high2, uintptr_t stride1, uintptr_t stride2);
+
+/*
+ * Returns true if two two-level (nested) stride patterns access a common address. Each pattern
+ * is numRows rows of count accesses separated by stride, with the bases of consecutive rows
+ * separated by rowStride. A single level pattern has numRows == 1. Accesses must be of equal
+ * length and every access must be aligned to that length.
+ */
+bool dynamic_gcd_nested(uintptr_t base1, intptr_t stride1, uint64_t count1, intptr_t rowStride1, uint64_t numRows1,
+                        uintptr_t base2, intptr_t stride2, uint64_t count2, intptr_t rowStride2, uint64_t numRows2);
+
+/*
+ * As dynamic_gcd_nested, but returns true if any access of length1 bytes of the first pattern
+ * overlaps any access of length2 bytes of the second. Accesses need not be aligned.
+ */
+bool dynamic_gcd_intervals(uintptr_t base1, intptr_t stride1, uint64_t count1, intptr_t rowStride1, uint64_t numRows1, uint64_t length1,
+                           uintptr_t base2, intptr_t stride2, uint64_t count2, intptr_t rowStride2, uint64_t numRows2, uint64_t length2);
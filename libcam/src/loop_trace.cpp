@@ -25,11 +25,19 @@
 #include "loop_trace.hh"
 #include "memory_allocator.hh"
 #include "ControlFlowCompressor.h"
+#include "BinaryTrace.h"
+#include "MemoryTracer.h"
+#include "DependenceTracer.h"
+#include "Throttle.h"
 #include "TimeoutCounter.h"
+#include <algorithm>
 #include <list>
+#include <set>
+#include <vector>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <unistd.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 using namespace std;
@@ -42,7 +50,7 @@ using namespace std;
 //#define LIBCAM_DEFAULT_MAX_MEM_USAGE ((JITUINT64)10000ULL)
 
 /**
- * Maximum number of iterations to check for matches.
+ * Initial number of iterations to check for matches, adapted per loop.
  **/
 #define MAX_RECENT_ITER_MATCHES 32
 
@@ -53,6 +61,7 @@ using namespace std;
 
 /**
  * Length of compression window (longer means possibly better compression but definitely poorer performance).
+ * This is the initial length for loop iterations, which is adapted per loop.
  **/
 #define COMPRESSION_WINDOW_SIZE 50
 
@@ -170,11 +179,18 @@ public:
   string outputDirectory;
   bool waitingForInvocCompletion;
   list<LoopInvocationCallInfo*> recentLoopInvCallInfos;
-
-  PassGlobals()
+  JITUINT32 level;               /**< Nesting level of the loops traced as loops, deeper loops are traced as calls. */
+  JITUINT32 loopDepth;           /**< Number of loops currently running, at any level. */
+  vector<bool> nestedLoopIsCall; /**< For each running loop deeper than level, whether it has its own sub-trace. */
+  set<JITNINT> callIDs;          /**< IDs of the call instructions given a call trace. */
+  set<JITNINT> nestedLoopIDs;    /**< IDs of the nested loops given a call trace, which must not be in callIDs. */
+  bool binaryTraces;             /**< Write the traces in the binary format of BinaryTrace.h. */
+
+  PassGlobals(JITUINT32 _level)
     : runningLoopPool(NULL), runningCallPool(NULL),
       dumpTraceMemUsage(LIBCAM_DEFAULT_MAX_MEM_USAGE), traceDumpID(0), currIterCfc(this, COMPRESSION_WINDOW_SIZE),
-      loopCompressedFile(NULL), callCompressedFile(NULL), outputDirectory("."), waitingForInvocCompletion(false)
+      loopCompressedFile(NULL), callCompressedFile(NULL), outputDirectory("."), waitingForInvocCompletion(false),
+      level(_level), loopDepth(0), binaryTraces(false)
   {
     //instrTraceFile.open("instruction_trace.txt");
     loopTraces = allocHashTable();
@@ -190,6 +206,10 @@ public:
     if (env) {
       outputDirectory = env;
     }
+    env = getenv("LIBCAM_BINARY_TRACES");
+    if (env) {
+      binaryTraces = atoi(env) != 0;
+    }
   }
 
   ~PassGlobals()
@@ -257,6 +277,23 @@ public:
   bool loopRunning();
   bool callRunning();
 
+  /* Start and end invocations of loops and calls at this level. */
+  void startLoopInvocation(JITNINT loopID);
+  void endLoopInvocation(void);
+  void startLoopIteration(void);
+  void startCallInvocation(JITNINT instID, bool nestedLoop = false);
+  void endCallInvocation(void);
+
+  /* Start and end a loop nested below this level, which is traced as a call. */
+  void startNestedLoopInvocation(JITNINT loopID);
+  void endNestedLoopInvocation(void);
+
+  /* Suffix distinguishing the output files of this level. */
+  string getLevelSuffix() { return level == 0 ? "" : ".level" + to_string(level); }
+
+  /* Extension of the output files, for the text or binary format. */
+  string getTraceExtension() { return binaryTraces ? ".bin.bz2" : ".txt.bz2"; }
+
   /* Record the calls for this loop invocation, return true if callTraces should be deleted before reallocation */
   bool recordCallTracesForInvocation(uint64_t invNum, bool attemptMatch);
 
@@ -291,11 +328,27 @@ public:
 
 
 /**
- * The globals for this pass.
+ * The globals for this pass.  There is one set of globals for each traced
+ * nesting level and globals points to the level being updated.
  **/
 static PassGlobals *globals = NULL;
+static vector<PassGlobals *> levels;
 static TimeoutCounter *timeoutCounter = NULL;
 
+/**
+ * Apply an operation to the globals of every traced nesting level.
+ **/
+template<class Op>
+static inline void
+forEachLevel(Op op)
+{
+  for (PassGlobals *level : levels) {
+    globals = level;
+    op();
+  }
+  globals = levels.front();
+}
+
 
 /**
  * Get a 64 bit unsigned pointer that can be used as a key into a hash table.
@@ -506,6 +559,15 @@ ExecTrace::~ExecTrace()
 }
 
 
+/**
+ * Loop trace constructor.
+ **/
+LoopTrace::LoopTrace()
+  : tuner(COMPRESSION_WINDOW_SIZE, MAX_RECENT_ITER_MATCHES)
+{
+}
+
+
 /**
  * Loop trace destructor.
  **/
@@ -766,12 +828,16 @@ RunningLoop::recordInstsSeenOnIteration(void)
   if(iterationNum + 1 != 0){
     /* Check if it is the same as any previous iterations */
     //XanListItem* iterInfoItem = xanList_first(iterationInfos);
+    CompressionTuner& tuner = ((LoopTrace *)trace)->tuner;
+    tuner.recordCfc(currCFC);
     bool matchFound = false;
-    for(auto iterInfo = recentIterationMatches.begin(); iterInfo != recentIterationMatches.end(); iterInfo++){
+    int depth = 0;
+    for(auto iterInfo = recentIterationMatches.begin(); iterInfo != recentIterationMatches.end(); iterInfo++, depth++){
       IterationInfo *iter = *iterInfo;
       if(iter->doesCfcMatch(currCFC)){
         iter->markSharer(iterationNum);
         currCFC->clear();
+        currCFC->setMaxWindowLength(tuner.getWindowLength());
         matchFound = true;
 
         /* Move this match to the front of the queue */
@@ -781,6 +847,7 @@ RunningLoop::recordInstsSeenOnIteration(void)
         break;
       }
     }
+    tuner.recordLookup(matchFound ? depth : -1);
     /*
     while(iterInfoItem){
       IterationInfo *iter = (IterationInfo *)iterInfoItem->data;
@@ -798,10 +865,10 @@ RunningLoop::recordInstsSeenOnIteration(void)
     if(!matchFound){
       IterationInfo* newIteration = globals->newMem<IterationInfo>(currCFC, iterationNum);
       globals->listAppend(iterationInfos, newIteration);
-      currCFC = globals->newMem<ControlFlowCompressor>(globals, COMPRESSION_WINDOW_SIZE);
+      currCFC = globals->newMem<ControlFlowCompressor>(globals, tuner.getWindowLength());
       /* Add the entry to the recently used iteration cache */
       recentIterationMatches.push_front(newIteration);
-      if(recentIterationMatches.size() > MAX_RECENT_ITER_MATCHES)
+      while(recentIterationMatches.size() > tuner.getRecentMatches())
         recentIterationMatches.pop_back();
     }
   }
@@ -1150,9 +1217,60 @@ writeFile(FILE *file, char *buf)
   }
 }
 
+/**
+ * Write binary encoded data to a compressed output file and check for errors.
+ **/
+void
+writeBinaryToCompressedFile(BZFILE *compressedFile, vector<uint8_t>& buf)
+{
+  JITINT32 errorCode;
+  BZ2_bzWrite(&errorCode, compressedFile, buf.data(), buf.size());
+  if (errorCode != BZ_OK) {
+    cerr << "Failed writing compressed file with error code " << errorCode << endl;
+    perror(NULL);
+    abort();
+  }
+  buf.clear();
+}
+
+/**
+ * Append the invocation ranges of a sharers set as delta varints.
+ **/
+void appendBinaryRange(XanBitSet *sharers, uint64_t sharersOffset, vector<uint8_t>& buf){
+  vector<pair<uint64_t, uint64_t>> ranges;
+  JITINT64 startInv = -1;
+  JITUINT64 numSharers = xanBitSet_length(sharers);
+  while ((startInv = xanBitSet_getFirstBitSetInRange(sharers, startInv + 1, numSharers)) != -1) {
+    JITINT64 endInv = xanBitSet_getFirstBitUnsetInRange(sharers, startInv, numSharers);
+    if (endInv == -1) {
+      endInv = numSharers - 1;
+    } else {
+      endInv -= 1;
+    }
+    assert(endInv >= startInv);
+    ranges.push_back(make_pair(sharersOffset + startInv, sharersOffset + endInv));
+    startInv = endInv + 1;
+  }
+
+  appendVarint(buf, ranges.size());
+  uint64_t next = 0;
+  for (auto range = ranges.begin(); range != ranges.end(); range++) {
+    appendVarint(buf, range->first - next);
+    appendVarint(buf, range->second - range->first);
+    next = range->second + 1;
+  }
+}
+
 void writeRangeToCompressedFile(XanBitSet *sharers, uint64_t sharersOffset, BZFILE *compressedFile){
   char buf[DIM_BUF];
 
+  if (globals->binaryTraces) {
+    vector<uint8_t> bin;
+    appendBinaryRange(sharers, sharersOffset, bin);
+    writeBinaryToCompressedFile(compressedFile, bin);
+    return;
+  }
+
   /* Start off the invocation numbers. */
   snprintf(buf, DIM_BUF, "{");
   writeCompressedFile(compressedFile, buf);
@@ -1210,6 +1328,21 @@ LoopTrace::writeInvocationToFile(void *invocation, BZFILE *compressedFile)
 {
   XanList *invocList = (XanList*)invocation;
 
+  /* Write the number of iteration groups followed by each range and compressed trace */
+  if (globals->binaryTraces) {
+    vector<uint8_t> bin;
+    appendVarint(bin, xanList_length(invocList));
+    XanListItem *invocListItem = xanList_first(invocList);
+    while(invocListItem){
+      IterationInfo *iterInfo = (IterationInfo*)(invocListItem->data);
+      appendBinaryRange(iterInfo->getSharers(), iterInfo->getSharersOffset(), bin);
+      iterInfo->getCfc()->appendBinary(bin);
+      invocListItem = invocListItem->next;
+    }
+    writeBinaryToCompressedFile(compressedFile, bin);
+    return;
+  }
+
   /* Write the parsing hint (number of iteration groups ) */
   char buf[DIM_BUF];
   snprintf(buf, DIM_BUF, "%d\n", xanList_length(invocList));
@@ -1239,6 +1372,13 @@ LoopTrace::writeInvocationToFile(void *invocation, BZFILE *compressedFile)
 void
 CallTrace::writeInvocationToFile(void *invocation, BZFILE *compressedFile)
 {
+  if (globals->binaryTraces) {
+    vector<uint8_t> bin;
+    ((ControlFlowCompressor*)invocation)->appendBinary(bin);
+    writeBinaryToCompressedFile(compressedFile, bin);
+    return;
+  }
+
   std::ostringstream stream;
   stream << *(ControlFlowCompressor*)invocation;
   std::string str =  stream.str();
@@ -1287,8 +1427,15 @@ ExecTrace::writeTraceToFile(uintptr_t id, BZFILE *compressedFile)
   if (xanList_length(allInvocationGroups) > 0) {
 
     /* Print this trace ID. */
-    snprintf(buf, DIM_BUF, "%" PRIuPTR " %u\n", id, xanList_length(allInvocationGroups));
-    writeCompressedFile(compressedFile, buf);
+    if (globals->binaryTraces) {
+      vector<uint8_t> bin;
+      appendVarint(bin, id);
+      appendVarint(bin, xanList_length(allInvocationGroups));
+      writeBinaryToCompressedFile(compressedFile, bin);
+    } else {
+      snprintf(buf, DIM_BUF, "%" PRIuPTR " %u\n", id, xanList_length(allInvocationGroups));
+      writeCompressedFile(compressedFile, buf);
+    }
 
     /* Work through all invocations. */
     XanListItem *groupItem = xanList_first(allInvocationGroups);
@@ -1299,8 +1446,10 @@ ExecTrace::writeTraceToFile(uintptr_t id, BZFILE *compressedFile)
       info->writeInvocationToFile(compressedFile);
 
       /* Finish the line. */
-      snprintf(buf, DIM_BUF, "\n");
-      writeCompressedFile(compressedFile, buf);
+      if (!globals->binaryTraces) {
+        snprintf(buf, DIM_BUF, "\n");
+        writeCompressedFile(compressedFile, buf);
+      }
 
       /* For loop traces, indicate if this invocation is complete */
       if(!isCallTrace() && !(groupItem == xanList_last(allInvocationGroups)))
@@ -1311,8 +1460,10 @@ ExecTrace::writeTraceToFile(uintptr_t id, BZFILE *compressedFile)
     }
 
     /* Finish this trace. */
-    snprintf(buf, DIM_BUF, "\n");
-    writeCompressedFile(compressedFile, buf);
+    if (!globals->binaryTraces) {
+      snprintf(buf, DIM_BUF, "\n");
+      writeCompressedFile(compressedFile, buf);
+    }
   }
 }
 
@@ -1339,6 +1490,12 @@ PassGlobals::writeTracesToFile(BZFILE *compressedFile, XanHashTable *traces)
 void
 PassGlobals::writeDumpIncompleteSymbol(BZFILE *compressedFile)
 {
+  if (binaryTraces) {
+    vector<uint8_t> bin;
+    appendVarint(bin, BINARY_TRACE_INVOC_INCOMPLETE);
+    writeBinaryToCompressedFile(compressedFile, bin);
+    return;
+  }
   char buf[20];
   strcpy(buf, "\nINCOMPLETE\n");
   writeCompressedFile(compressedFile, buf);
@@ -1347,6 +1504,12 @@ PassGlobals::writeDumpIncompleteSymbol(BZFILE *compressedFile)
 void
 PassGlobals::writeDumpCompleteSymbol(BZFILE *compressedFile)
 {
+  if (binaryTraces) {
+    vector<uint8_t> bin;
+    appendVarint(bin, BINARY_TRACE_INVOC_COMPLETE);
+    writeBinaryToCompressedFile(compressedFile, bin);
+    return;
+  }
   char buf[20];
   strcpy(buf, "\nCOMPLETE\n");
   writeCompressedFile(compressedFile, buf);
@@ -1354,8 +1517,13 @@ PassGlobals::writeDumpCompleteSymbol(BZFILE *compressedFile)
 
 void 
 PassGlobals::openCompressedFiles(){
+  /* Remove any trace left in the other format, cam would read it instead */
+  string staleExtension = binaryTraces ? ".txt.bz2" : ".bin.bz2";
+  unlink((outputDirectory + "/loop_trace" + getLevelSuffix() + staleExtension).c_str());
+  unlink((outputDirectory + "/call_trace" + getLevelSuffix() + staleExtension).c_str());
+
   /* Open the output file. */
-  loopOutputFile = fopen((outputDirectory + "/loop_trace.txt.bz2").c_str(), "w");
+  loopOutputFile = fopen((outputDirectory + "/loop_trace" + getLevelSuffix() + getTraceExtension()).c_str(), "w");
   if (!loopOutputFile) {
     abort();
   }
@@ -1363,7 +1531,7 @@ PassGlobals::openCompressedFiles(){
   if (!loopCompressedFile) {
     abort();
   }
-  callOutputFile = fopen((outputDirectory + "/call_trace.txt.bz2").c_str(), "w");
+  callOutputFile = fopen((outputDirectory + "/call_trace" + getLevelSuffix() + getTraceExtension()).c_str(), "w");
   if (!callOutputFile) {
     abort();
   }
@@ -1371,6 +1539,15 @@ PassGlobals::openCompressedFiles(){
   if (!callCompressedFile) {
     abort();
   }
+
+  /* Binary traces start with the magic bytes and format version */
+  if (binaryTraces) {
+    vector<uint8_t> bin(BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC + BINARY_TRACE_MAGIC_LENGTH);
+    appendVarint(bin, BINARY_TRACE_VERSION);
+    vector<uint8_t> callBin(bin);
+    writeBinaryToCompressedFile(loopCompressedFile, bin);
+    writeBinaryToCompressedFile(callCompressedFile, callBin);
+  }
 }
 
 bool
@@ -1410,8 +1587,14 @@ PassGlobals::writeTraces(string id)
     char buf[DIM_BUF];
 
     /* Write the number of invocation entries */
-    snprintf(buf, DIM_BUF, "%i\n", xanList_length(loopInvCallInfos));
-    writeCompressedFile(callCompressedFile, buf);
+    if (binaryTraces) {
+      vector<uint8_t> bin;
+      appendVarint(bin, xanList_length(loopInvCallInfos));
+      writeBinaryToCompressedFile(callCompressedFile, bin);
+    } else {
+      snprintf(buf, DIM_BUF, "%i\n", xanList_length(loopInvCallInfos));
+      writeCompressedFile(callCompressedFile, buf);
+    }
 
     /* Write each invocation entry */
     XanListItem *item = xanList_first(loopInvCallInfos);
@@ -1422,8 +1605,14 @@ PassGlobals::writeTraces(string id)
       writeRangeToCompressedFile(callInfo->getSharers(), callInfo->getSharersOffset(), callCompressedFile);
 
       /* Write the number of call IDs */
-      snprintf(buf, DIM_BUF, " %u\n", callInfo->getNumTraces());//xanHashTable_elementsInside(callInfo->getCallTraces()));
-      writeCompressedFile(callCompressedFile, buf);
+      if (binaryTraces) {
+        vector<uint8_t> bin;
+        appendVarint(bin, callInfo->getNumTraces());
+        writeBinaryToCompressedFile(callCompressedFile, bin);
+      } else {
+        snprintf(buf, DIM_BUF, " %u\n", callInfo->getNumTraces());//xanHashTable_elementsInside(callInfo->getCallTraces()));
+        writeCompressedFile(callCompressedFile, buf);
+      }
 
       /* Write the call traces */
       writeTracesToFile(callCompressedFile, callInfo->getCallTraces());
@@ -1591,127 +1780,166 @@ bool PassGlobals::callRunning(){
 
 
 /**
- * Start a loop (i.e. a new invocation).
+ * Start a loop invocation at this level.  Loops running above this level are
+ * not traced and loops running below it are traced as calls.
  **/
 void
-CAM_profileLoopInvocationStart(JITNINT loopID)
+PassGlobals::startLoopInvocation(JITNINT loopID)
 {
-  if(timeoutCounter->recordOperation())
+  JITUINT32 depth = loopDepth++;
+  if (depth < level) {
     return;
+  }
+  if (depth > level) {
+    startNestedLoopInvocation(loopID);
+    return;
+  }
 
   RunningLoop *running;
   LoopTrace *trace;
-  PDEBUG("Start loop %d (stack: %d)\n", loopID, xanStack_getSize(globals->runningStack));
-  if(xanStack_getSize(globals->runningStack) > 1){
+  PDEBUG("Start loop %d (stack: %d)\n", loopID, xanStack_getSize(runningStack));
+  if(xanStack_getSize(runningStack) > 1){
     cerr << "Starting loop when there is already something in the runningStack\n";
-    while(xanStack_getSize(globals->runningStack) > 1){
-      running = (RunningLoop *)globals->stackPop(globals->runningStack);
+    while(xanStack_getSize(runningStack) > 1){
+      running = (RunningLoop *)stackPop(runningStack);
       running->displaySummary();
     }
     abort();
   }
 
 
-  /* Start a new loop. */
-  running = globals->fetchNewRunningLoop();
-  trace = (LoopTrace *)xanHashTable_lookup(globals->loopTraces, intToPtr(loopID));
+  /* Start a new loop. Below the outermost level all loops share one trace,
+   * so their invocations are numbered in the order they execute. */
+  running = fetchNewRunningLoop();
+  if (level > 0 && xanHashTable_elementsInside(loopTraces) > 0) {
+    trace = (LoopTrace *)xanHashTable_first(loopTraces)->element;
+  } else {
+    trace = (LoopTrace *)xanHashTable_lookup(loopTraces, intToPtr(loopID));
+  }
   if (!trace) {
-    trace = globals->newMem<LoopTrace>();
-    globals->hashTableInsert(globals->loopTraces, intToPtr(loopID), trace);
+    trace = newMem<LoopTrace>();
+    hashTableInsert(loopTraces, intToPtr(loopID), trace);
   }
   running->trace = trace;;
+  running->currCFC->setMaxWindowLength(trace->tuner.getWindowLength());
   running->invocationNum = trace->numInvocations;
   running->iterationNum = -1;
   running->partiallyDumped = false;
   trace->numInvocations += 1;
 
   /* Push this onto the stack. */
-  globals->stackPush(globals->runningStack, running);
-  globals->checkDumpTraces();
+  stackPush(runningStack, running);
+  checkDumpTraces();
 }
 
 
 /**
- * Finish an invocation of a loop.
+ * Finish a loop invocation at this level.
  **/
 void
-CAM_profileLoopInvocationEnd(void)
+PassGlobals::endLoopInvocation(void)
 {
-  if(timeoutCounter->recordOperation())
+  JITUINT32 depth = --loopDepth;
+  if (depth < level) {
+    return;
+  }
+  if (depth > level) {
+    endNestedLoopInvocation();
     return;
+  }
 
-  PDEBUG("End loop (stack: %d)\n", xanStack_getSize(globals->runningStack));
-  RunningLoop *running = (RunningLoop *)globals->stackPop(globals->runningStack);
+  PDEBUG("End loop (stack: %d)\n", xanStack_getSize(runningStack));
+  RunningLoop *running = (RunningLoop *)stackPop(runningStack);
   running->finishInvocation(!(running->partiallyDumped));
-  globals->freeRunningLoop(running);
+  freeRunningLoop(running);
 
   /* Add all call traces for this invocation to the list of LoopInvocationCallInfos */
-  if(globals->recordCallTracesForInvocation(running->invocationNum, !globals->waitingForInvocCompletion))
-    globals->deleteTraceMap<CallTrace>(globals->callTraces);
-  globals->callTraces = globals->allocHashTable();
-  globals->waitingForInvocCompletion = false;
+  if(recordCallTracesForInvocation(running->invocationNum, !waitingForInvocCompletion))
+    deleteTraceMap<CallTrace>(callTraces);
+  callTraces = allocHashTable();
+  waitingForInvocCompletion = false;
 
-  globals->checkDumpTraces();
+  checkDumpTraces();
 }
 
 
 /**
- * Start a new loop iteration.
+ * Start an iteration of the loop traced at this level, iterations of other
+ * loops are not recorded.
  **/
 void
-CAM_profileLoopIterationStart(void)
+PassGlobals::startLoopIteration(void)
 {
-  if(timeoutCounter->recordOperation())
+  if (loopDepth != level + 1) {
     return;
+  }
 
   PDEBUG("Start iteration\n");
-  RunningLoop *running = (RunningLoop *)xanStack_top(globals->runningStack);
+  RunningLoop *running = (RunningLoop *)xanStack_top(runningStack);
   running->recordInstsSeenOnIteration();
   running->iterationNum += 1;
-  globals->checkDumpTraces();
+  checkDumpTraces();
 }
 
 
 /**
- * Record that an instruction has been seen.
+ * Start a loop nested below this level.  A loop directly inside the traced
+ * loop is recorded as a call of the loop ID, so that its instructions are
+ * attributed to the enclosing iteration.  A loop inside a call or another
+ * nested loop simply adds its instructions to the running call.
  **/
 void
-CAM_profileLoopSeenInstruction(JITNINT instID)
+PassGlobals::startNestedLoopInvocation(JITNINT loopID)
 {
-
-  RunningStruct *running = (RunningStruct *)xanStack_top(globals->runningStack);
-  if (running) {
-    if(timeoutCounter->recordOperation())
-      return;
-    //PDEBUG("Seen instruction %u\n", instID);
-    running->seenInstruction(instID);
-    globals->checkDumpTraces();
+  RunningStruct *running = (RunningStruct *)xanStack_top(runningStack);
+  bool isCall = running && !running->isCall();
+  nestedLoopIsCall.push_back(isCall);
+  if (isCall) {
+    running->seenInstruction(loopID);
+    startCallInvocation(loopID, true);
   }
 }
 
 
 /**
- * Start an invocation of a call.
+ * Finish a loop nested below this level.
  **/
 void
-CAM_profileCallInvocationStart(JITNINT instID)
+PassGlobals::endNestedLoopInvocation(void)
 {
+  bool isCall = nestedLoopIsCall.back();
+  nestedLoopIsCall.pop_back();
+  if (isCall) {
+    endCallInvocation();
+  }
+}
+
 
-  RunningStruct *running = (RunningStruct *)xanStack_top(globals->runningStack);
+/**
+ * Start a call invocation, if a loop is being traced.  A nested loop is
+ * recorded as a call of its loop ID, which must not also be a call ID.
+ **/
+void
+PassGlobals::startCallInvocation(JITNINT instID, bool nestedLoop)
+{
+  RunningStruct *running = (RunningStruct *)xanStack_top(runningStack);
 
   /* Must be running a loop. */
   if (running) {
-    if(timeoutCounter->recordOperation())
-      return;
     CallTrace *trace;
-    PDEBUG("Start call %d (stack: %d)\n", instID, xanStack_getSize(globals->runningStack));
+    PDEBUG("Start call %d (stack: %d)\n", instID, xanStack_getSize(runningStack));
 
     /* Start a new call. */
-    running = globals->fetchNewRunningCall();
-    trace = (CallTrace *)xanHashTable_lookup(globals->callTraces, intToPtr(instID));
+    running = fetchNewRunningCall();
+    trace = (CallTrace *)xanHashTable_lookup(callTraces, intToPtr(instID));
     if (!trace) {
-      trace = globals->newMem<CallTrace>();
-      globals->hashTableInsert(globals->callTraces, intToPtr(instID), trace);
+      (nestedLoop ? nestedLoopIDs : callIDs).insert(instID);
+      if ((nestedLoop ? callIDs : nestedLoopIDs).count(instID)) {
+        cerr << "Loop " << instID << " has the ID of a call instruction, they share the call trace of level " << level << "\n";
+        abort();
+      }
+      trace = newMem<CallTrace>();
+      hashTableInsert(callTraces, intToPtr(instID), trace);
     }
     running->trace = trace;
     running->invocationNum = trace->numInvocations;
@@ -1719,42 +1947,264 @@ CAM_profileCallInvocationStart(JITNINT instID)
     trace->numInvocations += 1;
 
     /* Push this onto the stack. */
-    globals->stackPush(globals->runningStack, running);
-    globals->checkDumpTraces();
+    stackPush(runningStack, running);
+    checkDumpTraces();
   }
 }
 
 
 /**
- * End an invocation of a call.
+ * End a call invocation, if a loop is being traced.
  **/
 void
-CAM_profileCallInvocationEnd(void)
+PassGlobals::endCallInvocation(void)
 {
-
-  RunningCall *running = (RunningCall *)xanStack_top(globals->runningStack);
+  RunningCall *running = (RunningCall *)xanStack_top(runningStack);
   if (running) {
-    if(timeoutCounter->recordOperation())
-      return;
-    PDEBUG("End call (stack: %d)\n", xanStack_getSize(globals->runningStack));
-    globals->stackPop(globals->runningStack);
+    PDEBUG("End call (stack: %d)\n", xanStack_getSize(runningStack));
+    stackPop(runningStack);
     running->finishInvocation(!(running->partiallyDumped));
-    globals->freeRunningCall(running);
-    globals->checkDumpTraces();
+    freeRunningCall(running);
+    checkDumpTraces();
   }
 }
 
+
+/**
+ * Start a loop (i.e. a new invocation).
+ **/
+void
+CAM_profileLoopInvocationStart(JITNINT loopID)
+{
+  ThrottleSample sample;
+  if(!throttle_loop_invocation_start())
+    return;
+
+  /* The memory and dependence tracers follow loops to attribute references to iterations */
+  if(memory_trace_running())
+    memory_trace_loop_invocation_start(loopID);
+  if(dependence_trace_running())
+    dependence_trace_loop_invocation_start(loopID);
+  if(!loop_trace_running())
+    return;
+
+  if(timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([=] { globals->startLoopInvocation(loopID); });
+}
+
+
+/**
+ * Finish an invocation of a loop.
+ **/
+void
+CAM_profileLoopInvocationEnd(void)
+{
+  ThrottleSample sample;
+  if(!throttle_loop_invocation_end())
+    return;
+
+  /* The memory and dependence tracers follow loops to attribute references to iterations */
+  if(memory_trace_running())
+    memory_trace_loop_invocation_end();
+  if(dependence_trace_running())
+    dependence_trace_loop_invocation_end();
+  if(!loop_trace_running())
+    return;
+
+  if(timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([] { globals->endLoopInvocation(); });
+}
+
+
+/**
+ * Start a new loop iteration.
+ **/
+void
+CAM_profileLoopIterationStart(void)
+{
+  ThrottleSample sample;
+  if(!throttle_loop_iteration_start())
+    return;
+
+  /* The memory and dependence tracers follow loops to attribute references to iterations */
+  if(memory_trace_running())
+    memory_trace_loop_iteration_start();
+  if(dependence_trace_running())
+    dependence_trace_loop_iteration_start();
+  if(!loop_trace_running())
+    return;
+
+  if(timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([] { globals->startLoopIteration(); });
+}
+
+
+/**
+ * Record that an instruction has been seen.
+ **/
+void
+CAM_profileLoopSeenInstruction(JITNINT instID)
+{
+  ThrottleSample sample;
+  if(!loop_trace_running() || !throttle_records(instID))
+    return;
+
+  loop_trace_seen_instruction(instID, true);
+}
+
+
+/**
+ * Record that an instruction has been seen, optionally leaving the timeout
+ * check to the caller.
+ **/
+void
+loop_trace_seen_instruction(JITNINT instID, bool checkTimeout)
+{
+  if(checkTimeout && xanStack_top(globals->runningStack) && timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([=] {
+    RunningStruct *running = (RunningStruct *)xanStack_top(globals->runningStack);
+    if (running) {
+      //PDEBUG("Seen instruction %u\n", instID);
+      running->seenInstruction(instID);
+      globals->checkDumpTraces();
+    }
+  });
+}
+
+
+/**
+ * Check whether the loop tracer is initialised.
+ **/
+bool
+loop_trace_running(void)
+{
+  return globals != NULL;
+}
+
+
+/**
+ * Register the instructions making up a basic block.
+ **/
+void
+CAM_profileLoopRegisterBlock(JITNINT blockID, const JITNINT *instIDs, JITUINT32 numInsts)
+{
+  vector<tracer_symbol> insts(instIDs, instIDs + numInsts);
+  ControlFlowCompressor::registerBlock(blockID, insts);
+}
+
+
+/**
+ * Record that all instructions of a basic block have been seen.
+ **/
+void
+CAM_profileLoopSeenBlock(JITNINT blockID)
+{
+  ThrottleSample sample;
+  if(!loop_trace_running() || !throttle_records_events())
+    return;
+
+  if(xanStack_top(globals->runningStack) && timeoutCounter->recordOperation())
+    return;
+
+  /* A block containing dropped instructions is traced as its remaining instructions */
+  if(throttle_drops_instructions()) {
+    const vector<tracer_symbol> &insts = ControlFlowCompressor::getBlockInstructions(ControlFlowCompressor::blockSymbol(blockID));
+    if(any_of(insts.begin(), insts.end(), throttle_drops)) {
+      for (auto i = insts.begin(); i != insts.end(); i++) {
+        if(throttle_records(*i))
+          loop_trace_seen_instruction(*i, false);
+      }
+      return;
+    }
+  }
+
+  forEachLevel([=] {
+    RunningStruct *running = (RunningStruct *)xanStack_top(globals->runningStack);
+    if (running) {
+      running->seenInstruction(ControlFlowCompressor::blockSymbol(blockID));
+      globals->checkDumpTraces();
+    }
+  });
+}
+
+
+/**
+ * Start an invocation of a call.
+ **/
+void
+CAM_profileCallInvocationStart(JITNINT instID)
+{
+  ThrottleSample sample;
+  if(!throttle_records_events())
+    return;
+
+  if(memory_trace_running())
+    memory_trace_call_invocation_start(instID);
+  if(dependence_trace_running())
+    dependence_trace_call_invocation_start(instID);
+  if(!loop_trace_running())
+    return;
+
+  if(xanStack_top(globals->runningStack) && timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([=] { globals->startCallInvocation(instID); });
+}
+
+
+/**
+ * End an invocation of a call.
+ **/
+void
+CAM_profileCallInvocationEnd(void)
+{
+  ThrottleSample sample;
+  if(!throttle_records_events())
+    return;
+
+  if(dependence_trace_running())
+    dependence_trace_call_invocation_end();
+  if(!loop_trace_running())
+    return;
+
+  if(xanStack_top(globals->runningStack) && timeoutCounter->recordOperation())
+    return;
+
+  forEachLevel([] { globals->endCallInvocation(); });
+}
+
 void CAM_forceLoopTraceDump(){
-  globals->dumpTraces();
+  forEachLevel([] { globals->dumpTraces(); });
 }
 
 /**
- * Initialisation.
+ * Initialisation.  The number of nesting levels to trace is set by the
+ * environment variable LIBCAM_LOOP_TRACE_LEVELS (default 1).
  **/
 void
 loop_trace_init(void)
 {
-  globals = new PassGlobals();
+  JITUINT32 numLevels = 1;
+  char *env = getenv("LIBCAM_LOOP_TRACE_LEVELS");
+  if (env) {
+    numLevels = atoi(env);
+    if (numLevels < 1) {
+      cerr << "LIBCAM_LOOP_TRACE_LEVELS must be at least 1\n";
+      abort();
+    }
+  }
+  for (JITUINT32 level = 0; level < numLevels; level++) {
+    levels.push_back(new PassGlobals(level));
+  }
+  globals = levels.front();
   timeoutCounter = new TimeoutCounter();
 }
 
@@ -1768,28 +2218,34 @@ loop_trace_shutdown(void)
   
   /* If the library was actually used, dump output */
   if(timeoutCounter->getNumOperations() > 0){
-    if(!globals->compressedFilesOpen()){
-      globals->openCompressedFiles();
-    }
+    forEachLevel([] {
+      if(!globals->compressedFilesOpen()){
+        globals->openCompressedFiles();
+      }
 
-    if (globals->traceDumpID > 0) {
-      globals->writeTraces(to_string(globals->traceDumpID));
-    } else {
-      globals->writeTraces("0");
-    }
+      if (globals->traceDumpID > 0) {
+        globals->writeTraces(to_string(globals->traceDumpID));
+      } else {
+        globals->writeTraces("0");
+      }
 
-    globals->closeCompressedFiles();
+      globals->closeCompressedFiles();
 
-    if(!timeoutCounter->isTimedOut() && xanStack_getSize (globals->runningStack) > 1){
-      cerr << "Running stack is not empty (" << xanStack_getSize(globals->runningStack) << "), calls to libcam API were inconsistent\n";
-      abort();
-    }
+      if(!timeoutCounter->isTimedOut() && xanStack_getSize (globals->runningStack) > 1){
+        cerr << "Running stack is not empty (" << xanStack_getSize(globals->runningStack) << "), calls to libcam API were inconsistent\n";
+        abort();
+      }
+    });
 
     timeoutCounter->dumpStats(globals->getOutputDirectory());
   }
 
   /* Cleanup */
   delete timeoutCounter;
-  delete globals;
+  for (PassGlobals *level : levels) {
+    globals = level;
+    delete level;
+  }
+  levels.clear();
   globals = NULL;
 }
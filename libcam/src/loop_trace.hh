@@ -22,6 +22,7 @@
 #include <bzlib.h>
 #include <xanlib.h>
 #include "ControlFlowCompressor.h"
+#include "CompressionTuner.h"
 
 
 /* Forward declaration. */
@@ -91,6 +92,10 @@ public:
 class LoopTrace : public ExecTrace
 {
 public:
+  /* Sizes the compression of this loop's iterations. */
+  CompressionTuner tuner;
+
+  LoopTrace();
   virtual ~LoopTrace();
 
   /* Get list of all instruction IDs recorded in this loop */
@@ -240,4 +245,8 @@ void loop_trace_init(void);
 /* Shut down. */
 void loop_trace_shutdown(void);
 
+/* Used by CAM_memSeenInstruction. */
+bool loop_trace_running(void);
+void loop_trace_seen_instruction(JITNINT instID, bool checkTimeout);
+
 #endif /* CAM_LOOP_TRACE_H */
@@ -50,7 +50,8 @@ map<string, unsigned int> argsParser(int argc, char **argv){
   args["check"] = 0;
   args["checkarg"] = 0;
   args["unit_tests"] = 0;
-  while ((c = getopt (argc, argv, "abv:spqx:y:u:")) != -1){
+  args["level"] = 0;
+  while ((c = getopt (argc, argv, "abv:spqx:y:u:l:")) != -1){
     switch (c) {
       case 'a':
         args["adjacent"] = 1;
@@ -79,6 +80,9 @@ map<string, unsigned int> argsParser(int argc, char **argv){
       case 'u':
         args["unit_tests"] = atoi(optarg);
         break;
+      case 'l':
+        args["level"] = atoi(optarg);
+        break;
       default:
         cerr << "Bad argument list\n";
         abort ();
@@ -319,11 +323,11 @@ int main(int argc, char **argv){
   pair<set<uintptr_t>, uint64_t> instrListAndNumInvoc; 
   pair<set<uintptr_t>, set<uintptr_t>> callTraceList;
   if(args["deppairs"] == 1 || args["statistics"] == 1){
-    instrListAndNumInvoc = parseLoopTraceForInstrList();
-    callTraceList = parseCallTraceForInstrList();
+    instrListAndNumInvoc = parseLoopTraceForInstrList(args["level"]);
+    callTraceList = parseCallTraceForInstrList(args["level"]);
     if(args["deppairs"] == 1){
       PDEBUG("Parse call trace\n");
-      callTraces = parseCallTrace();
+      callTraces = parseCallTrace(args["level"]);
     }
   }
 
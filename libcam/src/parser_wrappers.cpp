@@ -20,7 +20,6 @@
 #include "parser_wrappers.h"
 #include "loop_trace_cfc_parser.h"
 #include "call_trace_cfc_parser.h"
-#include "memory_trace_parser.h"
 #include "dependence_pairs_parser.h"
 #include "static_ddg_parser.h"
 #include "BZ2ParserState.h"
@@ -29,6 +28,8 @@
 #include "CallTraceStreamer.h"
 
 #include <deque>
+#include <fstream>
+#include <sstream>
 #include <vector>
 #include <cassert>
 #include <bzlib.h>
@@ -56,8 +57,8 @@ LoopTraceCfcLex current_ltcl;
 
 #endif
 
-pair<set<uintptr_t>, uint64_t> parseLoopTraceForInstrList(){
-  LoopTraceStreamer streamer;
+pair<set<uintptr_t>, uint64_t> parseLoopTraceForInstrList(unsigned int level){
+  LoopTraceStreamer streamer(level);
   return streamer.parseForInstructionList();
   #if 0
   FILE *f = fopen("loop_trace.txt", "r");
@@ -377,8 +378,8 @@ int callTraceGetNextEntry(CallTraceLoopInvocationGroup& callEntry){
 
 #endif
 
-StreamParseCallTrace parseCallTrace(){
-  CallTraceStreamer streamer;
+StreamParseCallTrace parseCallTrace(unsigned int level){
+  CallTraceStreamer streamer(level);
   StreamParseCallTrace t;
   while(1){
     CallTraceLoopInvocationGroup clig;
@@ -391,8 +392,8 @@ StreamParseCallTrace parseCallTrace(){
   return t;
 }
 
-pair<set<uintptr_t>, set<uintptr_t>> parseCallTraceForInstrList(){
-  CallTraceStreamer streamer;
+pair<set<uintptr_t>, set<uintptr_t>> parseCallTraceForInstrList(unsigned int level){
+  CallTraceStreamer streamer(level);
   return streamer.parseForInstructionLists();
 }
 
@@ -427,6 +428,59 @@ pair<vector<uintptr_t>, vector<uintptr_t>> findMemoryTraces(){
   return instrIDs;
 }
 
+/*
+ * Return the invocations which repeat an earlier invocation, if the memory
+ * trace was recorded with LIBCAM_MEM_TRACE_DEDUP_INVOCATIONS
+*/
+set<uint64_t> parse_repeated_invocations(){
+  set<uint64_t> repeated;
+  ifstream inputFile("memory_accesses/repeated_invocations.txt");
+  uint64_t invocation, earlier;
+  while(inputFile >> invocation >> earlier)
+    repeated.insert(invocation);
+  return repeated;
+}
+
+map<pair<uintptr_t, bool>, AccessSummary> parse_access_summaries(){
+  map<pair<uintptr_t, bool>, AccessSummary> summaries;
+  ifstream inputFile("memory_accesses/" ACCESS_SUMMARY_FILE);
+  uintptr_t id;
+  char kind;
+  AccessSummary summary;
+  while(inputFile >> id >> kind >> summary.lowest >> summary.highest){
+    for(int w = 0; w < ACCESS_SUMMARY_WORDS; w++)
+      inputFile >> hex >> summary.pages[w];
+    inputFile >> dec;
+    if(!inputFile || (kind != 'r' && kind != 'w')){
+      cerr << "Malformed " ACCESS_SUMMARY_FILE "\n";
+      abort();
+    }
+    summaries[pair<uintptr_t, bool>(id, kind == 'w')] = summary;
+  }
+  return summaries;
+}
+
+map<pair<uintptr_t, bool>, vector<pair<uint64_t, uint64_t>>> parse_outside_instances(unsigned int level){
+  map<pair<uintptr_t, bool>, vector<pair<uint64_t, uint64_t>>> outside;
+  string filename = "memory_accesses/outside_instances" + (level == 0 ? string("") : ".level" + to_string(level)) + ".txt";
+  ifstream inputFile(filename.c_str());
+  string line;
+  while(getline(inputFile, line)){
+    istringstream fields(line);
+    uintptr_t id;
+    char kind;
+    if(!(fields >> id >> kind) || (kind != 'r' && kind != 'w')){
+      cerr << "Malformed " << filename << "\n";
+      abort();
+    }
+    vector<pair<uint64_t, uint64_t>> &ranges = outside[pair<uintptr_t, bool>(id, kind == 'w')];
+    uint64_t first, count;
+    while(fields >> first >> count)
+      ranges.push_back(pair<uint64_t, uint64_t>(first, count));
+  }
+  return outside;
+}
+
 MemoryTrace parse_memory_trace(){
   MemoryTrace t;
   pair<vector<uintptr_t>, vector<uintptr_t>> instrIDs = findMemoryTraces();
@@ -23,6 +23,7 @@
 #include "static_inst_rec.h"
 #include "StaticLoopRec.h"
 #include "CallTrace.h"
+#include "AccessSummary.h"
 #include <set>
 using namespace std;
 
@@ -33,21 +34,24 @@ using namespace std;
 #define DEP_MWAR        0x10
 #define DEP_MWAW        0x20
 
-/* Loop trace */
+/* Loop trace, level selects the trace of a loop nesting level (see LIBCAM_LOOP_TRACE_LEVELS) */
 void loopTraceInit();
-pair<set<uintptr_t>, uint64_t> parseLoopTraceForInstrList();
+pair<set<uintptr_t>, uint64_t> parseLoopTraceForInstrList(unsigned int level = 0);
 int loopTraceGetNextEntry(LoopTraceEntry& loopEntry);
 
 /* Call trace */
 void callTraceInit();
-StreamParseCallTrace parseCallTrace();
-pair<set<uintptr_t>, set<uintptr_t>> parseCallTraceForInstrList();
+StreamParseCallTrace parseCallTrace(unsigned int level = 0);
+pair<set<uintptr_t>, set<uintptr_t>> parseCallTraceForInstrList(unsigned int level = 0);
 int callTraceGetNextEntry(CallTraceLoopInvocationGroup& callEntry);
 
 /* Memory trace */
 MemoryTrace parse_memory_trace();
 MemoryTrace parse_memory_trace_parallel();
 pair<vector<uintptr_t>, vector<uintptr_t>> findMemoryTraces();
+set<uint64_t> parse_repeated_invocations();
+map<pair<uintptr_t, bool>, AccessSummary> parse_access_summaries();
+map<pair<uintptr_t, bool>, vector<pair<uint64_t, uint64_t>>> parse_outside_instances(unsigned int level = 0);
 
 /* DDG */
 pair<set<pair<uintptr_t, uintptr_t>>, set<pair<uintptr_t, uintptr_t>>> parse_dependence_pairs();
@@ -82,13 +82,85 @@ uintptr_t MemSetEntry::prediction(){
 MemSetEntry MemSetEntry::splitOffEnd(uint64_t n){
   uint64_t remaining = getNumInstances() - n;
   MemSetEntry newEntry(base + remaining*stride, stride, length, start + remaining, end);
+  MemSetEntry original = *this;
   end -= n;
+  original.tagSlice(newEntry);
+  original.tagSlice(*this);
   return newEntry;
 }
 
 MemSetEntry MemSetEntry::getSlice(uint64_t s, uint64_t e){
   assert(s >= start && e <= end && s <= e);
-  return MemSetEntry(base + (s - start)*stride, stride, length, s, e);
+  assert(!isNested());
+  MemSetEntry slice(base + (s - start)*stride, stride, length, s, e);
+  tagSlice(slice);
+  return slice;
+}
+
+void MemSetEntry::tagSlice(MemSetEntry& slice){
+  if(!hasIterationTags())
+    return;
+  uint64_t perIteration = getInstancesPerIteration();
+  uint64_t offset = slice.getStart() - start;
+  if(offset/perIteration == (offset + slice.getNumInstances() - 1)/perIteration)
+    slice.setIterationTags(tagInvocation, tagFirstIteration + offset/perIteration, 1);
+  else if(offset%perIteration == 0 && slice.getNumInstances()%perIteration == 0)
+    slice.setIterationTags(tagInvocation, tagFirstIteration + offset/perIteration, slice.getNumInstances()/perIteration);
+  else
+    slice.setIterationTags(0, 0, 0);
+}
+
+vector<MemSetEntry> MemSetEntry::getSlices(uint64_t s, uint64_t e){
+  assert(s >= start && e <= end && s <= e);
+  vector<MemSetEntry> slices;
+  if(!isNested()){
+    slices.push_back(getSlice(s, e));
+    return slices;
+  }
+  uint64_t first = s - start, last = e - start;
+  uint64_t firstRow = first/rowLength, lastRow = last/rowLength;
+  if(firstRow == lastRow){
+    slices.push_back(MemSetEntry(getAccessLower(first), stride, length, s, e));
+    return slices;
+  }
+  /* Partial first row */
+  uint64_t firstFullRow = firstRow;
+  if(first%rowLength != 0){
+    slices.push_back(MemSetEntry(getAccessLower(first), stride, length, s, start + (firstRow + 1)*rowLength - 1));
+    firstFullRow++;
+  }
+  /* Complete rows */
+  uint64_t lastFullRow = (last%rowLength == rowLength - 1) ? lastRow : lastRow - 1;
+  if(firstFullRow <= lastFullRow){
+    uint64_t fullStart = start + firstFullRow*rowLength;
+    uint64_t fullEnd = start + (lastFullRow + 1)*rowLength - 1;
+    if(firstFullRow == lastFullRow)
+      slices.push_back(MemSetEntry(getAccessLower(firstFullRow*rowLength), stride, length, fullStart, fullEnd));
+    else
+      slices.push_back(MemSetEntry(getAccessLower(firstFullRow*rowLength), stride, length, fullStart, fullEnd, rowStride, rowLength));
+  }
+  /* Partial last row */
+  if(last%rowLength != rowLength - 1)
+    slices.push_back(MemSetEntry(getAccessLower(lastRow*rowLength), stride, length, start + lastRow*rowLength, e));
+  return slices;
+}
+
+uintptr_t MemSetEntry::getNestedUpperExtent(){
+  uintptr_t upper = base + length - 1;
+  if(stride > 0)
+    upper += stride*(rowLength - 1);
+  if(rowStride > 0)
+    upper += rowStride*(getNumRows() - 1);
+  return upper;
+}
+
+uintptr_t MemSetEntry::getNestedLowerExtent(){
+  uintptr_t lower = base;
+  if(stride < 0)
+    lower += stride*(rowLength - 1);
+  if(rowStride < 0)
+    lower += rowStride*(getNumRows() - 1);
+  return lower;
 }
 
 //MemSetEntry MemSetEntry::getNormalised(){
@@ -98,8 +170,29 @@ MemSetEntry MemSetEntry::getSlice(uint64_t s, uint64_t e){
 //    return *this;
 //}
 
-MemSetEntry::interval MemSetEntry::toInterval(MemSetEntry& entry){
-  return MemSetEntry::interval(entry.getLowerExtent(), entry.getUpperExtent(), &entry);
+void MemSetEntry::toInterval(MemSetEntry& entry, uint64_t& lower, uint64_t& upper, MemSetEntry*& value){
+  lower = entry.getLowerExtent();
+  upper = entry.getUpperExtent();
+  value = &entry;
+}
+
+void MemSetEntry::addToSummary(AccessSummary& summary){
+  uint64_t pageSize = (uint64_t)1 << ACCESS_SUMMARY_PAGE_SHIFT;
+  uint64_t maxAccesses = ACCESS_SUMMARY_WORDS*64;
+  /* Accesses, or rows, more than a page apart would mark the pages in between */
+  if(!isNested() && (uint64_t)abs(stride) > pageSize && getNumInstances() <= maxAccesses){
+    for(uint64_t n = 0; n < getNumInstances(); n++)
+      summary.add(getAccessLower(n), length);
+  }
+  else if(isNested() && (uint64_t)abs(rowStride) > pageSize && getNumRows() <= maxAccesses){
+    uintptr_t rowSpan = abs(stride)*(rowLength - 1) + length;
+    for(uint64_t r = 0; r < getNumRows(); r++){
+      uintptr_t rowBase = base + r*rowStride;
+      summary.add(stride >= 0 ? rowBase : rowBase + stride*(intptr_t)(rowLength - 1), rowSpan);
+    }
+  }
+  else
+    summary.add(getLowerExtent(), getUpperExtent() - getLowerExtent() + 1);
 }
 
 uint64_t MemSetEntry::getFirstDynamicInstanceFromAddress(uintptr_t addr){
@@ -122,7 +215,10 @@ bool MemSetEntry::isTrivialPattern(){
 
 MemSetEntry MemSetEntry::splitTrivial(){
   MemSetEntry remainder = MemSetEntry(base + stride, stride, length, start+1, end);
+  MemSetEntry original = *this;
   end = start;
+  original.tagSlice(remainder);
+  original.tagSlice(*this);
   return remainder;
 }
 
@@ -134,12 +230,19 @@ vector<MemSetEntry> MemSetEntry::getSplitPattern(){
 }
 
 void MemSetEntry::printWithIterInfo(ostream& os){
-  os << "[" << base << " " << stride << " " << length << " " << start << " " 
-       << end << " (" << iterationNumber << "," << effectiveInstrID << ")] ";
+  os << "[" << base << " " << stride << " " << length << " " << start << " " << end;
+  if(isNested())
+    os << " {" << rowStride << " " << rowLength << "}";
+  if(hasIterationTags())
+    os << " <" << tagInvocation << " " << tagFirstIteration << " " << tagIterationSpan << ">";
+  os << " (" << iterationNumber << "," << effectiveInstrID << ")] ";
 }
 
 ostream& operator<<(ostream& os, const MemSetEntry& e){
-  return os << "[" << e.base << " " << e.stride << " " << e.length << " " << e.start << " " << e.end << "] ";
+  os << "[" << e.base << " " << e.stride << " " << e.length << " " << e.start << " " << e.end;
+  if(e.rowLength != 0)
+    os << " {" << e.rowStride << " " << e.rowLength << "}";
+  return os << "] ";
 }
 
 
@@ -147,7 +250,9 @@ ostream& operator<<(ostream& os, const MemSetEntry& e){
  * MemSet
 **/
 
-MemSet MemSet::getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroupCfc &invGroup, uint64_t invNum, CallTraceLoopInvocationGroup& invocCallTrace){
+MemSet MemSet::getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroupCfc &invGroup, uint64_t invNum, CallTraceLoopInvocationGroup& invocCallTrace, bool useTracerTags){
+  if(useTracerTags && invGroup.containsInstruction(instrID) && hasIterationTags())
+    return getInvocationSliceFromTracerTags(instrID);
   MemSet slice;
   uint64_t memsetRemainingInstances = outstandingInstances;
   if(invGroup.containsInstruction(instrID)){ /* This instruction is a normal loop instruction */
@@ -165,10 +270,12 @@ MemSet MemSet::getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroup
         else
           endInstance = sliceIterator->getEnd();
         uint64_t instancesConsumed = endInstance - startInstance + 1;
-        MemSetEntry newEntry = sliceIterator->getSlice(startInstance, endInstance);
-        newEntry.setIterationNumber(invGroup.getIterationNumberFromII(ii, instrID));
-        newEntry.setEffectiveInstrID(instrID);
-        slice.push_back(newEntry);
+        vector<MemSetEntry> newEntries = sliceIterator->getSlices(startInstance, endInstance);
+        for(auto newEntry = newEntries.begin(); newEntry != newEntries.end(); newEntry++){
+          newEntry->setIterationNumber(invGroup.getIterationNumberFromII(ii, instrID));
+          newEntry->setEffectiveInstrID(instrID);
+          slice.push_back(*newEntry);
+        }
         ligInstancesConsumed += instancesConsumed;
         memsetRemainingInstances -= instancesConsumed;
         if(memsetRemainingInstances == 0){
@@ -196,10 +303,12 @@ MemSet MemSet::getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroup
         else
           endInstance = sliceIterator->getEnd();
         uint64_t instancesConsumed = endInstance - startInstance + 1;
-        MemSetEntry newEntry = sliceIterator->getSlice(startInstance, endInstance);
-        newEntry.setIterationNumber(iter);
-        newEntry.setEffectiveInstrID(effectiveInstrID);
-        slice.push_back(newEntry);
+        vector<MemSetEntry> newEntries = sliceIterator->getSlices(startInstance, endInstance);
+        for(auto newEntry = newEntries.begin(); newEntry != newEntries.end(); newEntry++){
+          newEntry->setIterationNumber(iter);
+          newEntry->setEffectiveInstrID(effectiveInstrID);
+          slice.push_back(*newEntry);
+        }
         ctInstancesConsumed += instancesConsumed;
         memsetRemainingInstances -= instancesConsumed;
         if(memsetRemainingInstances == 0){
@@ -216,6 +325,34 @@ MemSet MemSet::getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroup
 }
 
 
+MemSet MemSet::getInvocationSliceFromTracerTags(uintptr_t instrID){
+  MemSet slice;
+  uint64_t invocation = sliceIterator->getTagInvocation();
+  for(; sliceIterator != this->end() && sliceIterator->getTagInvocation() == invocation; sliceIterator++){
+    /* Tagged entries are never nested, each iteration becomes an entry of its own */
+    uint64_t perIteration = sliceIterator->getNumInstances()/sliceIterator->getTagIterationSpan();
+    for(uint64_t i = 0; i < sliceIterator->getTagIterationSpan(); i++){
+      uint64_t first = sliceIterator->getStart() + i*perIteration;
+      MemSetEntry newEntry = sliceIterator->getSlice(first, first + perIteration - 1);
+      newEntry.setIterationNumber(sliceIterator->getTagFirstIteration() + i);
+      newEntry.setEffectiveInstrID(instrID);
+      slice.push_back(newEntry);
+    }
+  }
+  outstandingInstances = sliceIterator != this->end() ? sliceIterator->getNumInstances() : 0;
+  return slice;
+}
+
+bool MemSet::hasIterationTags(){
+  if(sliceIterator == this->end() || outstandingInstances != sliceIterator->getNumInstances())
+    return false;
+  for(auto i = sliceIterator; i != this->end(); i++){
+    if(!i->hasIterationTags() || i->isNested())
+      return false;
+  }
+  return true;
+}
+
 void MemSet::initialiseSliceIterator(){
   sliceIterator = this->begin();
   if(this->empty())
@@ -237,6 +374,13 @@ void MemSet::splitLargeStrides(){
   (*this) = newMemSet;
 }
 
+AccessSummary MemSet::getSummary(){
+  AccessSummary summary;
+  for(auto i = begin(); i != end(); i++)
+    i->addToSummary(summary);
+  return summary;
+}
+
 void MemSet::printWithIterInfo(ostream& os){
   os << size() << " ";
   for(auto i = begin(); i != end(); i++)
@@ -258,10 +402,12 @@ StaticInstRec::~StaticInstRec(){
   delete writeTree;
 }
 
-void StaticInstRec::setReadSet(MemSet r) { readSet = r; readSetBuilt = true; }
-void StaticInstRec::setWriteSet(MemSet w) { writeSet = w; writeSetBuilt = true; }
+void StaticInstRec::setReadSet(MemSet r) { readSet = r; readSetBuilt = true; readSummary = readSet.getSummary(); }
+void StaticInstRec::setWriteSet(MemSet w) { writeSet = w; writeSetBuilt = true; writeSummary = writeSet.getSummary(); }
 MemSet &StaticInstRec::getReadSet() { return readSet; }
 MemSet &StaticInstRec::getWriteSet() { return writeSet; }
+AccessSummary &StaticInstRec::getReadSummary() { return readSummary; }
+AccessSummary &StaticInstRec::getWriteSummary() { return writeSummary; }
 bool StaticInstRec::hasReadSet() { return readSetBuilt; }
 bool StaticInstRec::hasWriteSet() { return writeSetBuilt; }
 
@@ -290,17 +436,26 @@ void StaticInstRec::splitLargeStrides(){
 }
 
 MemSetEntry::intervalTree *StaticInstRec::buildIntervalTree(MemSet &memset){
-  MemSetEntry::intervalVector intervals;
-  transform(memset.begin(), memset.end(), back_inserter(intervals), MemSetEntry::toInterval);
-  return new MemSetEntry::intervalTree(intervals);
+  return new MemSetEntry::intervalTree(memset.begin(), memset.end(), MemSetEntry::toInterval);
 }
 
 void StaticInstRec::buildReadTree(){
   readTree = buildIntervalTree(readSet);
 }
 
-void StaticInstRec::buildWriteTree(){
-  writeTree = buildIntervalTree(writeSet);
+void StaticInstRec::buildWriteTree(MemSetEntry::intervalTree *previous){
+  if(previous == NULL){
+    writeTree = buildIntervalTree(writeSet);
+    return;
+  }
+  previous->update(writeSet.begin(), writeSet.end(), MemSetEntry::toInterval);
+  writeTree = previous;
+}
+
+MemSetEntry::intervalTree *StaticInstRec::releaseWriteTree(){
+  MemSetEntry::intervalTree *tree = writeTree;
+  writeTree = NULL;
+  return tree;
 }
 
 void StaticInstRec::buildIntervalTrees(){
@@ -24,7 +24,8 @@
 #include <vector>
 #include <map>
 #include <list>
-#include "IntervalTree.h"
+#include "IntervalIndex.h"
+#include "AccessSummary.h"
 #include "StaticLoopRec.h"
 #include "CallTrace.h"
 
@@ -37,16 +38,23 @@ class MemSetEntry {
   uint64_t end;
   uint64_t iterationNumber;
   uintptr_t effectiveInstrID;
+  intptr_t rowStride;   /* Distance between the bases of consecutive rows of a nested pattern */
+  uint64_t rowLength;   /* Number of instances in each row, 0 if the pattern is not nested */
+  uint64_t tagInvocation;       /* Loop invocation recorded by the tracer */
+  uint64_t tagFirstIteration;   /* First iteration recorded by the tracer */
+  uint64_t tagIterationSpan;    /* Number of iterations covered, equally, by the instances, 0 if not tagged */
 
 public:
-  typedef Interval<MemSetEntry *, uint64_t> interval;
-  typedef vector<interval> intervalVector;
-  typedef IntervalTree<MemSetEntry *, uint64_t> intervalTree;
+  typedef IntervalIndex<MemSetEntry *, uint64_t> intervalTree;
 
-  MemSetEntry() : base(0), stride(0), length(0), start(0), end(0) {}
+  MemSetEntry() : base(0), stride(0), length(0), start(0), end(0), rowStride(0), rowLength(0), tagIterationSpan(0) {}
 
   MemSetEntry(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e)
-    : base(b), stride(s), length(l), start(st), end(e) {}
+    : base(b), stride(s), length(l), start(st), end(e), rowStride(0), rowLength(0), tagIterationSpan(0) {}
+
+  /* A nested pattern, (e - st + 1)/rl rows of rl instances of stride s, with row bases rs apart */
+  MemSetEntry(uintptr_t b, intptr_t s, uint64_t l, uint64_t st, uint64_t e, intptr_t rs, uint64_t rl)
+    : base(b), stride(s), length(l), start(st), end(e), rowStride(rs), rowLength(rl), tagIterationSpan(0) {}
 
   uintptr_t getBase() { return base; }
   intptr_t getStride() { return stride; }
@@ -55,7 +63,9 @@ public:
   uintptr_t getEnd() { return end; }
   uint64_t getIterationNumber() { return iterationNumber; }
   uintptr_t getEffectiveInstrID() { return effectiveInstrID; }
-  uintptr_t getLast() {return base + ((end - start)*stride); }
+  intptr_t getRowStride() { return rowStride; }
+  uint64_t getRowLength() { return rowLength; }
+  uintptr_t getLast() {return getAccessLower(end - start); }
   void setBase(uintptr_t x) { base = x; }
   void setStride(intptr_t x) { stride = x; }
   void setLength(uint64_t x) { length = x; }
@@ -65,19 +75,37 @@ public:
   void setIterationNumber(uint64_t iternum) { iterationNumber = iternum; }
   void setEffectiveInstrID(uintptr_t instrID) { effectiveInstrID = instrID; }
 
+  /* Returns true if the tracer recorded the invocation and iterations of this entry */
+  bool hasIterationTags() { return tagIterationSpan != 0; }
+  uint64_t getTagInvocation() { return tagInvocation; }
+  uint64_t getTagFirstIteration() { return tagFirstIteration; }
+  uint64_t getTagIterationSpan() { return tagIterationSpan; }
+  void setIterationTags(uint64_t inv, uint64_t firstIter, uint64_t span) { tagInvocation = inv; tagFirstIteration = firstIter; tagIterationSpan = span; }
+
   uintptr_t getNumInstances() {
     return end - start + 1;
   }
 
+  /* Returns true if this entry is a repetition of a 1-D pattern whose bases advance by rowStride */
+  bool isNested() { return rowLength != 0; }
+
+  uint64_t getNumRows() {
+    return isNested() ? getNumInstances()/rowLength : 1;
+  }
+
   uintptr_t getUpperExtent(){
-    if(stride >= 0)
+    if(isNested())
+      return getNestedUpperExtent();
+    else if(stride >= 0)
       return base + stride*(end - start) + length - 1;
     else
       return base + length - 1;
   }
 
   uintptr_t getLowerExtent(){
-    if(stride >= 0)
+    if(isNested())
+      return getNestedLowerExtent();
+    else if(stride >= 0)
       return base;
     else
       return base + stride*(end - start);
@@ -85,11 +113,13 @@ public:
 
   /* Returns the upper and lower extent of the nth access in this MemSetEntry */
   uintptr_t getAccessLower(uint64_t n) {
+    if(isNested())
+      return base + (n/rowLength)*rowStride + (n%rowLength)*stride;
     return base + n*stride;
   }
   
   uintptr_t getAccessUpper(uint64_t n) {
-    return base + n*stride + length - 1;
+    return getAccessLower(n) + length - 1;
   }
 
   /* Returns true if an n-byte access is aligned on an n-byte boundary */
@@ -97,8 +127,13 @@ public:
     return base%length == 0;
   }
 
+  /* Returns true if every access of the pattern is aligned on an n-byte boundary */
+  bool isAlignedPattern(){
+    return isAligned() && stride%(intptr_t)(length) == 0 && rowStride%(intptr_t)(length) == 0;
+  }
+
   /* Return a MemSetEntry with positive stride (i.e. reverse the range if stride is negative).
-   * Dynamic instance numbers of the normalised MemSetEntry will be invalid.
+   * Dynamic instance numbers of the normalised MemSetEntry will be invalid. Not valid for nested entries.
   */
   MemSetEntry getNormalised(){
     if(stride < 0)
@@ -116,6 +151,10 @@ public:
   /* Return a new MemSetEntry spanning only the instances specified */
   MemSetEntry getSlice(uint64_t s, uint64_t e);
 
+  /* As getSlice, but a slice of a nested entry which does not fall on row boundaries is returned as up to 
+   * three entries: the partial first row, the complete rows and the partial last row */
+  vector<MemSetEntry> getSlices(uint64_t s, uint64_t e);
+
   /* Return true if the pattern has only 2 instances with a large stride (greater than maxStride) */
   bool isTrivialPattern();
 
@@ -130,13 +169,25 @@ public:
   uint64_t getFirstDynamicInstanceFromAddress(uintptr_t addr);
   uint64_t getLastDynamicInstanceFromAddress(uintptr_t addr);
 
-  static interval toInterval(MemSetEntry& entry);
+  /* Give a slice of this entry the iteration tags of the instances it holds, if it lies within one iteration or falls on iteration boundaries */
+  void tagSlice(MemSetEntry& slice);
+
+  /* The extent of the entry, as indexed by an intervalTree */
+  static void toInterval(MemSetEntry& entry, uint64_t& lower, uint64_t& upper, MemSetEntry*& value);
+
+  /* Add the pages accessed by the entry to a summary, the accesses of a sparse pattern one by one */
+  void addToSummary(AccessSummary& summary);
 
   void printWithIterInfo(ostream& os);
 
   friend ostream& operator<<(ostream& os, const MemSetEntry& e);
 
   static const intptr_t maxStride = 8;
+
+private:
+  uintptr_t getNestedUpperExtent();
+  uint64_t getInstancesPerIteration() { return getNumInstances()/tagIterationSpan; }
+  uintptr_t getNestedLowerExtent();
 };
 
 class MemSet : public vector<MemSetEntry>{
@@ -144,12 +195,23 @@ class MemSet : public vector<MemSetEntry>{
   uint64_t outstandingInstances;
 public:
   //MemSet getInvocationSlice(uintptr_t instrID, InvocationGroup &invGroup, uint64_t invNum, CallTraces& invCallTraces);
-  MemSet getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroupCfc &invGroup, uint64_t invNum, CallTraceLoopInvocationGroup& invCallTraces);
+  /* Tags recorded by the tracer are used, if present, unless useTracerTags is false (they only describe outermost loops) */
+  MemSet getInvocationSliceWithIterTags(uintptr_t instrID, InvocationGroupCfc &invGroup, uint64_t invNum, CallTraceLoopInvocationGroup& invCallTraces, bool useTracerTags = true);
+
+  /* As getInvocationSliceWithIterTags, but the iterations are taken from the tags recorded by the tracer */
+  MemSet getInvocationSliceFromTracerTags(uintptr_t instrID);
+
+  /* Returns true if all remaining entries were tagged by the tracer */
+  bool hasIterationTags();
+
   void initialiseSliceIterator();
 
   /* For all entries with only 2 instances and a large stride, split into 2 entries */
   void splitLargeStrides();
 
+  /* Summary of the pages accessed by all entries */
+  AccessSummary getSummary();
+
   void printWithIterInfo(ostream& os);
 
   friend ostream& operator<<(ostream& os, const MemSet& memset);
@@ -163,6 +225,9 @@ struct StaticInstRec {
   MemSetEntry::intervalTree *writeTree;
   bool readSetBuilt;
   bool writeSetBuilt;
+  /* Pages accessed by the sets, taken when they are set */
+  AccessSummary readSummary;
+  AccessSummary writeSummary;
 
   StaticInstRec();
   ~StaticInstRec();
@@ -171,6 +236,8 @@ struct StaticInstRec {
   void setWriteSet(MemSet w);
   MemSet &getReadSet();
   MemSet &getWriteSet();
+  AccessSummary &getReadSummary();
+  AccessSummary &getWriteSummary();
   bool hasReadTree();
   bool hasWriteTree();
   bool hasReadSet();
@@ -180,7 +247,10 @@ struct StaticInstRec {
 
   void buildIntervalTrees();
   void buildReadTree();
-  void buildWriteTree();
+  /* Build the write tree, by updating the tree of an earlier invocation if one is given */
+  void buildWriteTree(MemSetEntry::intervalTree *previous = NULL);
+  /* Hand over the write tree, so it can be updated for a later invocation */
+  MemSetEntry::intervalTree *releaseWriteTree();
 
   void initialiseSliceIterators();
 
@@ -23,10 +23,13 @@
 #include "StaticLoopRec.h"
 #include "static_inst_rec.h"
 #include "IntervalTree.h"
+#include "IntervalIndex.h"
 #include "parser_wrappers.h"
 #include "memory_allocator.hh"
 #include "ControlFlowCompressor.h"
 #include "dependence_analysis.h"
+#include "ParallelBZ2Reader.h"
+#include "TraceTokenizer.h"
 #include <random>
 #include <time.h>
 #include <assert.h>
@@ -278,12 +281,353 @@ void testCallTraceParseFirstPass(){
   cout << endl;
 }
 
+MemSetEntry randomNestedEntry(int numRows){
+  intptr_t stride = 4*(rand()%5 - 2);
+  uint64_t rowLength = 2 + rand()%6;
+  intptr_t rowStride = 4*(rand()%41 - 20);
+  uintptr_t base = 4000 + 4*(rand()%100);
+  return MemSetEntry(base, stride, 4, 0, numRows*rowLength - 1, rowStride, numRows > 1 ? rowLength : 0);
+}
+
+/* Check the analytical alias test and slicing of nested patterns against brute force */
+void testNestedPatterns(){
+  for(int i = 0; i < 100000; i++){
+    MemSetEntry write = randomNestedEntry(1 + rand()%8);
+    MemSetEntry read = randomNestedEntry(1 + rand()%8);
+    if(!write.isNested() && !read.isNested())
+      continue;
+    if(isAlias(write, read) != isAliasBruteForce(write, read)){
+      cout << "Alias mismatch: " << write << read << endl;
+      abort();
+    }
+  }
+  for(int i = 0; i < 10000; i++){
+    MemSetEntry entry = randomNestedEntry(2 + rand()%8);
+    uint64_t s = rand()%entry.getNumInstances();
+    uint64_t e = s + rand()%(entry.getNumInstances() - s);
+    vector<MemSetEntry> slices = entry.getSlices(s, e);
+    uint64_t n = s;
+    for(auto slice = slices.begin(); slice != slices.end(); slice++){
+      if(slice->getStart() != n){
+        cout << "Slice starts at " << slice->getStart() << " instead of " << n << ": " << entry << *slice << endl;
+        abort();
+      }
+      for(uint64_t j = 0; j < slice->getNumInstances(); j++, n++){
+        if(slice->getAccessLower(j) != entry.getAccessLower(n)){
+          cout << "Slice mismatch: " << entry << *slice << endl;
+          abort();
+        }
+      }
+    }
+    if(n != e + 1){
+      cout << "Slices end at " << n - 1 << " instead of " << e << ": " << entry << endl;
+      abort();
+    }
+  }
+  cout << "SUCCESS!\n";
+}
+
+/* A pattern of accesses of any length, at any alignment, nested if it has more than one row */
+MemSetEntry randomUnalignedEntry(int numRows){
+  uint64_t lengths[] = {1, 2, 3, 4, 8};
+  uint64_t length = lengths[rand()%5];
+  intptr_t stride = rand()%41 - 20;
+  uint64_t rowLength = 1 + rand()%8;
+  intptr_t rowStride = rand()%161 - 80;
+  uintptr_t base = 4000 + rand()%200;
+  if(numRows == 1)
+    return MemSetEntry(base, stride, length, 0, rowLength - 1);
+  return MemSetEntry(base, stride, length, 0, numRows*rowLength - 1, rowStride, rowLength);
+}
+
+/* Check the analytical alias test of accesses of different lengths or alignments against brute force */
+void testUnalignedPatterns(){
+  int numChecked = 0;
+  while(numChecked < 200000){
+    MemSetEntry write = randomUnalignedEntry(rand()%3 ? 1 : 2 + rand()%4);
+    MemSetEntry read = randomUnalignedEntry(rand()%3 ? 1 : 2 + rand()%4);
+    bool aligned = write.getLength() == read.getLength() && write.isAlignedPattern() && read.isAlignedPattern();
+    if(aligned || (!write.isNested() && !read.isNested() && write.getStride() == 0 && read.getStride() == 0))
+      continue;
+    if(isAlias(write, read) != isAliasBruteForce(write, read)){
+      cout << "Alias mismatch: " << write << read << endl;
+      abort();
+    }
+    numChecked++;
+  }
+  cout << "SUCCESS!\n";
+}
+
+/* Check parallel decompression of appended multi-block streams against the original text */
+void testParallelDecompression(){
+  string text;
+  for(int i = 0; i < 400000; i++)
+    text += to_string(1000 + 8*(rand()%(1 + i%64))) + (rand()%4 ? " " : ",\n");
+  string compressed;
+  for(size_t start = 0; start < text.size(); ){
+    /* Streams of varying size, compressed in blocks of 100k */
+    size_t length = min(text.size() - start, (size_t)(1 + rand()%800000));
+    vector<char> stream(length + length/100 + 600);
+    unsigned int streamLength = stream.size();
+    if(BZ2_bzBuffToBuffCompress(&stream[0], &streamLength, &text[start], length, 1, 0, 0) != BZ_OK){
+      cout << "Compression failed\n";
+      abort();
+    }
+    compressed.append(&stream[0], streamLength);
+    start += length;
+  }
+  ParallelBZ2Reader reader("test", compressed.data(), compressed.size());
+  string decompressed;
+  vector<char> buf(100000);
+  while(!reader.finished()){
+    size_t n = reader.read(&buf[0], 1 + rand()%buf.size());
+    decompressed.append(&buf[0], n);
+  }
+  if(decompressed != text){
+    cout << "Decompressed " << decompressed.size() << " bytes differing from the " << text.size() << " compressed\n";
+    abort();
+  }
+  cout << "SUCCESS!\n";
+}
+
+/* The tokens of a trace, as (position, value) for numbers and (position, marker) for markers */
+vector<tuple<size_t, bool, int64_t>> tokenizeTrace(const string& text, bool simd){
+  vector<tuple<size_t, bool, int64_t>> tokens;
+  size_t pos = 0;
+  while(pos < text.size()){
+    pos += simd ? skipSeparators(&text[pos], text.size() - pos) : skipSeparatorsScalar(&text[pos], text.size() - pos);
+    if(pos == text.size())
+      break;
+    if(isTraceDigit(text[pos]) || (text[pos] == '-' && isTraceDigit(text[pos + 1]))){
+      int64_t value;
+      size_t length = simd ? parseNumber(&text[pos], text.size() - pos, value) : parseNumberScalar(&text[pos], value);
+      /* Check numbers that fit against strtoull */
+      if(length <= 19 && value != (int64_t)strtoull(text.substr(pos, length).c_str(), NULL, 10)){
+        cout << "Number " << text.substr(pos, length) << " converted to " << value << endl;
+        abort();
+      }
+      tokens.push_back(make_tuple(pos, true, value));
+      pos += length;
+    }
+    else{
+      tokens.push_back(make_tuple(pos, false, (int64_t)text[pos]));
+      pos++;
+    }
+  }
+  return tokens;
+}
+
+/* Check the vectorised splitting of trace text into tokens against the scalar version, on random text */
+void testTraceTokenizer(){
+  const string separators = " ,\n()[]-.";
+  for(int i = 0; i < 20000; i++){
+    string text;
+    int numPieces = rand()%60;
+    for(int piece = 0; piece < numPieces; piece++){
+      int kind = rand()%8;
+      if(kind < 4){
+        /* Numbers of up to 22 digits, some negative, some with leading zeros */
+        if(rand()%4 == 0)
+          text += '-';
+        int numDigits = 1 + (rand()%3 ? rand()%8 : rand()%22);
+        for(int d = 0; d < numDigits; d++)
+          text += '0' + rand()%10;
+      }
+      else if(kind == 4)
+        text += "ndtriz"[rand()%6];
+      else if(kind == 5)
+        text += (char)(128 + rand()%128);
+      else{
+        int numSeparators = 1 + (rand()%4 ? 0 : rand()%40);
+        for(int sep = 0; sep < numSeparators; sep++)
+          text += separators[rand()%separators.size()];
+      }
+    }
+    if(tokenizeTrace(text, true) != tokenizeTrace(text, false)){
+      cout << "Tokens differ for: " << text << endl;
+      abort();
+    }
+  }
+  cout << "SUCCESS!\n";
+}
+
+typedef Interval<int, uint64_t> indexInterval;
+
+void indexIntervalExtent(indexInterval& ivl, uint64_t& start, uint64_t& stop, int& value){
+  start = ivl.start;
+  stop = ivl.stop;
+  value = ivl.value;
+}
+
+/* Check the overlaps found by an interval index, one at a time and in a batch, against a brute force search */
+void checkIndexOverlaps(IntervalIndex<int, uint64_t>& index, vector<indexInterval>& intervals, vector<indexInterval>& queries){
+  vector<vector<int>> batchFound(queries.size());
+  index.findOverlappingBatch(queries.begin(), queries.end(),
+      [](indexInterval& q, uint64_t& start, uint64_t& stop){ start = q.start; stop = q.stop; },
+      [&batchFound](indexInterval& q, int value){ batchFound[q.value].push_back(value); return true; });
+
+  for(auto q = queries.begin(); q != queries.end(); q++){
+    vector<int> expected;
+    for(auto ivl = intervals.begin(); ivl != intervals.end(); ivl++){
+      if(ivl->start <= q->stop && ivl->stop >= q->start)
+        expected.push_back(ivl->value);
+    }
+    vector<int> found;
+    index.findOverlapping(q->start, q->stop, found);
+    sort(expected.begin(), expected.end());
+    sort(found.begin(), found.end());
+    sort(batchFound[q->value].begin(), batchFound[q->value].end());
+    if(found != expected || batchFound[q->value] != expected){
+      cout << "Overlaps of [" << q->start << "," << q->stop << "] differ, " << intervals.size() << " intervals\n";
+      abort();
+    }
+
+    /* A stopped search visits no more intervals */
+    int numVisited = 0;
+    bool finished = index.findOverlapping(q->start, q->stop, [&numVisited](int){ return ++numVisited < 2; });
+    if(finished != (expected.size() < 2) || numVisited != (int)min<size_t>(expected.size(), 2)){
+      cout << "Search of [" << q->start << "," << q->stop << "] was not stopped\n";
+      abort();
+    }
+  }
+}
+
+/*
+ * Check the overlaps found by the flat interval index against the interval
+ * tree and a brute force search, and again after the intervals are updated
+ */
+void testIntervalIndex(){
+  for(int i = 0; i < 2000; i++){
+    /* Sizes either side of the levels of the index, some with long intervals */
+    int numIntervals = rand()%4 ? rand()%40 : rand()%3000;
+    uint64_t maxStart = 1 + rand()%20000;
+    uint64_t maxLength = rand()%2 ? 16 : 1 + rand()%5000;
+    vector<indexInterval> intervals;
+    for(int n = 0; n < numIntervals; n++)
+      intervals.push_back(randomInterval<int, uint64_t>(maxStart, maxLength, maxStart + maxLength, n));
+    IntervalIndex<int, uint64_t> index(intervals.begin(), intervals.end(), indexIntervalExtent);
+
+    vector<indexInterval> queries;
+    for(int q = 0; q < 50; q++)
+      queries.push_back(randomInterval<int, uint64_t>(maxStart + maxLength, maxLength, 2 * (maxStart + maxLength), q));
+    checkIndexOverlaps(index, intervals, queries);
+
+    /* The tree sorts the intervals it is given, the index is updated by position below */
+    vector<indexInterval> treeIntervals(intervals);
+    IntervalTree<int, uint64_t> tree(treeIntervals);
+    for(auto q = queries.begin(); q != queries.end(); q++){
+      vector<int> found;
+      index.findOverlapping(q->start, q->stop, found);
+      vector<indexInterval> treeOverlaps;
+      tree.findOverlapping(q->start, q->stop, treeOverlaps);
+      vector<int> treeFound;
+      for(auto ivl = treeOverlaps.begin(); ivl != treeOverlaps.end(); ivl++)
+        treeFound.push_back(ivl->value);
+      sort(found.begin(), found.end());
+      sort(treeFound.begin(), treeFound.end());
+      if(found != treeFound){
+        cout << "Overlaps of [" << q->start << "," << q->stop << "] differ from the interval tree\n";
+        abort();
+      }
+    }
+
+    /* The same intervals, all shifted, a few moved, all replaced, or some removed */
+    int change = rand()%5;
+    uint64_t shift = rand()%1000;
+    for(auto ivl = intervals.begin(); ivl != intervals.end(); ivl++){
+      if(change == 1){
+        ivl->start += shift;
+        ivl->stop += shift;
+      }
+      else if(change == 2 && rand()%8 == 0)
+        ivl->stop += rand()%32;
+      else if(change == 3)
+        *ivl = randomInterval<int, uint64_t>(maxStart, maxLength, maxStart + maxLength, ivl->value);
+    }
+    if(change == 4)
+      intervals.erase(intervals.begin() + intervals.size()/2, intervals.end());
+    bool kept = index.update(intervals.begin(), intervals.end(), indexIntervalExtent);
+    if(!kept && change < 2){
+      cout << "Order of the index was lost updating it\n";
+      abort();
+    }
+    checkIndexOverlaps(index, intervals, queries);
+  }
+  cout << "SUCCESS!\n";
+}
+
+/* An entry whose accesses, or rows, may be pages apart, within 256 pages */
+MemSetEntry randomSparseEntry(){
+  uint64_t lengths[] = {1, 4, 8};
+  uint64_t length = lengths[rand()%3];
+  intptr_t stride = rand()%2 ? rand()%33 - 16 : (rand()%2 ? 1 : -1)*(4096*(1 + rand()%4) + rand()%64);
+  uint64_t rowLength = 1 + rand()%6;
+  intptr_t rowStride = rand()%2 ? rand()%129 - 64 : (rand()%2 ? 1 : -1)*(4096*(1 + rand()%8) + rand()%64);
+  uint64_t numRows = rand()%2 ? 1 : 2 + rand()%4;
+  uintptr_t base = 0x100000 + 4096*(100 + rand()%56) + rand()%4096;
+  if(numRows == 1)
+    return MemSetEntry(base, stride, length, 0, rowLength - 1);
+  return MemSetEntry(base, stride, length, 0, numRows*rowLength - 1, rowStride, rowLength);
+}
+
+/* Check that the summaries of sets with common bytes intersect, and that sparse sets are told apart */
+void testMemSetSummaries(){
+  int numDisjoint = 0;
+  for(int i = 0; i < 20000; i++){
+    MemSet sets[2];
+    set<uintptr_t> bytes[2];
+    for(int s = 0; s < 2; s++){
+      int numEntries = 1 + rand()%3;
+      for(int e = 0; e < numEntries; e++){
+        MemSetEntry entry = randomSparseEntry();
+        sets[s].push_back(entry);
+        for(uint64_t n = 0; n < entry.getNumInstances(); n++){
+          for(uintptr_t b = entry.getAccessLower(n); b <= entry.getAccessUpper(n); b++)
+            bytes[s].insert(b);
+        }
+      }
+    }
+    bool common = false;
+    for(auto b = bytes[0].begin(); b != bytes[0].end() && !common; b++)
+      common = bytes[1].count(*b) != 0;
+    bool meet = sets[0].getSummary().mayIntersect(sets[1].getSummary());
+    if(common && !meet){
+      cout << "Summaries of sets with common bytes do not intersect: " << sets[0] << sets[1] << endl;
+      abort();
+    }
+    numDisjoint += !meet;
+  }
+  if(numDisjoint == 0){
+    cout << "No sets were told apart by their summaries\n";
+    abort();
+  }
+  cout << "SUCCESS!\n";
+}
+
 void run_unit_tests(int test){
   srand (time(NULL));
   switch(test){
     case 1:
       testCallTraceParseFirstPass();
       break;
+    case 2:
+      testNestedPatterns();
+      break;
+    case 3:
+      testParallelDecompression();
+      break;
+    case 4:
+      testTraceTokenizer();
+      break;
+    case 5:
+      testIntervalIndex();
+      break;
+    case 6:
+      testUnalignedPatterns();
+      break;
+    case 7:
+      testMemSetSummaries();
+      break;
     default:
       cout << "Specify test\n";
       break;